@@ -1,9 +1,18 @@
 #pragma once
 
+#include <cassert>
 #include <string>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <ostream>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
+#include "AnimationKernels.h"
 #include "Maths.h"
 
 struct Bone
@@ -53,12 +62,14 @@ struct AnimationSequence
 	{
 		return ((float)frames.size() / ticksPerSecond);
 	}
+	// calcFrame, nextFrame and interpolateBoneToGlobal read the full keyframes, which compressClips frees
 	void calcFrame(float t, int& frame, float& interpolationFact)
 	{
+		assert(!frames.empty());
 		interpolationFact = t * ticksPerSecond;
 		frame = (int)floorf(interpolationFact);
 		interpolationFact = interpolationFact - (float)frame;
-		frame = std::min(frame, (int)(frames.size() - 1));
+		frame = std::min(frame, (int)frames.size() - 1);
 	}
 	bool running(float t)
 	{
@@ -70,10 +81,11 @@ struct AnimationSequence
 	}
 	int nextFrame(int frame)
 	{
-		return std::min(frame + 1, (int)(frames.size() - 1));
+		return std::min(frame + 1, (int)frames.size() - 1);
 	}
 	Matrix interpolateBoneToGlobal(Matrix* matrices, int baseFrame, float interpolationFact, Skeleton* skeleton, int boneIndex)
 	{
+		assert(baseFrame >= 0 && baseFrame < (int)frames.size());
 		Matrix scale = Matrix::scaling(interpolate(frames[baseFrame].scales[boneIndex], frames[nextFrame(baseFrame)].scales[boneIndex], interpolationFact));
 		Matrix rotation = interpolate(frames[baseFrame].rotations[boneIndex], frames[nextFrame(baseFrame)].rotations[boneIndex], interpolationFact).toMatrix();
 		Matrix translation = Matrix::translation(interpolate(frames[baseFrame].positions[boneIndex], frames[nextFrame(baseFrame)].positions[boneIndex], interpolationFact));
@@ -87,37 +99,731 @@ struct AnimationSequence
 	}
 };
 
+// How often and how completely an AnimationInstance evaluates its skeleton. Between evaluations the last pose is
+// held. Bones within collapseLevels of the tips of the skeleton (0 keeps every bone) follow their parent.
+struct AnimationLOD
+{
+	int updateInterval = 1;
+	int collapseLevels = 0;
+};
+
+struct AnimationLODTier
+{
+	float maxDistance;
+	AnimationLOD lod;
+};
+
+// Distance bands, nearest first. Instances out of view use offscreen whatever their distance.
+class AnimationLODTiers
+{
+public:
+	std::vector<AnimationLODTier> tiers;
+	AnimationLOD offscreen;
+	AnimationLODTiers()
+	{
+		tiers.push_back({ 15.0f, { 1, 0 } });
+		tiers.push_back({ 30.0f, { 2, 1 } });
+		tiers.push_back({ FLT_MAX, { 3, 2 } });
+		offscreen = { 6, 2 };
+	}
+	AnimationLOD select(float distance, bool visible) const
+	{
+		if (!visible)
+		{
+			return offscreen;
+		}
+		for (const AnimationLODTier& tier : tiers)
+		{
+			if (distance <= tier.maxDistance)
+			{
+				return tier.lod;
+			}
+		}
+		return tiers.empty() ? AnimationLOD() : tiers.back().lod;
+	}
+};
+
+// Bones evaluated against the bones a full rate, full skeleton update would have evaluated
+struct AnimationLODStats
+{
+	long long evaluated = 0;
+	long long fullRate = 0;
+	void add(const AnimationLODStats& other)
+	{
+		evaluated += other.evaluated;
+		fullRate += other.fullRate;
+	}
+};
+
+// Interpolated channels of one pose, one entry per bone
+struct SkeletonScratch
+{
+	static const int MAX_BONES = 256;
+	float px[MAX_BONES], py[MAX_BONES], pz[MAX_BONES];
+	float ra[MAX_BONES], rb[MAX_BONES], rc[MAX_BONES], rd[MAX_BONES];
+	float sx[MAX_BONES], sy[MAX_BONES], sz[MAX_BONES];
+};
+
+// Error allowed when dropping keyframes: model units for positions and scales, quaternion components for rotations
+struct KeyframeTolerance
+{
+	float position = 0.01f;
+	float rotation = 0.001f;
+	float scale = 0.0001f;
+};
+
+// Keys of one channel of one bone, count keyed frames from first in the clip's key arrays. One key is a constant
+// channel.
+struct KeyTrack
+{
+	unsigned int first = 0;
+	unsigned int count = 0;
+};
+
+// Keyframes of one clip with constant channels reduced to one key, and the other channels to the keys that linear
+// interpolation (slerp / nlerp for rotations) cannot rebuild within the tolerance. Rotations are packed into 48
+// bits. Sampling decompresses straight into a SkeletonScratch.
+struct CompressedClip
+{
+	int frameCount = 0;
+	int bonesN = 0;
+	std::vector<KeyTrack> positionTracks, rotationTracks, scaleTracks; // One per bone
+	std::vector<unsigned short> positionFrames, rotationFrames, scaleFrames;
+	std::vector<float> positions, scales; // Three per key
+	std::vector<unsigned short> rotations; // Three per key
+	// Channels are the component arrays of a clip, frame major
+	void build(int frames, int bones, const std::vector<float>* position[3], const std::vector<float>* rotation[4], const std::vector<float>* scale[3],
+		const KeyframeTolerance& tolerance)
+	{
+		frameCount = frames;
+		bonesN = bones;
+		positionTracks.clear();
+		rotationTracks.clear();
+		scaleTracks.clear();
+		positionFrames.clear();
+		rotationFrames.clear();
+		scaleFrames.clear();
+		positions.clear();
+		scales.clear();
+		rotations.clear();
+		for (int b = 0; b < bones; b++)
+		{
+			positionTracks.push_back(reduceVector(position, b, tolerance.position, positionFrames, positions));
+			rotationTracks.push_back(reduceRotation(rotation, b, tolerance.rotation));
+			scaleTracks.push_back(reduceVector(scale, b, tolerance.scale, scaleFrames, scales));
+		}
+	}
+	unsigned int sizeInBytes() const
+	{
+		return ((positionTracks.size() + rotationTracks.size() + scaleTracks.size()) * sizeof(KeyTrack)) +
+			((positionFrames.size() + rotationFrames.size() + scaleFrames.size() + rotations.size()) * sizeof(unsigned short)) +
+			((positions.size() + scales.size()) * sizeof(float));
+	}
+	// Keys either side of frame + interpolationFact in a track, and the fraction of the way between them
+	static void locate(const std::vector<unsigned short>& keyFrames, const KeyTrack& track, int frame, float interpolationFact, int& k0, int& k1, float& fact)
+	{
+		const unsigned short* keys = &keyFrames[track.first];
+		int k = (int)(std::upper_bound(keys, keys + track.count, (unsigned short)frame) - keys) - 1;
+		if (k >= (int)track.count - 1)
+		{
+			k0 = track.first + track.count - 1;
+			k1 = k0;
+			fact = 0.0f;
+			return;
+		}
+		k0 = track.first + k;
+		k1 = k0 + 1;
+		fact = ((float)(frame - keys[k]) + interpolationFact) / (float)(keys[k + 1] - keys[k]);
+	}
+	// Interpolated channels of bones [0, n), as AnimationClip::interpolateLocals
+	void interpolateLocals(int frame, float interpolationFact, int n, SkeletonScratch& scratch) const
+	{
+		for (int i = 0; i < n; i++)
+		{
+			int k0, k1;
+			float fact;
+			locate(positionFrames, positionTracks[i], frame, interpolationFact, k0, k1, fact);
+			const float* p0 = &positions[k0 * 3];
+			const float* p1 = &positions[k1 * 3];
+			scratch.px[i] = (p0[0] * (1.0f - fact)) + (p1[0] * fact);
+			scratch.py[i] = (p0[1] * (1.0f - fact)) + (p1[1] * fact);
+			scratch.pz[i] = (p0[2] * (1.0f - fact)) + (p1[2] * fact);
+
+			locate(rotationFrames, rotationTracks[i], frame, interpolationFact, k0, k1, fact);
+			float a0, b0, c0, d0, a1, b1, c1, d1;
+			AnimationKernels::unpackRotation(&rotations[k0 * 3], a0, b0, c0, d0);
+			if (k1 == k0)
+			{
+				scratch.ra[i] = a0;
+				scratch.rb[i] = b0;
+				scratch.rc[i] = c0;
+				scratch.rd[i] = d0;
+			} else
+			{
+				AnimationKernels::unpackRotation(&rotations[k1 * 3], a1, b1, c1, d1);
+				AnimationKernels::interpolateRotation(a0, b0, c0, d0, a1, b1, c1, d1, fact, scratch.ra[i], scratch.rb[i], scratch.rc[i], scratch.rd[i]);
+			}
+
+			locate(scaleFrames, scaleTracks[i], frame, interpolationFact, k0, k1, fact);
+			const float* s0 = &scales[k0 * 3];
+			const float* s1 = &scales[k1 * 3];
+			scratch.sx[i] = (s0[0] * (1.0f - fact)) + (s1[0] * fact);
+			scratch.sy[i] = (s0[1] * (1.0f - fact)) + (s1[1] * fact);
+			scratch.sz[i] = (s0[2] * (1.0f - fact)) + (s1[2] * fact);
+		}
+	}
+	// Keys of a three component channel of one bone. Each span is grown while every frame inside it is within
+	// tolerance of the straight line between its ends.
+	KeyTrack reduceVector(const std::vector<float>* channel[3], int bone, float tolerance, std::vector<unsigned short>& keyFrames, std::vector<float>& values)
+	{
+		auto value = [&](int frame, int c) { return (*channel[c])[(frame * bonesN) + bone]; };
+		auto keep = [&](int frame) {
+			keyFrames.push_back((unsigned short)frame);
+			for (int c = 0; c < 3; c++)
+			{
+				values.push_back(value(frame, c));
+			}
+		};
+		auto spanFits = [&](int start, int end) {
+			for (int f = start + 1; f < end; f++)
+			{
+				float fact = (float)(f - start) / (float)(end - start);
+				for (int c = 0; c < 3; c++)
+				{
+					if (fabsf((value(start, c) * (1.0f - fact)) + (value(end, c) * fact) - value(f, c)) > tolerance)
+					{
+						return false;
+					}
+				}
+			}
+			return true;
+		};
+		KeyTrack track;
+		track.first = keyFrames.size();
+		keep(0);
+		bool constant = true;
+		for (int f = 1; f < frameCount && constant; f++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				constant = constant && fabsf(value(f, c) - value(0, c)) <= tolerance;
+			}
+		}
+		int start = 0;
+		while (!constant && start < frameCount - 1)
+		{
+			int end = start + 1;
+			while (end + 1 < frameCount && spanFits(start, end + 1))
+			{
+				end++;
+			}
+			keep(end);
+			start = end;
+		}
+		track.count = keyFrames.size() - track.first;
+		return track;
+	}
+	// As reduceVector for rotations, measured after packing so the packing error counts against the tolerance
+	KeyTrack reduceRotation(const std::vector<float>* channel[4], int bone, float tolerance)
+	{
+		std::vector<unsigned short> packed(frameCount * 3);
+		std::vector<float> unpacked(frameCount * 4);
+		for (int f = 0; f < frameCount; f++)
+		{
+			int i = (f * bonesN) + bone;
+			AnimationKernels::packRotation((*channel[0])[i], (*channel[1])[i], (*channel[2])[i], (*channel[3])[i], &packed[f * 3]);
+			AnimationKernels::unpackRotation(&packed[f * 3], unpacked[f * 4], unpacked[(f * 4) + 1], unpacked[(f * 4) + 2], unpacked[(f * 4) + 3]);
+		}
+		// Largest component difference, either way round since q and -q are the same rotation
+		auto error = [&](const float* q, int frame) {
+			int i = (frame * bonesN) + bone;
+			float same = 0.0f;
+			float opposite = 0.0f;
+			for (int c = 0; c < 4; c++)
+			{
+				same = std::max(same, fabsf(q[c] - (*channel[c])[i]));
+				opposite = std::max(opposite, fabsf(q[c] + (*channel[c])[i]));
+			}
+			return std::min(same, opposite);
+		};
+		auto spanFits = [&](int start, int end) {
+			const float* q0 = &unpacked[start * 4];
+			const float* q1 = &unpacked[end * 4];
+			for (int f = start + 1; f < end; f++)
+			{
+				float q[4];
+				AnimationKernels::interpolateRotation(q0[0], q0[1], q0[2], q0[3], q1[0], q1[1], q1[2], q1[3], (float)(f - start) / (float)(end - start), q[0], q[1], q[2], q[3]);
+				if (error(q, f) > tolerance)
+				{
+					return false;
+				}
+			}
+			return true;
+		};
+		auto keep = [&](int frame) {
+			rotationFrames.push_back((unsigned short)frame);
+			rotations.insert(rotations.end(), &packed[frame * 3], &packed[frame * 3] + 3);
+		};
+		KeyTrack track;
+		track.first = rotationFrames.size();
+		keep(0);
+		bool constant = true;
+		for (int f = 1; f < frameCount && constant; f++)
+		{
+			constant = error(&unpacked[0], f) <= tolerance;
+		}
+		int start = 0;
+		while (!constant && start < frameCount - 1)
+		{
+			int end = start + 1;
+			while (end + 1 < frameCount && spanFits(start, end + 1))
+			{
+				end++;
+			}
+			keep(end);
+			start = end;
+		}
+		track.count = rotationFrames.size() - track.first;
+		return track;
+	}
+};
+
+// One sequence with its keyframes in separate position / rotation / scale component arrays, frame major, so
+// sampling a frame walks each array forwards. Element [frame * bonesN + bone].
+struct AnimationClip
+{
+	std::string name;
+	float ticksPerSecond = 1.0f;
+	int frameCount = 0;
+	int bonesN = 0;
+	std::vector<float> px, py, pz;
+	std::vector<float> ra, rb, rc, rd;
+	std::vector<float> sx, sy, sz;
+	// Replaces the arrays above once compress has run
+	CompressedClip compressed;
+	bool isCompressed = false;
+	void build(const std::string& clipName, const AnimationSequence& sequence)
+	{
+		name = clipName;
+		ticksPerSecond = sequence.ticksPerSecond;
+		frameCount = sequence.frames.size();
+		bonesN = frameCount > 0 ? sequence.frames[0].positions.size() : 0;
+		std::vector<float>* channels[] = { &px, &py, &pz, &ra, &rb, &rc, &rd, &sx, &sy, &sz };
+		for (std::vector<float>* channel : channels)
+		{
+			channel->resize(frameCount * bonesN);
+		}
+		for (int f = 0; f < frameCount; f++)
+		{
+			const AnimationFrame& frame = sequence.frames[f];
+			for (int b = 0; b < bonesN; b++)
+			{
+				int i = (f * bonesN) + b;
+				px[i] = frame.positions[b].x;
+				py[i] = frame.positions[b].y;
+				pz[i] = frame.positions[b].z;
+				ra[i] = frame.rotations[b].a;
+				rb[i] = frame.rotations[b].b;
+				rc[i] = frame.rotations[b].c;
+				rd[i] = frame.rotations[b].d;
+				sx[i] = frame.scales[b].x;
+				sy[i] = frame.scales[b].y;
+				sz[i] = frame.scales[b].z;
+			}
+		}
+	}
+	float duration() const
+	{
+		return ((float)frameCount / ticksPerSecond);
+	}
+	void calcFrame(float t, int& frame, float& interpolationFact) const
+	{
+		interpolationFact = t * ticksPerSecond;
+		frame = (int)floorf(interpolationFact);
+		interpolationFact = interpolationFact - (float)frame;
+		frame = std::min(frame, frameCount - 1);
+	}
+	int nextFrame(int frame) const
+	{
+		return std::min(frame + 1, frameCount - 1);
+	}
+	// Interpolated channels of bones [0, n)
+	void interpolateLocals(int frame, float interpolationFact, int n, SkeletonScratch& scratch) const
+	{
+		if (isCompressed)
+		{
+			compressed.interpolateLocals(frame, interpolationFact, n, scratch);
+			return;
+		}
+		int i0 = frame * bonesN;
+		int i1 = nextFrame(frame) * bonesN;
+		AnimationKernels::lerp3(&px[i0], &py[i0], &pz[i0], &px[i1], &py[i1], &pz[i1], interpolationFact, scratch.px, scratch.py, scratch.pz, n);
+		AnimationKernels::interpolateRotations(&ra[i0], &rb[i0], &rc[i0], &rd[i0], &ra[i1], &rb[i1], &rc[i1], &rd[i1], interpolationFact, scratch.ra, scratch.rb, scratch.rc, scratch.rd, n);
+		AnimationKernels::lerp3(&sx[i0], &sy[i0], &sz[i0], &sx[i1], &sy[i1], &sz[i1], interpolationFact, scratch.sx, scratch.sy, scratch.sz, n);
+	}
+	unsigned int sizeInBytes() const
+	{
+		return isCompressed ? compressed.sizeInBytes() : frameCount * bonesN * 10 * sizeof(float);
+	}
+	void compress(const KeyframeTolerance& tolerance)
+	{
+		const std::vector<float>* position[3] = { &px, &py, &pz };
+		const std::vector<float>* rotation[4] = { &ra, &rb, &rc, &rd };
+		const std::vector<float>* scale[3] = { &sx, &sy, &sz };
+		compressed.build(frameCount, bonesN, position, rotation, scale, tolerance);
+		isCompressed = true;
+		for (std::vector<float>* channel : { &px, &py, &pz, &ra, &rb, &rc, &rd, &sx, &sy, &sz })
+		{
+			std::vector<float>().swap(*channel);
+		}
+	}
+};
+
+// Skinning matrices of one clip precomputed at a fixed rate. Only the top three rows of each matrix are kept,
+// the last row of a skinning matrix is always 0 0 0 1. Element [(sample * bones + bone) * 12].
+struct BakedClip
+{
+	float samplesPerSecond = 0;
+	int sampleCount = 0;
+	std::vector<float> rows;
+	unsigned int sizeInBytes() const
+	{
+		return rows.size() * sizeof(float);
+	}
+};
+
+// A bone things attach to, resolved by name once at load time. inverseOffset takes the bone's skinning matrix
+// back to its pose transform.
+struct BoneSocket
+{
+	std::string name;
+	int bone;
+	Matrix inverseOffset;
+};
+
 class Animation
 {
 public:
 	std::map<std::string, AnimationSequence> animations;
 	Skeleton skeleton;
+	// Clips are addressed by handle, the index into clips, resolved once with findClip
+	std::vector<AnimationClip> clips;
+	std::map<std::string, int> clipHandles;
+	// Levels of bones below each bone, 0 for the tips of the skeleton
+	std::vector<int> boneHeights;
+	// Filled in by every AnimationInstance::sample, indexed by the handle from addSocket
+	std::vector<BoneSocket> sockets;
+	// One per clip when baked, empty when evaluated live
+	std::vector<BakedClip> bakedClips;
+	Matrix bakedCoordTransform;
 	int bonesSize()
 	{
 		return skeleton.bones.size();
 	}
-	void calcFrame(std::string name, float t, int& frame, float& interpolationFact)
+	// Rebuilds clips and bone heights from animations and skeleton, call after both are loaded
+	void buildClips()
 	{
-		animations[name].calcFrame(t, frame, interpolationFact);
+		boneHeights.assign(bonesSize(), 0);
+		for (int i = bonesSize() - 1; i > 0; i--)
+		{
+			int parent = skeleton.bones[i].parentIndex;
+			if (parent > -1)
+			{
+				boneHeights[parent] = std::max(boneHeights[parent], boneHeights[i] + 1);
+			}
+		}
+		clips.clear();
+		clipHandles.clear();
+		for (auto& pair : animations)
+		{
+			clipHandles[pair.first] = clips.size();
+			clips.emplace_back();
+			clips.back().build(pair.first, pair.second);
+		}
+	}
+	int findClip(const std::string& name) const
+	{
+		auto it = clipHandles.find(name);
+		return it == clipHandles.end() ? -1 : it->second;
 	}
-	Matrix interpolateBoneToGlobal(std::string name, Matrix* matrices, int baseFrame, float interpolationFact, int boneIndex)
+	bool collapsed(int bone, int collapseLevels) const
 	{
-		return animations[name].interpolateBoneToGlobal(matrices, baseFrame, interpolationFact, &skeleton, boneIndex);
+		return boneHeights[bone] < collapseLevels && skeleton.bones[bone].parentIndex > -1;
 	}
-	void calcTransforms(Matrix* matrices, Matrix coordTransform)
+	// Global (model space) transforms of every bone at time t in one pass. Parents come before their children.
+	// Bones collapsed by collapseLevels are left for calcTransforms to fill in. Returns the bones evaluated.
+	int sampleSkeleton(int clip, float t, Matrix* matrices, int collapseLevels = 0)
 	{
+		const AnimationClip& c = clips[clip];
+		int frame = 0;
+		float interpolationFact = 0;
+		c.calcFrame(t, frame, interpolationFact);
+		int n = std::min(bonesSize(), (int)SkeletonScratch::MAX_BONES);
+		SkeletonScratch scratch;
+		c.interpolateLocals(frame, interpolationFact, n, scratch);
+		int evaluated = 0;
+		for (int i = 0; i < n; i++)
+		{
+			if (collapsed(i, collapseLevels))
+			{
+				continue;
+			}
+			evaluated++;
+			int parent = skeleton.bones[i].parentIndex;
+			if (parent > -1)
+			{
+				Matrix local;
+				AnimationKernels::composeTRS(scratch.sx[i], scratch.sy[i], scratch.sz[i], scratch.ra[i], scratch.rb[i], scratch.rc[i], scratch.rd[i], scratch.px[i], scratch.py[i], scratch.pz[i], local);
+				AnimationKernels::mul(local, matrices[parent], matrices[i]);
+			} else
+			{
+				AnimationKernels::composeTRS(scratch.sx[i], scratch.sy[i], scratch.sz[i], scratch.ra[i], scratch.rb[i], scratch.rc[i], scratch.rd[i], scratch.px[i], scratch.py[i], scratch.pz[i], matrices[i]);
+			}
+		}
+		return evaluated;
+	}
+	// Compresses every clip and frees the full keyframes, including those of the sequences, which keep only their
+	// names and rates, so the name based calcFrame and interpolateBoneToGlobal cannot be used afterwards. Writes
+	// the bytes before and after to report.
+	void compressClips(const KeyframeTolerance& tolerance, std::ostream& report)
+	{
+		unsigned int sequenceBytes = 0;
+		for (auto& pair : animations)
+		{
+			for (const AnimationFrame& frame : pair.second.frames)
+			{
+				sequenceBytes += sizeof(AnimationFrame) + (frame.positions.size() * sizeof(Vec3)) + (frame.rotations.size() * sizeof(Quaternion)) +
+					(frame.scales.size() * sizeof(Vec3));
+			}
+			std::vector<AnimationFrame>().swap(pair.second.frames);
+		}
+		unsigned int clipBytes = 0;
+		unsigned int compressedBytes = 0;
+		for (AnimationClip& clip : clips)
+		{
+			clipBytes += clip.sizeInBytes();
+			clip.compress(tolerance);
+			compressedBytes += clip.sizeInBytes();
+		}
+		report << "  Keyframes: " << sequenceBytes / 1024.0f << " KB as frames and " << clipBytes / 1024.0f << " KB as clips, "
+			<< compressedBytes / 1024.0f << " KB compressed" << std::endl;
+	}
+	// Socket handle for a bone, -1 if the skeleton has no bone of that name. Call at load time, before sampling.
+	int addSocket(const std::string& boneName)
+	{
+		int socket = findSocket(boneName);
+		if (socket != -1)
+		{
+			return socket;
+		}
+		int bone = skeleton.findBone(boneName);
+		if (bone == -1)
+		{
+			return -1;
+		}
+		BoneSocket added;
+		added.name = boneName;
+		added.bone = bone;
+		added.inverseOffset = skeleton.bones[bone].offset.invert();
+		sockets.push_back(added);
+		return sockets.size() - 1;
+	}
+	int findSocket(const std::string& boneName) const
+	{
+		for (int i = 0; i < sockets.size(); i++)
+		{
+			if (sockets[i].name == boneName)
+			{
+				return i;
+			}
+		}
+		return -1;
+	}
+	// Precomputes the skinning matrices of every clip for instances using coordTransform, from time 0 to the
+	// end of the clip, and writes the size of each table to report
+	void bake(float samplesPerSecond, const Matrix& coordTransform, std::ostream& report)
+	{
+		bakedClips.clear();
+		bakedCoordTransform = coordTransform;
+		std::vector<Matrix> matrices(bonesSize());
+		unsigned int total = 0;
+		for (int clip = 0; clip < clips.size(); clip++)
+		{
+			BakedClip baked;
+			baked.samplesPerSecond = samplesPerSecond;
+			baked.sampleCount = (int)ceilf(clips[clip].duration() * samplesPerSecond) + 1;
+			baked.rows.resize(baked.sampleCount * bonesSize() * 12);
+			for (int sample = 0; sample < baked.sampleCount; sample++)
+			{
+				sampleSkeleton(clip, (float)sample / samplesPerSecond, matrices.data());
+				calcTransforms(matrices.data(), coordTransform);
+				for (int i = 0; i < bonesSize(); i++)
+				{
+					memcpy(&baked.rows[((sample * bonesSize()) + i) * 12], matrices[i].m, 12 * sizeof(float));
+				}
+			}
+			report << "  " << clips[clip].name << ": " << baked.sampleCount << " samples, " << baked.sizeInBytes() / 1024.0f << " KB" << std::endl;
+			total += baked.sizeInBytes();
+			bakedClips.push_back(baked);
+		}
+		report << "  Total: " << total / 1024.0f << " KB for " << clips.size() << " clips" << std::endl;
+	}
+	bool baked(const Matrix& coordTransform) const
+	{
+		return !bakedClips.empty() && memcmp(bakedCoordTransform.m, coordTransform.m, sizeof(bakedCoordTransform.m)) == 0;
+	}
+	// Skinning matrices at time t blended from the two nearest baked samples
+	void sampleBaked(int clip, float t, Matrix* matrices) const
+	{
+		const BakedClip& baked = bakedClips[clip];
+		float position = std::max(t * baked.samplesPerSecond, 0.0f);
+		int sample = std::min((int)position, baked.sampleCount - 1);
+		int next = std::min(sample + 1, baked.sampleCount - 1);
+		float fact = std::min(position - (float)sample, 1.0f);
+		int bones = skeleton.bones.size();
+		const float* r0 = &baked.rows[sample * bones * 12];
+		const float* r1 = &baked.rows[next * bones * 12];
+		for (int i = 0; i < bones; i++)
+		{
+			AnimationKernels::lerpRows(&r0[i * 12], &r1[i * 12], fact, matrices[i]);
+		}
+	}
+	// Skinning matrices at time t, looked up when the clips are baked for coordTransform and evaluated otherwise.
+	// Returns the bones evaluated, none for a lookup.
+	int evaluatePose(int clip, float t, Matrix* matrices, const Matrix& coordTransform, int collapseLevels)
+	{
+		if (baked(coordTransform))
+		{
+			sampleBaked(clip, t, matrices);
+			return 0;
+		}
+		int evaluated = sampleSkeleton(clip, t, matrices, collapseLevels);
+		calcTransforms(matrices, coordTransform, collapseLevels);
+		return evaluated;
+	}
+	// Per-frame reference path over the full keyframes, kept as the baseline the clip sampling is checked against.
+	// Only valid before compressClips, and for a sequence that exists.
+	void calcFrame(const std::string& name, float t, int& frame, float& interpolationFact)
+	{
+		animations.at(name).calcFrame(t, frame, interpolationFact);
+	}
+	Matrix interpolateBoneToGlobal(const std::string& name, Matrix* matrices, int baseFrame, float interpolationFact, int boneIndex)
+	{
+		return animations.at(name).interpolateBoneToGlobal(matrices, baseFrame, interpolationFact, &skeleton, boneIndex);
+	}
+	// Global transforms to skinning matrices. Collapsed bones take their parent's skinning matrix, so their
+	// vertices move rigidly with the parent.
+	void calcTransforms(Matrix* matrices, Matrix coordTransform, int collapseLevels = 0)
+	{
+		Matrix toModel = skeleton.globalInverse * coordTransform;
 		for (int i = 0; i < bonesSize(); i++)
 		{
-			matrices[i] = skeleton.bones[i].offset * matrices[i] * skeleton.globalInverse * coordTransform;
+			if (collapsed(i, collapseLevels))
+			{
+				matrices[i] = matrices[skeleton.bones[i].parentIndex];
+				continue;
+			}
+			Matrix bone;
+			AnimationKernels::mul(skeleton.bones[i].offset, matrices[i], bone);
+			AnimationKernels::mul(bone, toModel, matrices[i]);
 		}
 	}
 	bool hasAnimation(std::string name)
 	{
-		if (animations.find(name) == animations.end())
+		return findClip(name) != -1;
+	}
+};
+
+// Skinning matrices of one model shared by every instance showing the same pose. A pose is keyed by clip, time
+// quantized to samplesPerSecond and collapseLevels, and is evaluated the first time an instance asks for it.
+// Instances hold a reference to their slot. Slots nobody holds keep their pose for later hits until a miss
+// needs the space, oldest released first. Instances updated on different threads take mutex around their use.
+class PoseCache
+{
+public:
+	std::mutex mutex;
+	Animation* animation = nullptr;
+	Matrix coordTransform;
+	float samplesPerSecond = 60.0f;
+	long long hits = 0;
+	long long misses = 0;
+	int bones = 0;
+	std::vector<Matrix> storage; // bones matrices per slot
+	std::vector<unsigned long long> keys;
+	std::vector<int> refs;
+	std::vector<bool> queued;
+	std::deque<int> freeSlots;
+	std::unordered_map<unsigned long long, int> slots;
+	void init(Animation* _animation, const Matrix& _coordTransform)
+	{
+		animation = _animation;
+		coordTransform = _coordTransform;
+		bones = animation->bonesSize();
+		storage.clear();
+		keys.clear();
+		refs.clear();
+		queued.clear();
+		freeSlots.clear();
+		slots.clear();
+	}
+	// Slot holding the pose, with a reference taken for the caller. bonesEvaluated is 0 on a hit.
+	int acquire(int clip, float t, int collapseLevels, int& bonesEvaluated)
+	{
+		int tick = (int)floorf(t * samplesPerSecond);
+		unsigned long long key = ((unsigned long long)clip << 40) | ((unsigned long long)(collapseLevels & 0xff) << 32) | (unsigned int)tick;
+		auto it = slots.find(key);
+		if (it != slots.end())
+		{
+			hits++;
+			refs[it->second]++;
+			bonesEvaluated = 0;
+			return it->second;
+		}
+		misses++;
+		int slot = takeSlot();
+		keys[slot] = key;
+		refs[slot] = 1;
+		slots[key] = slot;
+		bonesEvaluated = animation->evaluatePose(clip, (float)tick / samplesPerSecond, &storage[slot * bones], coordTransform, collapseLevels);
+		return slot;
+	}
+	void release(int slot)
+	{
+		if (slot < 0)
 		{
-			return false;
+			return;
+		}
+		refs[slot]--;
+		if (refs[slot] == 0 && !queued[slot])
+		{
+			queued[slot] = true;
+			freeSlots.push_back(slot);
 		}
-		return true;
+	}
+	const Matrix* pose(int slot) const
+	{
+		return &storage[slot * bones];
+	}
+	int takeSlot()
+	{
+		while (!freeSlots.empty())
+		{
+			int slot = freeSlots.front();
+			freeSlots.pop_front();
+			queued[slot] = false;
+			// Slots hit again after their release are skipped
+			if (refs[slot] == 0)
+			{
+				slots.erase(keys[slot]);
+				return slot;
+			}
+		}
+		int slot = refs.size();
+		keys.push_back(0);
+		refs.push_back(0);
+		queued.push_back(false);
+		storage.resize(refs.size() * bones);
+		return slot;
 	}
 };
 
@@ -126,10 +832,17 @@ class AnimationInstance
 public:
 	Animation* animation;
 	std::string usingAnimation;
+	int clip = -1;
 	float t;
-	Matrix matrices[256]; 
-	Matrix matricesPose[256]; 
+	AnimationLOD lod;
+	int framesUntilSample = 0;
+	int bonesEvaluated = 0; // By the last update, 0 if it held the previous pose or shared a cached one
+	PoseCache* poseCache = nullptr;
+	int cachedPose = -1;
+	std::vector<Matrix> matrices; // Own pose, only allocated without a pose cache
+	std::vector<Matrix> socketMatrices; // Per socket of animation, updated with the pose
 	Matrix coordTransform;
+	Matrix skinningToModel; // Undoes globalInverse between coordTransform and its inverse
 	void init(Animation* _animation, int fromYZX)
 	{
 		animation = _animation;
@@ -141,6 +854,7 @@ public:
 			coordTransform.a[1][2] = -1.0f;
 			coordTransform.a[3][3] = 1.0f;
 		}
+		skinningToModel = coordTransform.invert() * animation->skeleton.globalInverse.invert() * coordTransform;
 	}
 	void update(std::string name, float dt)
 	{
@@ -150,20 +864,109 @@ public:
 		} else
 		{
 			usingAnimation = name;
+			clip = animation->findClip(name);
+			t = 0;
+			framesUntilSample = 0;
+		}
+		step();
+	}
+	// Same as update(name, dt) for a handle from Animation::findClip, without any string work per frame
+	void update(int clipHandle, float dt)
+	{
+		if (clipHandle == clip)
+		{
+			t += dt;
+		} else
+		{
+			clip = clipHandle;
+			usingAnimation = clip < 0 ? "" : animation->clips[clip].name;
 			t = 0;
+			framesUntilSample = 0;
 		}
-		if (animationFinished() == true)
+		step();
+	}
+	// A tier with a shorter interval than the current wait samples on the next update
+	void setLOD(const AnimationLOD& newLOD)
+	{
+		lod = newLOD;
+		if (framesUntilSample > lod.updateInterval)
+		{
+			framesUntilSample = 0;
+		}
+	}
+	// Samples every lod.updateInterval updates and holds the pose in between. Switching clips samples at once.
+	void step()
+	{
+		bonesEvaluated = 0;
+		framesUntilSample--;
+		if (framesUntilSample <= 0)
+		{
+			sample();
+			framesUntilSample = lod.updateInterval;
+		}
+	}
+	// Share poses through cache instead of evaluating them here. The cache's coordTransform replaces this one's.
+	void usePoseCache(PoseCache* cache)
+	{
+		if (poseCache != nullptr)
+		{
+			std::lock_guard<std::mutex> guard(poseCache->mutex);
+			poseCache->release(cachedPose);
+		}
+		poseCache = cache;
+		cachedPose = -1;
+	}
+	void sample()
+	{
+		if (clip < 0 || animationFinished() == true)
 		{
 			return;
 		}
-		int frame = 0;
-		float interpolationFact = 0;
-		animation->calcFrame(name, t, frame, interpolationFact);
-		for (int i = 0; i < animation->bonesSize(); i++)
+		if (poseCache != nullptr)
+		{
+			// Held through updateSockets too, as another instance's miss can grow the storage it reads
+			std::lock_guard<std::mutex> guard(poseCache->mutex);
+			int previous = cachedPose;
+			cachedPose = poseCache->acquire(clip, t, lod.collapseLevels, bonesEvaluated);
+			poseCache->release(previous);
+			updateSockets();
+			return;
+		}
+		matrices.resize(animation->bonesSize());
+		bonesEvaluated = animation->evaluatePose(clip, t, matrices.data(), coordTransform, lod.collapseLevels);
+		updateSockets();
+	}
+	// Socket matrices from the skinning matrices, so they follow whichever way the pose was produced
+	void updateSockets()
+	{
+		if (animation->sockets.empty())
+		{
+			return;
+		}
+		const Matrix* skinning = pose();
+		socketMatrices.resize(animation->sockets.size());
+		for (int i = 0; i < socketMatrices.size(); i++)
 		{
-			matrices[i] = animation->interpolateBoneToGlobal(name, matrices, frame, interpolationFact, i);
+			const BoneSocket& socket = animation->sockets[i];
+			Matrix bone;
+			AnimationKernels::mul(socket.inverseOffset, skinning[socket.bone], bone);
+			AnimationKernels::mul(bone, skinningToModel, socketMatrices[i]);
 		}
-		animation->calcTransforms(matrices, coordTransform);
+	}
+	// Model space transform of a socket in the current pose
+	const Matrix& socketMatrix(int socket) const
+	{
+		return socketMatrices[socket];
+	}
+	// Skinning matrices of the current pose, bonesSize() of them
+	const Matrix* pose()
+	{
+		if (cachedPose >= 0)
+		{
+			return poseCache->pose(cachedPose);
+		}
+		matrices.resize(animation->bonesSize());
+		return matrices.data();
 	}
 	void resetAnimationTime()
 	{
@@ -171,29 +974,66 @@ public:
 	}
 	bool animationFinished()
 	{
-		if (t > animation->animations[usingAnimation].duration())
+		if (clip < 0 || t > animation->clips[clip].duration())
 		{
 			return true;
 		}
 		return false;
 	}
-	Matrix findWorldMatrix(std::string boneName)
+	// Model space transform of a bone by name in the current pose. Bones registered with Animation::addSocket are
+	// a lookup, any other bone searches the skeleton first.
+	Matrix findWorldMatrix(const std::string& boneName)
 	{
-		int boneID = animation->skeleton.findBone(boneName);
-		std::vector<int> boneChain;
-		int ID = boneID;
-		while (ID != -1)
+		int socket = animation->findSocket(boneName);
+		if (socket != -1 && socket < socketMatrices.size())
 		{
-			boneChain.push_back(ID);
-			ID = animation->skeleton.bones[ID].parentIndex;
+			return socketMatrices[socket];
 		}
-		int frame = 0;
-		float interpolationFact = 0;
-		animation->calcFrame(usingAnimation, t, frame, interpolationFact);
-		for (int i = boneChain.size() - 1; i > -1; i = i - 1)
+		int bone = animation->skeleton.findBone(boneName);
+		if (bone == -1 || clip < 0)
 		{
-			matricesPose[boneChain[i]] = animation->interpolateBoneToGlobal(usingAnimation, matricesPose, frame, interpolationFact, boneChain[i]);
+			return coordTransform;
 		}
-		return (matricesPose[boneID] * coordTransform);
+		return animation->skeleton.bones[bone].offset.invert() * pose()[bone] * skinningToModel;
 	}
-};
\ No newline at end of file
+};
+
+// Bone palettes of many instances of one model packed back to back for a single instanced draw. Each instance
+// takes stride() matrices: its world matrix followed by one matrix per bone.
+class SkinPalette
+{
+public:
+	std::vector<Matrix> matrices;
+	int bones = 0;
+	int count = 0;
+	void begin(int bonesPerInstance)
+	{
+		bones = bonesPerInstance;
+		count = 0;
+		matrices.clear();
+	}
+	int stride() const
+	{
+		return bones + 1;
+	}
+	void add(const Matrix& world, const Matrix* boneMatrices)
+	{
+		matrices.resize((count + 1) * stride());
+		Matrix* slot = &matrices[count * stride()];
+		slot[0] = world;
+		memcpy(&slot[1], boneMatrices, bones * sizeof(Matrix));
+		count++;
+	}
+	const Matrix& world(int instance) const
+	{
+		return matrices[instance * stride()];
+	}
+	const Matrix& bone(int instance, int boneIndex) const
+	{
+		return matrices[instance * stride() + 1 + boneIndex];
+	}
+	unsigned int sizeInBytes() const
+	{
+		return count * stride() * sizeof(Matrix);
+	}
+};
@@ -0,0 +1,243 @@
+#pragma once
+
+#include "Maths.h"
+
+#if !defined(ANIMATION_KERNELS_SCALAR) && (defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__))
+#define ANIMATION_KERNELS_SSE
+#include <xmmintrin.h>
+#endif
+
+// Batched keyframe interpolation over arrays of bones. Inputs are the component arrays of two keyframes,
+// outputs are component arrays of n bones. SSE handles four bones at a time, the scalar versions handle the
+// remainder and builds without SSE (or with ANIMATION_KERNELS_SCALAR defined).
+namespace AnimationKernels
+{
+	// Keyframes closer than this (dot product of the rotations) are blended with nlerp instead of slerp.
+	// Below 3.6 degrees apart nlerp stays within about 1e-6 radians of slerp, and unlike Quaternion::slerp it
+	// does not snap to the first key when acosf rounds the angle to zero.
+	const float NLERP_THRESHOLD = 0.9995f;
+
+	inline void lerp3(const float* x0, const float* y0, const float* z0, const float* x1, const float* y1, const float* z1, float t, float* x, float* y, float* z, int n)
+	{
+		int i = 0;
+		float t0 = 1.0f - t;
+#ifdef ANIMATION_KERNELS_SSE
+		__m128 vt = _mm_set1_ps(t);
+		__m128 vt0 = _mm_set1_ps(t0);
+		for (; i + 4 <= n; i += 4)
+		{
+			_mm_storeu_ps(&x[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&x0[i]), vt0), _mm_mul_ps(_mm_loadu_ps(&x1[i]), vt)));
+			_mm_storeu_ps(&y[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&y0[i]), vt0), _mm_mul_ps(_mm_loadu_ps(&y1[i]), vt)));
+			_mm_storeu_ps(&z[i], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&z0[i]), vt0), _mm_mul_ps(_mm_loadu_ps(&z1[i]), vt)));
+		}
+#endif
+		for (; i < n; i++)
+		{
+			x[i] = (x0[i] * t0) + (x1[i] * t);
+			y[i] = (y0[i] * t0) + (y1[i] * t);
+			z[i] = (z0[i] * t0) + (z1[i] * t);
+		}
+	}
+
+	// One rotation, slerp unless the keyframes are close enough for nlerp
+	inline void interpolateRotation(float a0, float b0, float c0, float d0, float a1, float b1, float c1, float d1, float t, float& a, float& b, float& c, float& d)
+	{
+		float dp = a0 * a1 + b0 * b1 + c0 * c1 + d0 * d1;
+		if (fabsf(dp) < NLERP_THRESHOLD)
+		{
+			Quaternion q = Quaternion::slerp(Quaternion(a0, b0, c0, d0), Quaternion(a1, b1, c1, d1), t);
+			a = q.a;
+			b = q.b;
+			c = q.c;
+			d = q.d;
+			return;
+		}
+		float t0 = dp < 0 ? -(1.0f - t) : (1.0f - t);
+		a = a0 * t0 + a1 * t;
+		b = b0 * t0 + b1 * t;
+		c = c0 * t0 + c1 * t;
+		d = d0 * t0 + d1 * t;
+		float inv = 1.0f / sqrtf(a * a + b * b + c * c + d * d);
+		a *= inv;
+		b *= inv;
+		c *= inv;
+		d *= inv;
+	}
+
+	// Rotations of n bones. Lanes whose keyframes are too far apart for nlerp fall back to scalar slerp.
+	inline void interpolateRotations(const float* a0, const float* b0, const float* c0, const float* d0, const float* a1, const float* b1, const float* c1, const float* d1, float t,
+		float* a, float* b, float* c, float* d, int n)
+	{
+		int i = 0;
+#ifdef ANIMATION_KERNELS_SSE
+		__m128 vt = _mm_set1_ps(t);
+		__m128 vt0 = _mm_set1_ps(1.0f - t);
+		__m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 threshold = _mm_set1_ps(NLERP_THRESHOLD);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128 qa0 = _mm_loadu_ps(&a0[i]);
+			__m128 qb0 = _mm_loadu_ps(&b0[i]);
+			__m128 qc0 = _mm_loadu_ps(&c0[i]);
+			__m128 qd0 = _mm_loadu_ps(&d0[i]);
+			__m128 qa1 = _mm_loadu_ps(&a1[i]);
+			__m128 qb1 = _mm_loadu_ps(&b1[i]);
+			__m128 qc1 = _mm_loadu_ps(&c1[i]);
+			__m128 qd1 = _mm_loadu_ps(&d1[i]);
+			__m128 dp = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qa0, qa1), _mm_mul_ps(qb0, qb1)), _mm_add_ps(_mm_mul_ps(qc0, qc1), _mm_mul_ps(qd0, qd1)));
+			// Take the short way round by flipping the weight of the first key when the dot product is negative
+			__m128 w0 = _mm_xor_ps(vt0, _mm_and_ps(dp, signMask));
+			__m128 qa = _mm_add_ps(_mm_mul_ps(qa0, w0), _mm_mul_ps(qa1, vt));
+			__m128 qb = _mm_add_ps(_mm_mul_ps(qb0, w0), _mm_mul_ps(qb1, vt));
+			__m128 qc = _mm_add_ps(_mm_mul_ps(qc0, w0), _mm_mul_ps(qc1, vt));
+			__m128 qd = _mm_add_ps(_mm_mul_ps(qd0, w0), _mm_mul_ps(qd1, vt));
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(qa, qa), _mm_mul_ps(qb, qb)), _mm_add_ps(_mm_mul_ps(qc, qc), _mm_mul_ps(qd, qd)));
+			__m128 inv = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(lengthSq));
+			_mm_storeu_ps(&a[i], _mm_mul_ps(qa, inv));
+			_mm_storeu_ps(&b[i], _mm_mul_ps(qb, inv));
+			_mm_storeu_ps(&c[i], _mm_mul_ps(qc, inv));
+			_mm_storeu_ps(&d[i], _mm_mul_ps(qd, inv));
+			int far = _mm_movemask_ps(_mm_cmplt_ps(_mm_andnot_ps(signMask, dp), threshold));
+			for (int lane = 0; far != 0; lane++, far >>= 1)
+			{
+				if (far & 1)
+				{
+					int j = i + lane;
+					interpolateRotation(a0[j], b0[j], c0[j], d0[j], a1[j], b1[j], c1[j], d1[j], t, a[j], b[j], c[j], d[j]);
+				}
+			}
+		}
+#endif
+		for (; i < n; i++)
+		{
+			interpolateRotation(a0[i], b0[i], c0[i], d0[i], a1[i], b1[i], c1[i], d1[i], t, a[i], b[i], c[i], d[i]);
+		}
+	}
+
+	// Matrix::scaling(s) * rotation.toMatrix() * Matrix::translation(p) written out directly
+	inline void composeTRS(float sx, float sy, float sz, float a, float b, float c, float d, float px, float py, float pz, Matrix& out)
+	{
+		float aa = a * a;
+		float ab = a * b;
+		float ac = a * c;
+		float bb = b * b;
+		float cc = c * c;
+		float bc = b * c;
+		float da = d * a;
+		float db = d * b;
+		float dc = d * c;
+		out.m[0] = (1.0f - 2.0f * (bb + cc)) * sx;
+		out.m[1] = 2.0f * (ab - dc) * sy;
+		out.m[2] = 2.0f * (ac + db) * sz;
+		out.m[3] = px;
+		out.m[4] = 2.0f * (ab + dc) * sx;
+		out.m[5] = (1.0f - 2.0f * (aa + cc)) * sy;
+		out.m[6] = 2.0f * (bc - da) * sz;
+		out.m[7] = py;
+		out.m[8] = 2.0f * (ac - db) * sx;
+		out.m[9] = 2.0f * (bc + da) * sy;
+		out.m[10] = (1.0f - 2.0f * (aa + bb)) * sz;
+		out.m[11] = pz;
+		out.m[12] = 0;
+		out.m[13] = 0;
+		out.m[14] = 0;
+		out.m[15] = 1;
+	}
+
+	// Blend of two affine matrices given as their top three rows (12 floats each). The last row is 0 0 0 1.
+	inline void lerpRows(const float* r0, const float* r1, float t, Matrix& out)
+	{
+		float t0 = 1.0f - t;
+#ifdef ANIMATION_KERNELS_SSE
+		__m128 vt = _mm_set1_ps(t);
+		__m128 vt0 = _mm_set1_ps(t0);
+		for (int row = 0; row < 3; row++)
+		{
+			_mm_store_ps(&out.m[row * 4], _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(&r0[row * 4]), vt0), _mm_mul_ps(_mm_loadu_ps(&r1[row * 4]), vt)));
+		}
+#else
+		for (int i = 0; i < 12; i++)
+		{
+			out.m[i] = (r0[i] * t0) + (r1[i] * t);
+		}
+#endif
+		out.m[12] = 0;
+		out.m[13] = 0;
+		out.m[14] = 0;
+		out.m[15] = 1;
+	}
+
+	// Rotation in 48 bits: the three smallest components at 15 bits each, with the index of the largest in the top
+	// bits of the first two words. The largest is made positive and rebuilt from the unit length when unpacking.
+	inline void packRotation(float a, float b, float c, float d, unsigned short* packed)
+	{
+		float q[4] = { a, b, c, d };
+		int largest = 0;
+		for (int i = 1; i < 4; i++)
+		{
+			if (fabsf(q[i]) > fabsf(q[largest]))
+			{
+				largest = i;
+			}
+		}
+		float sign = q[largest] < 0 ? -1.0f : 1.0f;
+		int out = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			// [-1/sqrt(2), 1/sqrt(2)] to [0, 1]
+			float v = (q[i] * sign * 0.70710678f) + 0.5f;
+			v = v < 0.0f ? 0.0f : (v > 1.0f ? 1.0f : v);
+			packed[out++] = (unsigned short)((v * 32767.0f) + 0.5f);
+		}
+		packed[0] |= (unsigned short)((largest & 1) << 15);
+		packed[1] |= (unsigned short)((largest >> 1) << 15);
+	}
+
+	inline void unpackRotation(const unsigned short* packed, float& a, float& b, float& c, float& d)
+	{
+		int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+		float q[4];
+		float sum = 0.0f;
+		int in = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			if (i == largest)
+			{
+				continue;
+			}
+			q[i] = (((packed[in++] & 0x7fff) / 32767.0f) - 0.5f) * 1.41421356f;
+			sum += q[i] * q[i];
+		}
+		q[largest] = sqrtf(sum < 1.0f ? 1.0f - sum : 0.0f);
+		a = q[0];
+		b = q[1];
+		c = q[2];
+		d = q[3];
+	}
+
+	// Same result as lhs * rhs (Matrix::mul): each output row is the rows of lhs weighted by a row of rhs
+	inline void mul(const Matrix& lhs, const Matrix& rhs, Matrix& out)
+	{
+#ifdef ANIMATION_KERNELS_SSE
+		__m128 l0 = _mm_load_ps(&lhs.m[0]);
+		__m128 l1 = _mm_load_ps(&lhs.m[4]);
+		__m128 l2 = _mm_load_ps(&lhs.m[8]);
+		__m128 l3 = _mm_load_ps(&lhs.m[12]);
+		for (int row = 0; row < 4; row++)
+		{
+			const float* r = &rhs.m[row * 4];
+			__m128 v = _mm_mul_ps(l0, _mm_set1_ps(r[0]));
+			v = _mm_add_ps(v, _mm_mul_ps(l1, _mm_set1_ps(r[1])));
+			v = _mm_add_ps(v, _mm_mul_ps(l2, _mm_set1_ps(r[2])));
+			v = _mm_add_ps(v, _mm_mul_ps(l3, _mm_set1_ps(r[3])));
+			_mm_store_ps(&out.m[row * 4], v);
+		}
+#else
+		out = ((Matrix&)lhs).mul(rhs);
+#endif
+	}
+}
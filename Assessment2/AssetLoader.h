@@ -0,0 +1,188 @@
+#pragma once
+#include "Core.h"
+#include "GEMCache.h"
+#include "Model.h"
+#include "Sounds.h"
+#include "Texture.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <ostream>
+#include <set>
+#include <thread>
+
+// Per-asset record of when and how long decode (worker thread) and upload (main thread) took
+class StartupTimeline {
+public:
+  struct Entry {
+    std::string name;
+    std::string kind;
+    int thread = -1;
+    double decodeStart = 0;
+    double decodeMs = 0;
+    double uploadStart = 0;
+    double uploadMs = 0;
+  };
+  std::vector<Entry> entries;
+  std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+  double now() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+  }
+
+  // Entries are added before a parallel pass so each worker only writes its own slot
+  int add(const std::string &name, const std::string &kind) {
+    Entry entry;
+    entry.name = name;
+    entry.kind = kind;
+    entries.push_back(entry);
+    return (int)entries.size() - 1;
+  }
+
+  void write(std::ostream &out) const {
+    double decodeTotal = 0, uploadTotal = 0;
+    out << "kind\tthread\tdecode start\tdecode ms\tupload start\tupload ms\tasset" << std::endl;
+    for (const Entry &e : entries) {
+      out << e.kind << "\t" << e.thread << "\t" << e.decodeStart << "\t" << e.decodeMs << "\t" << e.uploadStart << "\t" << e.uploadMs << "\t"
+          << e.name << std::endl;
+      decodeTotal += e.decodeMs;
+      uploadTotal += e.uploadMs;
+    }
+    out << entries.size() << " assets, " << decodeTotal << " ms decode (summed over workers), " << uploadTotal << " ms upload, "
+        << now() << " ms wall" << std::endl;
+  }
+};
+
+// Startup asset pipeline. Files are decoded on a pool of worker threads, then GPU resources are created on the
+// calling thread. Their uploads are queued by Core and go out as one copy queue submission in submitUploads.
+class AssetLoader {
+public:
+  StartupTimeline timeline;
+
+  // Runs job(i, thread) for every i in [0, count) across the hardware threads
+  static void parallelFor(int count, const std::function<void(int, int)> &job) {
+    int threads = std::min((int)std::max(1u, std::thread::hardware_concurrency()), count);
+    std::atomic<int> next(0);
+    auto worker = [&](int thread) {
+      for (int i = next++; i < count; i = next++) {
+        job(i, thread);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+      pool.emplace_back(worker, t);
+    }
+    worker(0);
+    for (std::thread &t : pool) {
+      t.join();
+    }
+  }
+
+  void loadModels(Core *core, const std::vector<StaticModel *> &staticModels, const std::vector<std::string> &staticPaths,
+                  const std::vector<AnimatedModel *> &animatedModels, const std::vector<std::string> &animatedPaths,
+                  PSOManager *psos, Shaders *shaders) {
+    std::vector<std::string> paths = staticPaths;
+    paths.insert(paths.end(), animatedPaths.begin(), animatedPaths.end());
+    std::vector<GEMLoader::GEMModelSource> sources(paths.size());
+    std::vector<int> slots;
+    for (const std::string &path : paths) {
+      slots.push_back(timeline.add(path, "model"));
+    }
+
+    std::atomic<bool> failed(false);
+    parallelFor((int)paths.size(), [&](int i, int thread) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.thread = thread;
+      entry.decodeStart = timeline.now();
+      if (!sources[i].open(paths[i])) {
+        failed = true;
+      }
+      entry.decodeMs = timeline.now() - entry.decodeStart;
+    });
+    if (failed) {
+      exit(0);
+    }
+
+    for (int i = 0; i < paths.size(); i++) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.uploadStart = timeline.now();
+      if (i < staticModels.size()) {
+        staticModels[i]->create(core, sources[i]);
+      } else {
+        std::cout << "Loading: " << paths[i] << std::endl;
+        animatedModels[i - staticModels.size()]->create(core, sources[i], psos, shaders);
+      }
+      entry.uploadMs = timeline.now() - entry.uploadStart;
+    }
+  }
+
+  // Textures already in the manager are skipped
+  void loadTextures(Core *core, TextureManager &textures, const std::vector<std::string> &filenames) {
+    std::vector<std::string> pending;
+    std::set<std::string> seen;
+    for (const std::string &filename : filenames) {
+      if (textures.textures.find(filename) == textures.textures.end() && seen.insert(filename).second) {
+        pending.push_back(filename);
+      }
+    }
+    std::vector<Texture *> decoded(pending.size());
+    std::vector<int> slots;
+    for (const std::string &filename : pending) {
+      slots.push_back(timeline.add(filename, "texture"));
+    }
+
+    parallelFor((int)pending.size(), [&](int i, int thread) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.thread = thread;
+      entry.decodeStart = timeline.now();
+      decoded[i] = new Texture();
+      decoded[i]->decode(pending[i]);
+      entry.decodeMs = timeline.now() - entry.decodeStart;
+    });
+
+    for (int i = 0; i < pending.size(); i++) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.uploadStart = timeline.now();
+      decoded[i]->create(core);
+      textures.textures[pending[i]] = decoded[i];
+      entry.uploadMs = timeline.now() - entry.uploadStart;
+    }
+  }
+
+  void loadSounds(SoundManager &sounds, const std::vector<std::string> &filenames) {
+    std::vector<Sound *> decoded(filenames.size());
+    std::vector<char> ok(filenames.size(), 0);
+    std::vector<int> slots;
+    for (const std::string &filename : filenames) {
+      slots.push_back(timeline.add(filename, "sound"));
+    }
+
+    parallelFor((int)filenames.size(), [&](int i, int thread) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.thread = thread;
+      entry.decodeStart = timeline.now();
+      decoded[i] = new Sound();
+      bool read = decoded[i]->readWAV(filenames[i]);
+      entry.decodeMs = timeline.now() - entry.decodeStart;
+      ok[i] = read;
+    });
+
+    for (int i = 0; i < filenames.size(); i++) {
+      StartupTimeline::Entry &entry = timeline.entries[slots[i]];
+      entry.uploadStart = timeline.now();
+      if (ok[i]) {
+        sounds.add(filenames[i], decoded[i]);
+      }
+      entry.uploadMs = timeline.now() - entry.uploadStart;
+    }
+  }
+
+  // Records the single batched submit as its own row
+  void submitUploads(Core *core) {
+    StartupTimeline::Entry &entry = timeline.entries[timeline.add("upload batch", "submit")];
+    entry.uploadStart = timeline.now();
+    core->submitUploads();
+    entry.uploadMs = timeline.now() - entry.uploadStart;
+  }
+};
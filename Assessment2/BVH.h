@@ -0,0 +1,188 @@
+#pragma once
+#include "Collision.h"
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// Nearest box along a ray
+struct RayHit {
+  int index = -1; // Index of the box in the list the tree was built from, -1 for a miss
+  float distance = FLT_MAX;
+
+  bool hit() const { return index >= 0; }
+};
+
+// Bounding volume hierarchy over a list of boxes. Static geometry is built once; boxes that move every frame keep
+// the same tree and refit it, so only the bounds change and the shape is rebuilt when the number of boxes does.
+class AABBTree {
+public:
+  void build(const std::vector<AABB> &boxes) {
+    nodes.clear();
+    items.resize(boxes.size());
+    for (int i = 0; i < (int)boxes.size(); i++) {
+      items[i] = i;
+    }
+    if (boxes.empty()) {
+      return;
+    }
+    nodes.reserve(boxes.size() * 2);
+    nodes.push_back(Node());
+    split(0, 0, (int)boxes.size(), boxes);
+  }
+
+  // Recomputes the bounds for boxes that have moved, bottom up. Children always come after their parent in nodes.
+  void refit(const std::vector<AABB> &boxes) {
+    if (boxes.size() != items.size()) {
+      build(boxes);
+      return;
+    }
+    for (int n = (int)nodes.size() - 1; n >= 0; n--) {
+      Node &node = nodes[n];
+      if (node.count > 0) {
+        node.bounds = AABB();
+        for (int lane = 0; lane < node.count; lane++) {
+          const AABB &box = boxes[items[node.first + lane]];
+          node.packet.set(lane, box);
+          node.bounds = merge(node.bounds, box);
+        }
+      } else {
+        node.packet.set(0, nodes[node.first].bounds);
+        node.packet.set(1, nodes[node.first + 1].bounds);
+        node.bounds = merge(nodes[node.first].bounds, nodes[node.first + 1].bounds);
+      }
+    }
+  }
+
+  RayHit raycast(const Vec3 &origin, const Vec3 &dir, float maxDist) const {
+    return raycast(origin, dir, maxDist, [](int) { return true; });
+  }
+
+  // Closest box for which accept(index) is true, entered no further than maxDist along dir. Ties go to the lowest
+  // index so the result is the same as testing every box in order. Each node tests its two children, or a leaf its
+  // boxes, with one packet test.
+  template <typename Accept>
+  RayHit raycast(const Vec3 &origin, const Vec3 &dir, float maxDist, Accept accept) const {
+    RayHit best;
+    float limit = maxDist;
+    float t[4];
+    int stack[64];
+    int top = 0;
+    if (nodes.empty() || !CollisionSystem::rayAABBDistance(origin, dir, nodes[0].bounds, limit, t[0])) {
+      return best;
+    }
+    stack[top++] = 0;
+    while (top > 0) {
+      const Node &node = nodes[stack[--top]];
+      int hits = CollisionSystem::rayAABBDistance4(origin, dir, node.packet, limit, t);
+      if (node.count > 0) {
+        for (int lane = 0; hits != 0; lane++, hits >>= 1) {
+          int index = items[node.first + lane];
+          if ((hits & 1) && (t[lane] < best.distance || (t[lane] == best.distance && index < best.index)) &&
+              accept(index)) {
+            best.index = index;
+            best.distance = t[lane];
+            limit = t[lane];
+          }
+        }
+        continue;
+      }
+      // Push the further child first so the nearer one is searched first and tightens the limit
+      if (hits == 3 && t[0] < t[1]) {
+        stack[top++] = node.first + 1;
+        stack[top++] = node.first;
+      } else {
+        if (hits & 1) {
+          stack[top++] = node.first;
+        }
+        if (hits & 2) {
+          stack[top++] = node.first + 1;
+        }
+      }
+    }
+    return best;
+  }
+
+  int nodeCount() const { return (int)nodes.size(); }
+
+private:
+  static const int LEAF_SIZE = 4; // One AABBPacket per leaf
+
+  // A leaf holds items[first .. first + count). An inner node has count 0 and its children at first and first + 1.
+  struct Node {
+    AABBPacket packet; // The children's bounds, or the leaf's boxes
+    AABB bounds;
+    int first = 0;
+    int count = 0;
+  };
+  std::vector<Node> nodes;
+  std::vector<int> items;
+
+  static AABB merge(const AABB &a, const AABB &b) {
+    return AABB(Vec3(std::min(a.min.x, b.min.x), std::min(a.min.y, b.min.y), std::min(a.min.z, b.min.z)),
+                Vec3(std::max(a.max.x, b.max.x), std::max(a.max.y, b.max.y), std::max(a.max.z, b.max.z)));
+  }
+
+  AABB bound(const std::vector<AABB> &boxes, int first, int count) const {
+    AABB result;
+    for (int i = first; i < first + count; i++) {
+      result = merge(result, boxes[items[i]]);
+    }
+    return result;
+  }
+
+  void pack(int n, const std::vector<AABB> &boxes) {
+    Node &node = nodes[n];
+    node.packet.clear();
+    if (node.count > 0) {
+      for (int i = node.first; i < node.first + node.count; i++) {
+        node.packet.add(boxes[items[i]]);
+      }
+    } else {
+      node.packet.add(nodes[node.first].bounds);
+      node.packet.add(nodes[node.first + 1].bounds);
+    }
+  }
+
+  // Splits items[first .. first + count) at the median centre along the longest axis of their centres
+  void split(int n, int first, int count, const std::vector<AABB> &boxes) {
+    nodes[n].bounds = bound(boxes, first, count);
+    if (count <= LEAF_SIZE) {
+      nodes[n].first = first;
+      nodes[n].count = count;
+      pack(n, boxes);
+      return;
+    }
+    AABB centres;
+    for (int i = first; i < first + count; i++) {
+      Vec3 centre = (boxes[items[i]].min + boxes[items[i]].max) * 0.5f;
+      centres = merge(centres, AABB(centre, centre));
+    }
+    Vec3 extent = centres.max - centres.min;
+    int axis = (extent.x > extent.y && extent.x > extent.z) ? 0 : (extent.y > extent.z ? 1 : 2);
+    auto centre = [&boxes, axis](int index) {
+      const AABB &box = boxes[index];
+      return axis == 0 ? box.min.x + box.max.x : (axis == 1 ? box.min.y + box.max.y : box.min.z + box.max.z);
+    };
+    int half = count / 2;
+    std::nth_element(items.begin() + first, items.begin() + first + half, items.begin() + first + count,
+                     [&centre](int a, int b) { return centre(a) < centre(b); });
+
+    int children = (int)nodes.size();
+    nodes[n].first = children;
+    nodes[n].count = 0;
+    nodes.push_back(Node());
+    nodes.push_back(Node());
+    split(children, first, half, boxes);
+    split(children + 1, first + half, count - half, boxes);
+    pack(n, boxes);
+  }
+};
+
+// Closest box of targets for which accept(index) is true that the ray enters before any box of scene and no further
+// than maxDist. The trees are only read, so a tree of moving boxes refit once a frame serves every ray of that frame.
+template <typename Accept>
+RayHit raycastPast(const AABBTree &scene, const AABBTree &targets, const Vec3 &origin, const Vec3 &dir, float maxDist,
+                   Accept accept) {
+  RayHit wall = scene.raycast(origin, dir, maxDist);
+  return targets.raycast(origin, dir, wall.hit() ? wall.distance : maxDist, accept);
+}
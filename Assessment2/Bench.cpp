@@ -0,0 +1,1543 @@
+#include "Animation.h"
+#include "BVH.h"
+#include "ColliderGrid.h"
+#include "Collision.h"
+#include "Controller.h"
+#include "EnemyStore.h"
+#include "FlowField.h"
+#include "Frustum.h"
+#include "GEMCache.h"
+#include "HeightField.h"
+#include "JobSystem.h"
+#include "LevelLoader.h"
+#include "Maths.h"
+#include "ModelData.h"
+#include "SpatialHash.h"
+#include "UploadRing.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+// Headless benchmarks and checks of the game's CPU side. Nothing here touches the window or the GPU, so this
+// builds on its own (see CMakeLists.txt) on any platform with the models and level.txt beside it.
+
+// Culls every level instance from the spawn point in eight directions using only the CPU side of the models.
+// Returns false if the SIMD and scalar passes disagree or the level cannot be read.
+static bool writeCullReport(const std::string &levelFile, std::ostream &out) {
+  LevelLoader levelLoader;
+  if (!levelLoader.load(levelFile)) {
+    out << "Could not read " << levelFile << std::endl;
+    return false;
+  }
+  std::map<std::string, InstanceBounds> bounds;
+  std::map<std::string, std::pair<Vec3, float>> modelSpheres;
+  for (const auto &obj : levelLoader.objects) {
+    if (modelSpheres.find(obj.modelName) == modelSpheres.end()) {
+      GEMLoader::GEMModelSource source;
+      if (!source.open("Models/" + obj.modelName + ".gem")) {
+        out << "Could not read model " << obj.modelName << std::endl;
+        return false;
+      }
+      std::pair<Vec3, float> &sphere = modelSpheres[obj.modelName];
+      computeModelBounds(source, sphere.first, sphere.second);
+    }
+    const std::pair<Vec3, float> &sphere = modelSpheres[obj.modelName];
+    Vec3 center;
+    float radius;
+    transformBounds(obj.transform(), sphere.first, sphere.second, center, radius);
+    bounds[obj.modelName].add(center, radius);
+  }
+
+  bool matched = true;
+  Matrix p = Matrix::perspective(0.01f, 10000.0f, 1920.0f / 1080.0f, 60.0f);
+  Vec3 eye(0, 1.5f, 0);
+  for (int view = 0; view < 8; view++) {
+    // As Camera::getViewMatrix looks along its yaw with no pitch
+    float yaw = view * 3.14159f / 4.0f;
+    Matrix vp = Matrix::lookAt(eye, eye + Vec3(sinf(yaw), 0.0f, cosf(yaw)), Vec3(0, 1, 0)) * p;
+    Frustum frustum = Frustum::fromViewProjection(vp);
+    CullStats simdTotals, scalarTotals;
+    std::vector<int> simdVisible, scalarVisible;
+    for (const auto &pair : bounds) {
+      simdVisible.clear();
+      scalarVisible.clear();
+      simdTotals.add(pair.second.cull(frustum, simdVisible));
+      scalarTotals.add(pair.second.cullScalar(frustum, scalarVisible));
+      if (simdVisible != scalarVisible) {
+        out << "  " << pair.first << ": SIMD and scalar visible sets differ" << std::endl;
+        matched = false;
+      }
+    }
+
+    const int repeats = 1000;
+    std::vector<int> visible;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) {
+      for (const auto &pair : bounds) {
+        visible.clear();
+        pair.second.cull(frustum, visible);
+      }
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) {
+      for (const auto &pair : bounds) {
+        visible.clear();
+        pair.second.cullScalar(frustum, visible);
+      }
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double simdUs = std::chrono::duration<double, std::micro>(mid - start).count() / repeats;
+    double scalarUs = std::chrono::duration<double, std::micro>(end - mid).count() / repeats;
+    out << "yaw " << view * 45 << ": " << simdTotals.visible << " of " << simdTotals.tested << " instances visible, " << simdUs
+        << " us SIMD, " << scalarUs << " us scalar" << std::endl;
+  }
+  out << (matched ? "SIMD and scalar culling agree" : "SIMD and scalar culling DISAGREE") << std::endl;
+  return matched;
+}
+
+// Loads every model in directory with the stream parser, GEMModelLoader, and with the mapped view, GEMModelView,
+// neither going through the cache, and reports the time of each. Returns false if a model cannot be read or the two
+// disagree on any vertex, index, bone or keyframe.
+static bool writeLoadBenchmark(const std::string &directory, std::ostream &out) {
+  std::vector<std::string> filenames;
+  GEMLoader::GEMCache::listModels(directory, filenames);
+  std::sort(filenames.begin(), filenames.end());
+  if (filenames.empty()) {
+    out << "No models in " << directory << std::endl;
+    return false;
+  }
+  const int repeats = 5;
+  bool matched = true;
+  double loaderTotal = 0, viewTotal = 0;
+  for (const std::string &filename : filenames) {
+    GEMLoader::GEMModelView view;
+    if (!view.open(filename)) {
+      out << "Could not read " << filename << std::endl;
+      matched = false;
+      continue;
+    }
+    std::vector<GEMLoader::GEMMesh> meshes;
+    GEMLoader::GEMAnimation animation;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) {
+      GEMLoader::GEMModelLoader loader;
+      meshes.clear();
+      animation = GEMLoader::GEMAnimation();
+      if (loader.isAnimatedModel(filename)) {
+        loader.load(filename, meshes, animation);
+      } else {
+        loader.load(filename, meshes);
+      }
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++) {
+      view.open(filename);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    bool same = meshes.size() == view.meshes.size() && animation.bones.size() == view.animation.bones.size() &&
+                animation.animations.size() == view.animation.animations.size() &&
+                (!view.animated || memcmp(&animation.globalInverse, &view.animation.globalInverse, sizeof(GEMLoader::GEMMatrix)) == 0);
+    for (size_t m = 0; same && m < meshes.size(); m++) {
+      const GEMLoader::GEMMesh &mesh = meshes[m];
+      const GEMLoader::GEMMeshView &meshView = view.meshes[m];
+      same = mesh.verticesStatic.size() == meshView.verticesStatic.count &&
+             mesh.verticesAnimated.size() == meshView.verticesAnimated.count && mesh.indices.size() == meshView.indices.count &&
+             memcmp(mesh.verticesStatic.data(), meshView.verticesStatic.data, meshView.verticesStatic.sizeInBytes()) == 0 &&
+             memcmp(mesh.verticesAnimated.data(), meshView.verticesAnimated.data, meshView.verticesAnimated.sizeInBytes()) == 0 &&
+             memcmp(mesh.indices.data(), meshView.indices.data, meshView.indices.sizeInBytes()) == 0;
+    }
+    for (size_t b = 0; same && b < animation.bones.size(); b++) {
+      same = animation.bones[b].name == view.animation.bones[b].name &&
+             animation.bones[b].parentIndex == view.animation.bones[b].parentIndex;
+    }
+    for (size_t a = 0; same && a < animation.animations.size(); a++) {
+      const GEMLoader::GEMAnimationSequence &sequence = animation.animations[a];
+      const GEMLoader::GEMAnimationSequenceView &sequenceView = view.animation.animations[a];
+      same = sequence.name == sequenceView.name && sequence.ticksPerSecond == sequenceView.ticksPerSecond &&
+             sequence.frames.size() == sequenceView.frameCount;
+      for (size_t f = 0; same && f < sequence.frames.size(); f++) {
+        const GEMLoader::GEMAnimationFrame &frame = sequence.frames[f];
+        same = frame.positions.size() == sequenceView.bonesN &&
+               memcmp(frame.positions.data(), sequenceView.positions(f).data, sequenceView.positions(f).sizeInBytes()) == 0 &&
+               memcmp(frame.rotations.data(), sequenceView.rotations(f).data, sequenceView.rotations(f).sizeInBytes()) == 0 &&
+               memcmp(frame.scales.data(), sequenceView.scales(f).data, sequenceView.scales(f).sizeInBytes()) == 0;
+      }
+    }
+    double loaderMs = std::chrono::duration<double, std::milli>(mid - start).count() / repeats;
+    double viewMs = std::chrono::duration<double, std::milli>(end - mid).count() / repeats;
+    loaderTotal += loaderMs;
+    viewTotal += viewMs;
+    out << filename << ": " << view.file.size << " bytes, " << loaderMs << " ms GEMModelLoader, " << viewMs << " ms GEMModelView"
+        << (same ? "" : ", the two DISAGREE") << std::endl;
+    matched = matched && same;
+  }
+  out << filenames.size() << " models: " << loaderTotal << " ms GEMModelLoader, " << viewTotal << " ms GEMModelView ("
+      << loaderTotal / viewTotal << "x)" << std::endl;
+  return matched;
+}
+
+// Samples every clip of one model with the per-bone lookup by name and with the clip handle sampler, and reports
+// poses per second for both. Returns false if the model cannot be read or the two disagree.
+static bool writeAnimationBenchmark(const std::string &filename, std::ostream &out) {
+  GEMLoader::GEMModelSource source;
+  if (!source.open(filename) || !source.animated) {
+    out << "Could not read " << filename << std::endl;
+    return false;
+  }
+  Animation animation;
+  createAnimation(source, animation);
+  AnimationInstance instance;
+  instance.init(&animation, 0);
+  std::vector<Matrix> reference(animation.bonesSize());
+  std::vector<Matrix> sampled(animation.bonesSize());
+  int socketBone = animation.bonesSize() - 1;
+  int socket = animation.addSocket(animation.skeleton.bones[socketBone].name);
+  AnimationInstance socketInstance;
+  socketInstance.init(&animation, 0);
+
+  bool matched = true;
+  const int poses = 2000;
+  double referenceTotal = 0, sampledTotal = 0;
+  out << filename << ": " << animation.bonesSize() << " bones, " << animation.clips.size() << " clips" << std::endl;
+  for (int clip = 0; clip < animation.clips.size(); clip++) {
+    const std::string &name = animation.clips[clip].name;
+    float duration = animation.clips[clip].duration();
+    float maxError = 0.0f;
+    float socketError = 0.0f;
+
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < poses; p++) {
+      float t = duration * p / poses;
+      int frame = 0;
+      float interpolationFact = 0;
+      animation.calcFrame(name, t, frame, interpolationFact);
+      for (int i = 0; i < animation.bonesSize(); i++) {
+        reference[i] = animation.interpolateBoneToGlobal(name, reference.data(), frame, interpolationFact, i);
+      }
+      animation.calcTransforms(reference.data(), instance.coordTransform);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < poses; p++) {
+      float t = duration * p / poses;
+      animation.sampleSkeleton(clip, t, sampled.data());
+      animation.calcTransforms(sampled.data(), instance.coordTransform);
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+
+    // Compare both paths over the whole clip, and the last bone's socket against its reference transform
+    for (int p = 0; p < 64; p++) {
+      float t = duration * p / 64;
+      int frame = 0;
+      float interpolationFact = 0;
+      animation.calcFrame(name, t, frame, interpolationFact);
+      for (int i = 0; i < animation.bonesSize(); i++) {
+        reference[i] = animation.interpolateBoneToGlobal(name, reference.data(), frame, interpolationFact, i);
+      }
+      animation.sampleSkeleton(clip, t, sampled.data());
+      // Relative to the largest element so bones far from the origin do not dominate
+      for (int i = 0; i < animation.bonesSize(); i++) {
+        float largest = 1.0f;
+        float difference = 0.0f;
+        for (int j = 0; j < 16; j++) {
+          largest = std::max(largest, fabsf(reference[i].m[j]));
+          difference = std::max(difference, fabsf(reference[i].m[j] - sampled[i].m[j]));
+        }
+        maxError = std::max(maxError, difference / largest);
+      }
+      socketInstance.update(clip, 0.0f);
+      socketInstance.resetAnimationTime();
+      socketInstance.update(clip, t);
+      Matrix expected = reference[socketBone] * instance.coordTransform;
+      float largest = 1.0f;
+      float difference = 0.0f;
+      for (int j = 0; j < 16; j++) {
+        largest = std::max(largest, fabsf(expected.m[j]));
+        difference = std::max(difference, fabsf(expected.m[j] - socketInstance.socketMatrix(socket).m[j]));
+      }
+      socketError = std::max(socketError, difference / largest);
+    }
+    double referenceSeconds = std::chrono::duration<double>(mid - start).count();
+    double sampledSeconds = std::chrono::duration<double>(end - mid).count();
+    referenceTotal += referenceSeconds;
+    sampledTotal += sampledSeconds;
+    out << "  " << name << ": " << poses / referenceSeconds << " poses/s by name, " << poses / sampledSeconds
+        << " poses/s by handle, max relative difference " << maxError << ", socket " << socketError << std::endl;
+    if (maxError > 5e-3f || socketError > 5e-3f) {
+      matched = false;
+    }
+  }
+  out << "Total: " << animation.clips.size() * poses / referenceTotal << " poses/s by name, "
+      << animation.clips.size() * poses / sampledTotal << " poses/s by handle" << std::endl;
+
+  // Animation LOD: the same sampling with the tips of the skeleton collapsed onto their parents
+  for (int levels = 1; levels <= 2; levels++) {
+    int evaluated = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int clip = 0; clip < animation.clips.size(); clip++) {
+      float duration = animation.clips[clip].duration();
+      for (int p = 0; p < poses; p++) {
+        evaluated = animation.sampleSkeleton(clip, duration * p / poses, sampled.data(), levels);
+        animation.calcTransforms(sampled.data(), instance.coordTransform, levels);
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    out << "Collapse " << levels << ": " << evaluated << " of " << animation.bonesSize() << " bones, "
+        << animation.clips.size() * poses / seconds << " poses/s" << std::endl;
+  }
+
+  // Baked at 60 samples per second against live evaluation. The blend is linear in the matrices, so the difference
+  // peaks between samples on bones that turn far in one keyframe.
+  std::ostringstream bakeReport;
+  animation.bake(60.0f, instance.coordTransform, bakeReport);
+  float bakedError = 0.0f;
+  double liveSeconds = 0, bakedSeconds = 0;
+  for (int clip = 0; clip < animation.clips.size(); clip++) {
+    float duration = animation.clips[clip].duration();
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < poses; p++) {
+      animation.sampleSkeleton(clip, duration * p / poses, sampled.data());
+      animation.calcTransforms(sampled.data(), instance.coordTransform);
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int p = 0; p < poses; p++) {
+      animation.sampleBaked(clip, duration * p / poses, reference.data());
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    liveSeconds += std::chrono::duration<double>(mid - start).count();
+    bakedSeconds += std::chrono::duration<double>(end - mid).count();
+    for (int p = 0; p < 64; p++) {
+      float t = duration * p / 64;
+      animation.sampleSkeleton(clip, t, sampled.data());
+      animation.calcTransforms(sampled.data(), instance.coordTransform);
+      animation.sampleBaked(clip, t, reference.data());
+      for (int i = 0; i < animation.bonesSize(); i++) {
+        float largest = 1.0f;
+        float difference = 0.0f;
+        for (int j = 0; j < 16; j++) {
+          largest = std::max(largest, fabsf(sampled[i].m[j]));
+          difference = std::max(difference, fabsf(sampled[i].m[j] - reference[i].m[j]));
+        }
+        bakedError = std::max(bakedError, difference / largest);
+      }
+    }
+  }
+  out << "Baked at 60 samples/s:" << std::endl << bakeReport.str();
+  out << "  " << animation.clips.size() * poses / liveSeconds << " poses/s live, " << animation.clips.size() * poses / bakedSeconds
+      << " poses/s baked, max relative difference " << bakedError << std::endl;
+  animation.bakedClips.clear();
+
+  // Pose cache: a crowd spawned in groups of six, a quarter of a second apart, playing the first clip for ten
+  // seconds with and without sharing poses
+  const int crowd = 48;
+  const int frames = 600;
+  PoseCache cache;
+  cache.init(&animation, instance.coordTransform);
+  std::vector<AnimationInstance> crowdInstances(crowd);
+  for (int shared = 0; shared < 2; shared++) {
+    for (int i = 0; i < crowd; i++) {
+      crowdInstances[i].init(&animation, 0);
+      crowdInstances[i].usePoseCache(shared ? &cache : nullptr);
+      crowdInstances[i].update(0, 0.0f);
+      crowdInstances[i].update(0, (i / 6) * 0.25f);
+    }
+    long long evaluated = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int frame = 0; frame < frames; frame++) {
+      for (AnimationInstance &crowdInstance : crowdInstances) {
+        crowdInstance.update(0, 1.0f / 60.0f);
+        evaluated += crowdInstance.bonesEvaluated;
+        if (crowdInstance.animationFinished()) {
+          crowdInstance.resetAnimationTime();
+        }
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    out << "Crowd of " << crowd << (shared ? " sharing poses: " : " with own poses: ") << (double)evaluated / frames << " bones and "
+        << seconds * 1000.0 / frames << " ms per frame";
+    if (shared) {
+      out << ", " << cache.refs.size() << " cache slots";
+    }
+    out << std::endl;
+  }
+  return matched;
+}
+
+// Compresses the keyframes of each animated model in directory and reports the bytes before and after, sampling
+// speed, and how far the bones move from their uncompressed positions in model units. Returns false if a model
+// cannot be read, none is animated, or a bone moves further than a hundredth of the size of its model.
+static bool writeCompressionReport(const std::string &directory, std::ostream &out) {
+  std::vector<std::string> filenames;
+  GEMLoader::GEMCache::listModels(directory, filenames);
+  std::sort(filenames.begin(), filenames.end());
+  bool matched = true;
+  int animated = 0;
+  for (const std::string &filename : filenames) {
+    GEMLoader::GEMModelSource source;
+    if (!source.open(filename)) {
+      out << "Could not read " << filename << std::endl;
+      matched = false;
+      continue;
+    }
+    if (!source.animated) {
+      continue;
+    }
+    animated++;
+    Animation full, compressed;
+    createAnimation(source, full);
+    createAnimation(source, compressed);
+    out << filename << ": " << full.bonesSize() << " bones, " << full.clips.size() << " clips" << std::endl;
+    compressed.compressClips(KeyframeTolerance(), out);
+
+    std::vector<Matrix> expected(full.bonesSize());
+    std::vector<Matrix> sampled(full.bonesSize());
+    const int poses = 500;
+    float maxError = 0.0f;
+    float extent = 0.0f;
+    double fullSeconds = 0, compressedSeconds = 0;
+    for (int clip = 0; clip < full.clips.size(); clip++) {
+      float duration = full.clips[clip].duration();
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int p = 0; p < poses; p++) {
+        full.sampleSkeleton(clip, duration * p / poses, expected.data());
+      }
+      auto mid = std::chrono::high_resolution_clock::now();
+      for (int p = 0; p < poses; p++) {
+        compressed.sampleSkeleton(clip, duration * p / poses, sampled.data());
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+      fullSeconds += std::chrono::duration<double>(mid - start).count();
+      compressedSeconds += std::chrono::duration<double>(end - mid).count();
+      for (int p = 0; p < 64; p++) {
+        float t = duration * p / 64;
+        full.sampleSkeleton(clip, t, expected.data());
+        compressed.sampleSkeleton(clip, t, sampled.data());
+        for (int i = 0; i < full.bonesSize(); i++) {
+          Vec3 position(expected[i].m[3], expected[i].m[7], expected[i].m[11]);
+          Vec3 moved = position - Vec3(sampled[i].m[3], sampled[i].m[7], sampled[i].m[11]);
+          extent = std::max(extent, position.length());
+          maxError = std::max(maxError, moved.length());
+        }
+      }
+    }
+    out << "  " << full.clips.size() * poses / fullSeconds << " poses/s full, " << full.clips.size() * poses / compressedSeconds
+        << " poses/s compressed, bones move up to " << maxError << " of " << extent << " model units" << std::endl;
+    if (maxError > extent * 0.01f) {
+      matched = false;
+    }
+  }
+  if (animated == 0) {
+    out << "No animated models in " << directory << std::endl;
+    return false;
+  }
+  return matched;
+}
+
+// Repeatable pseudo random numbers for the generated benchmark scenes
+struct BenchmarkRandom {
+  unsigned int seed = 12345;
+
+  float range(float lo, float hi) {
+    seed = seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * ((seed >> 8) / 16777216.0f);
+  }
+};
+
+// count boxes shaped like the level's models, standing on y = 0 anywhere in a square 2 * half across
+static std::vector<AABB> scatterColliders(int count, float half, BenchmarkRandom &random) {
+  std::vector<ModelBounds> shapes;
+  for (const auto &pair : StaticModelBounds) {
+    shapes.push_back(pair.second);
+  }
+  std::vector<AABB> colliders;
+  for (int i = 0; i < count; i++) {
+    const ModelBounds &shape = shapes[i % shapes.size()];
+    Vec3 position(random.range(-half, half), 0.0f, random.range(-half, half));
+    colliders.push_back(AABB::fromCenterExtent(position + Vec3(0, shape.halfExtentY, 0), shape.toVec3()));
+  }
+  return colliders;
+}
+
+// Moves a crowd of enemies through generated levels of growing size, probing the ground and pushing out of walls
+// once against the whole collider list and once through ColliderGrid. Colliders are the level's own model bounds
+// scattered at about the density of level.txt. Returns false if the two ever leave an enemy in different places.
+static bool writeCollisionBenchmark(std::ostream &out) {
+  BenchmarkRandom random;
+
+  // Same correction as EnemyController::resolveStaticCollisions
+  auto push = [](Vec3 &position, AABB &enemyAABB, const AABB &wall) {
+    CollisionInfo info = CollisionSystem::checkAABB(enemyAABB, wall);
+    if (info.collided) {
+      info.normal.y = 0;
+      if (info.normal.length() > 0.01f) {
+        CollisionSystem::resolveCollision(position, info);
+        enemyAABB = getAnimatedModelAABB("Goat-01", position);
+      }
+    }
+    return enemyAABB;
+  };
+
+  bool matched = true;
+  const int frames = 60;
+  const float dt = 1.0f / 60.0f;
+  for (int colliderCount : {64, 256, 1024, 4096}) {
+    float half = 50.0f * sqrtf(colliderCount / 128.0f);
+    std::vector<AABB> colliders = scatterColliders(colliderCount, half, random);
+    ColliderGrid grid;
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    grid.build(colliders);
+    double buildUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - buildStart).count();
+    out << colliderCount << " colliders over " << 2 * half << " x " << 2 * half << ": " << grid.cellCount() << " cells, "
+        << grid.entryCount() << " entries, built in " << buildUs << " us" << std::endl;
+
+    for (int enemyCount : {16, 64, 256}) {
+      std::vector<Vec3> starts, headings;
+      for (int e = 0; e < enemyCount; e++) {
+        starts.push_back(Vec3(random.range(-half, half), 0.0f, random.range(-half, half)));
+        float yaw = random.range(0.0f, 6.28318f);
+        headings.push_back(Vec3(sinf(yaw), 0, cosf(yaw)) * 4.0f * dt);
+      }
+      std::vector<Vec3> brute = starts, gridded = starts;
+      std::vector<int> nearby;
+
+      auto start = std::chrono::high_resolution_clock::now();
+      for (int f = 0; f < frames; f++) {
+        for (int e = 0; e < enemyCount; e++) {
+          Vec3 &position = brute[e];
+          position = position + headings[e];
+          for (const auto &wall : colliders) {
+            if (position.x >= wall.min.x && position.x <= wall.max.x && position.z >= wall.min.z && position.z <= wall.max.z &&
+                position.y >= wall.max.y - 0.5f && wall.max.y > position.y) {
+              position.y = wall.max.y;
+            }
+          }
+          AABB enemyAABB = getAnimatedModelAABB("Goat-01", position);
+          for (const auto &wall : colliders) {
+            push(position, enemyAABB, wall);
+          }
+        }
+      }
+      auto mid = std::chrono::high_resolution_clock::now();
+      for (int f = 0; f < frames; f++) {
+        for (int e = 0; e < enemyCount; e++) {
+          Vec3 &position = gridded[e];
+          position = position + headings[e];
+          position.y = std::max(position.y, grid.surfaceBelow(position));
+          AABB enemyAABB = getAnimatedModelAABB("Goat-01", position);
+          grid.resolve(enemyAABB, nearby, [&](const AABB &wall) { return push(position, enemyAABB, wall); });
+        }
+      }
+      auto end = std::chrono::high_resolution_clock::now();
+
+      int differ = 0;
+      for (int e = 0; e < enemyCount; e++) {
+        if (brute[e].x != gridded[e].x || brute[e].y != gridded[e].y || brute[e].z != gridded[e].z) {
+          differ++;
+        }
+      }
+      double bruteUs = std::chrono::duration<double, std::micro>(mid - start).count() / frames;
+      double gridUs = std::chrono::duration<double, std::micro>(end - mid).count() / frames;
+      out << "  " << enemyCount << " enemies: " << bruteUs << " us/frame brute force, " << gridUs << " us/frame grid ("
+          << bruteUs / gridUs << "x)";
+      if (differ > 0) {
+        out << ", " << differ << " enemies end up in different places";
+        matched = false;
+      }
+      out << std::endl;
+    }
+  }
+  out << (matched ? "Grid and brute force agree" : "Grid and brute force DISAGREE") << std::endl;
+  return matched;
+}
+
+// Fires rays from head height across generated levels full of enemies and finds the nearest enemy in front of
+// any wall, once by testing every box and once through the scene and enemy trees. Enemies move between batches of
+// rays, each batch standing in for a frame, so the enemy tree is refit once per batch as the game refits it once per
+// frame. Returns false if the two ever pick a different enemy.
+static bool writeRaycastBenchmark(std::ostream &out) {
+  BenchmarkRandom random;
+  bool matched = true;
+  const int batches = 20;
+  const int raysPerBatch = 250;
+  for (int colliderCount : {64, 256, 1024, 4096}) {
+    float half = 50.0f * sqrtf(colliderCount / 128.0f);
+    std::vector<AABB> colliders = scatterColliders(colliderCount, half, random);
+    AABBTree sceneTree;
+    auto buildStart = std::chrono::high_resolution_clock::now();
+    sceneTree.build(colliders);
+    double buildUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - buildStart).count();
+    out << colliderCount << " colliders: " << sceneTree.nodeCount() << " nodes, built in " << buildUs << " us" << std::endl;
+
+    for (int enemyCount : {16, 64, 256}) {
+      // Every fifth enemy is waiting to be removed and must be skipped
+      std::vector<EnemyController> controllers(enemyCount);
+      std::vector<EnemyController *> enemies;
+      std::vector<Vec3> positions;
+      for (int e = 0; e < enemyCount; e++) {
+        controllers[e].shouldRemove = e % 5 == 4;
+        enemies.push_back(&controllers[e]);
+        positions.push_back(Vec3(random.range(-half, half), 0.0f, random.range(-half, half)));
+      }
+      std::vector<Vec3> origins, directions;
+      for (int r = 0; r < raysPerBatch; r++) {
+        origins.push_back(Vec3(random.range(-half, half), 1.5f, random.range(-half, half)));
+        float yaw = random.range(0.0f, 6.28318f);
+        float pitch = random.range(-0.3f, 0.1f);
+        directions.push_back(Vec3(sinf(yaw) * cosf(pitch), sinf(pitch), cosf(yaw) * cosf(pitch)));
+      }
+
+      AABBTree enemyTree;
+      std::vector<AABB> animalColliders;
+      std::vector<RayHit> expected(raysPerBatch), found(raysPerBatch);
+      double bruteSeconds = 0, treeSeconds = 0, refitSeconds = 0;
+      int hits = 0, differ = 0;
+      for (int b = 0; b < batches; b++) {
+        animalColliders.clear();
+        for (int e = 0; e < enemyCount; e++) {
+          positions[e] = positions[e] + Vec3(random.range(-0.5f, 0.5f), 0.0f, random.range(-0.5f, 0.5f));
+          animalColliders.push_back(getAnimatedModelAABB("Goat-01", positions[e]));
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < raysPerBatch; r++) {
+          Vec3 dir = directions[r].normalize(); // As BulletSystem::raycast does, so the distances match exactly
+          float limit = 1000.0f, t;
+          for (const auto &wall : colliders) {
+            if (CollisionSystem::rayAABBDistance(origins[r], dir, wall, limit, t)) {
+              limit = t;
+            }
+          }
+          RayHit nearest;
+          for (int e = 0; e < enemyCount; e++) {
+            if (!enemies[e]->shouldRemove && CollisionSystem::rayAABBDistance(origins[r], dir, animalColliders[e], limit, t) &&
+                t < nearest.distance) {
+              nearest.index = e;
+              nearest.distance = t;
+            }
+          }
+          expected[r] = nearest;
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        enemyTree.refit(animalColliders);
+        auto refit = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < raysPerBatch; r++) {
+          found[r] = raycastPast(sceneTree, enemyTree, origins[r], directions[r].normalize(), 1000.0f,
+                                 [&enemies](int j) { return !enemies[j]->shouldRemove; });
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        bruteSeconds += std::chrono::duration<double>(mid - start).count();
+        refitSeconds += std::chrono::duration<double>(refit - mid).count();
+        treeSeconds += std::chrono::duration<double>(end - mid).count();
+
+        for (int r = 0; r < raysPerBatch; r++) {
+          hits += expected[r].hit() ? 1 : 0;
+          if (expected[r].index != found[r].index || (expected[r].hit() && expected[r].distance != found[r].distance)) {
+            differ++;
+          }
+        }
+      }
+      int rays = batches * raysPerBatch;
+      out << "  " << enemyCount << " enemies: " << hits << " of " << rays << " rays hit, " << rays / bruteSeconds << " rays/s brute force, "
+          << rays / treeSeconds << " rays/s tree (" << bruteSeconds / treeSeconds << "x), refit "
+          << refitSeconds * 1e6 / batches << " us/frame";
+      if (differ > 0) {
+        out << ", " << differ << " rays hit a different enemy";
+        matched = false;
+      }
+      out << std::endl;
+    }
+  }
+  out << (matched ? "Tree and brute force agree" : "Tree and brute force DISAGREE") << std::endl;
+  return matched;
+}
+
+// Tests rays against generated boxes one box at a time and four at a time, and reports boxes tested per second.
+// Some rays run along an axis or start inside a box. Returns false if the packet test ever disagrees with the
+// scalar one on a hit or a distance.
+static bool writeSlabBenchmark(std::ostream &out) {
+  BenchmarkRandom random;
+  const float half = 100.0f;
+  std::vector<AABB> boxes = scatterColliders(4096, half, random);
+  std::vector<AABBPacket> packets;
+  for (size_t i = 0; i < boxes.size(); i++) {
+    if (i % 4 == 0) {
+      packets.push_back(AABBPacket());
+      packets.back().clear();
+    }
+    packets.back().add(boxes[i]);
+  }
+
+  std::vector<Vec3> origins, directions;
+  for (int r = 0; r < 256; r++) {
+    Vec3 dir(random.range(-1.0f, 1.0f), random.range(-0.3f, 0.3f), random.range(-1.0f, 1.0f));
+    if (r % 4 == 1) {
+      dir.y = 0.0f;
+    } else if (r % 4 == 2) {
+      dir = Vec3(0.0f, 0.0f, dir.z < 0 ? -1.0f : 1.0f);
+    }
+    Vec3 origin(random.range(-half, half), random.range(0.0f, 3.0f), random.range(-half, half));
+    if (r % 8 == 3) {
+      origin = (boxes[r].min + boxes[r].max) * 0.5f;
+    }
+    origins.push_back(origin);
+    directions.push_back(dir.normalize());
+  }
+
+  long long tests = 0, hits = 0, differ = 0;
+  float distances[4];
+  for (size_t r = 0; r < origins.size(); r++) {
+    for (size_t p = 0; p < packets.size(); p++) {
+      int mask = CollisionSystem::rayAABBDistance4(origins[r], directions[r], packets[p], 1000.0f, distances);
+      for (int lane = 0; lane < packets[p].count; lane++) {
+        float t;
+        bool hit = CollisionSystem::rayAABBDistance(origins[r], directions[r], boxes[p * 4 + lane], 1000.0f, t);
+        tests++;
+        hits += hit ? 1 : 0;
+        if (hit != ((mask >> lane) & 1) || (hit && t != distances[lane])) {
+          differ++;
+        }
+      }
+    }
+  }
+  out << tests << " ray / box pairs, " << hits << " hits, " << differ << " disagree" << std::endl;
+
+  const int repeats = 20;
+  long long scalarHits = 0, packetHits = 0;
+  auto start = std::chrono::high_resolution_clock::now();
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    for (size_t r = 0; r < origins.size(); r++) {
+      float t;
+      for (const auto &box : boxes) {
+        scalarHits += CollisionSystem::rayAABBDistance(origins[r], directions[r], box, 1000.0f, t) ? 1 : 0;
+      }
+    }
+  }
+  auto mid = std::chrono::high_resolution_clock::now();
+  for (int repeat = 0; repeat < repeats; repeat++) {
+    for (size_t r = 0; r < origins.size(); r++) {
+      for (const auto &packet : packets) {
+        int mask = CollisionSystem::rayAABBDistance4(origins[r], directions[r], packet, 1000.0f, distances);
+        packetHits += ((mask & 1) + ((mask >> 1) & 1)) + (((mask >> 2) & 1) + ((mask >> 3) & 1));
+      }
+    }
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  double scalarSeconds = std::chrono::duration<double>(mid - start).count();
+  double packetSeconds = std::chrono::duration<double>(end - mid).count();
+  double boxTests = (double)repeats * origins.size() * boxes.size();
+  out << boxTests / scalarSeconds / 1e6 << " M boxes/s scalar, " << boxTests / packetSeconds / 1e6 << " M boxes/s packets ("
+      << scalarSeconds / packetSeconds << "x)" << std::endl;
+  if (scalarHits != packetHits) {
+    differ++;
+  }
+  out << (differ == 0 ? "Scalar and packet tests agree" : "Scalar and packet tests DISAGREE") << std::endl;
+  return differ == 0;
+}
+
+// Compares the ground height from HeightField with a scan of every level collider at random points over level.txt,
+// then removes some colliders, patches the field and compares again. Answers may only differ within one cell of a
+// collider's edge. Also times the scan, ColliderGrid and HeightField lookups. Returns false on any other difference.
+static bool writeHeightFieldReport(const std::string &levelFile, std::ostream &out) {
+  LevelLoader levelLoader;
+  if (!levelLoader.load(levelFile)) {
+    out << "Could not read " << levelFile << std::endl;
+    return false;
+  }
+  std::vector<AABB> colliders;
+  AABB area;
+  for (const auto &obj : levelLoader.objects) {
+    if (obj.hasCollision) {
+      colliders.push_back(getLevelObjectAABB(obj.modelName, obj.position, obj.rotation));
+      area = AABB(Vec3(std::min(area.min.x, colliders.back().min.x), 0, std::min(area.min.z, colliders.back().min.z)),
+                  Vec3(std::max(area.max.x, colliders.back().max.x), 0, std::max(area.max.z, colliders.back().max.z)));
+    }
+  }
+
+  auto scan = [](const std::vector<AABB> &boxes, const Vec3 &p) {
+    float surface = -FLT_MAX;
+    for (const auto &wall : boxes) {
+      if (p.x >= wall.min.x && p.x <= wall.max.x && p.z >= wall.min.z && p.z <= wall.max.z && p.y >= wall.max.y - 0.5f &&
+          wall.max.y > surface) {
+        surface = wall.max.y;
+      }
+    }
+    return surface;
+  };
+  BenchmarkRandom random;
+  std::vector<Vec3> points;
+  for (int i = 0; i < 100000; i++) {
+    points.push_back(Vec3(random.range(area.min.x, area.max.x), random.range(-1.0f, 8.0f), random.range(area.min.z, area.max.z)));
+  }
+  // Number of points the field gets wrong away from any collider edge
+  auto compare = [&](const HeightField &field, const std::vector<AABB> &boxes, const char *label) {
+    float edge = field.resolution();
+    int differ = 0, wrong = 0;
+    for (const Vec3 &p : points) {
+      if (field.surfaceBelow(p) == scan(boxes, p)) {
+        continue;
+      }
+      differ++;
+      bool nearEdge = false;
+      for (const auto &box : boxes) {
+        bool inGrown = p.x >= box.min.x - edge && p.x <= box.max.x + edge && p.z >= box.min.z - edge && p.z <= box.max.z + edge;
+        bool inShrunk = p.x >= box.min.x + edge && p.x <= box.max.x - edge && p.z >= box.min.z + edge && p.z <= box.max.z - edge;
+        nearEdge = nearEdge || (inGrown && !inShrunk);
+      }
+      wrong += nearEdge ? 0 : 1;
+    }
+    out << label << ": " << points.size() - differ << " of " << points.size() << " points agree, " << differ - wrong
+        << " differ next to an edge, " << wrong << " differ elsewhere" << std::endl;
+    return wrong;
+  };
+
+  HeightField field;
+  auto buildStart = std::chrono::high_resolution_clock::now();
+  field.build(colliders);
+  double buildUs = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - buildStart).count();
+  out << colliders.size() << " colliders, " << field.cellCount() << " cells of " << field.resolution() << ", built in " << buildUs
+      << " us, " << field.overflowCells << " cells out of layers" << std::endl;
+  int wrong = compare(field, colliders, "Built");
+
+  ColliderGrid grid;
+  grid.build(colliders);
+  float checksum[3] = {0, 0, 0};
+  auto start = std::chrono::high_resolution_clock::now();
+  for (const Vec3 &p : points) {
+    checksum[0] += std::max(0.0f, scan(colliders, p));
+  }
+  auto gridStart = std::chrono::high_resolution_clock::now();
+  for (const Vec3 &p : points) {
+    checksum[1] += std::max(0.0f, grid.surfaceBelow(p));
+  }
+  auto fieldStart = std::chrono::high_resolution_clock::now();
+  for (const Vec3 &p : points) {
+    checksum[2] += std::max(0.0f, field.surfaceBelow(p));
+  }
+  auto end = std::chrono::high_resolution_clock::now();
+  double n = (double)points.size();
+  out << n / std::chrono::duration<double>(gridStart - start).count() / 1e6 << " M lookups/s scanning, "
+      << n / std::chrono::duration<double>(fieldStart - gridStart).count() / 1e6 << " M/s ColliderGrid, "
+      << n / std::chrono::duration<double>(end - fieldStart).count() / 1e6 << " M/s HeightField (checksums " << checksum[0] << " "
+      << checksum[1] << " " << checksum[2] << ")" << std::endl;
+
+  // Take out every seventh collider as if it had been destroyed and patch the field under each one
+  std::vector<AABB> remaining;
+  for (size_t i = 0; i < colliders.size(); i++) {
+    if (i % 7 != 3) {
+      remaining.push_back(colliders[i]);
+    }
+  }
+  for (size_t i = 3; i < colliders.size(); i += 7) {
+    field.patch(colliders[i], remaining);
+  }
+  wrong += compare(field, remaining, "Patched");
+  out << (wrong == 0 ? "HeightField matches the colliders" : "HeightField does NOT match the colliders") << std::endl;
+  return wrong == 0;
+}
+
+// Colliders of level.txt the enemies walk among (all but the outer walls) and the x / z area they cover. Returns
+// false if the level cannot be read.
+static bool readEnemyColliders(const std::string &levelFile, std::vector<AABB> &colliders, AABB &area, std::ostream &out) {
+  LevelLoader levelLoader;
+  if (!levelLoader.load(levelFile)) {
+    out << "Could not read " << levelFile << std::endl;
+    return false;
+  }
+  for (const auto &obj : levelLoader.objects) {
+    if (obj.hasCollision && obj.modelName != "Wall_003") {
+      colliders.push_back(getLevelObjectAABB(obj.modelName, obj.position, obj.rotation));
+      area = AABB(Vec3(std::min(area.min.x, colliders.back().min.x), 0, std::min(area.min.z, colliders.back().min.z)),
+                  Vec3(std::max(area.max.x, colliders.back().max.x), 0, std::max(area.max.z, colliders.back().max.z)));
+    }
+  }
+  return true;
+}
+
+// Runs thousands of agents after a player circling the middle of level.txt, once following FlowField and once
+// heading straight at the player as enemies used to, both pushed out of the colliders through ColliderGrid. Reports
+// the time spent searching and steering and how many agents reach the player. Returns false if the level cannot be
+// read or the flow field catches fewer agents than heading straight.
+static bool writeFlowBenchmark(const std::string &levelFile, std::ostream &out) {
+  std::vector<AABB> colliders;
+  AABB area;
+  if (!readEnemyColliders(levelFile, colliders, area, out)) {
+    return false;
+  }
+  ColliderGrid grid;
+  grid.build(colliders);
+  FlowField flow;
+  flow.build(colliders);
+  out << colliders.size() << " colliders, " << flow.cellCount() << " flow cells" << std::endl;
+
+  auto push = [](Vec3 &position, AABB &box, const AABB &wall) {
+    CollisionInfo info = CollisionSystem::checkAABB(box, wall);
+    if (info.collided) {
+      info.normal.y = 0;
+      if (info.normal.length() > 0.01f) {
+        CollisionSystem::resolveCollision(position, info);
+        box = getAnimatedModelAABB("Goat-01", position);
+      }
+    }
+    return box;
+  };
+
+  bool passed = true;
+  const int frames = 1200;
+  const float dt = 1.0f / 60.0f;
+  const float speed = 4.0f;
+  Vec3 centre = (area.min + area.max) * 0.5f;
+  for (int agentCount : {1000, 4000}) {
+    BenchmarkRandom random;
+    std::vector<Vec3> starts;
+    while ((int)starts.size() < agentCount) {
+      Vec3 p(random.range(area.min.x, area.max.x), 0.0f, random.range(area.min.z, area.max.z));
+      if (!flow.isBlocked(p)) {
+        starts.push_back(p);
+      }
+    }
+    int caught[2] = {0, 0};
+    for (int mode = 0; mode < 2; mode++) {
+      bool useFlow = mode == 0;
+      std::vector<Vec3> agents = starts;
+      std::vector<char> reached(agentCount, 0);
+      std::vector<int> nearby;
+      flow.build(colliders);
+      double searchSeconds = 0, steerSeconds = 0;
+      for (int f = 0; f < frames; f++) {
+        float angle = f * dt * 0.25f;
+        Vec3 player = centre + Vec3(cosf(angle), 0.0f, sinf(angle)) * 8.0f;
+        auto start = std::chrono::high_resolution_clock::now();
+        if (useFlow) {
+          flow.update(player, 2048);
+        }
+        auto mid = std::chrono::high_resolution_clock::now();
+        for (int a = 0; a < agentCount; a++) {
+          Vec3 &position = agents[a];
+          Vec3 dir;
+          if (!useFlow || !flow.direction(position, dir)) {
+            dir = player - position;
+            dir.y = 0.0f;
+            if (dir.length() < 0.01f) {
+              continue;
+            }
+            dir = dir.normalize();
+          }
+          position = position + dir * speed * dt;
+          AABB box = getAnimatedModelAABB("Goat-01", position);
+          grid.resolve(box, nearby, [&](const AABB &wall) { return push(position, box, wall); });
+          Vec3 toPlayer = player - position;
+          toPlayer.y = 0.0f;
+          if (toPlayer.length() < 2.0f) {
+            reached[a] = 1;
+          }
+        }
+        auto end = std::chrono::high_resolution_clock::now();
+        searchSeconds += std::chrono::duration<double>(mid - start).count();
+        steerSeconds += std::chrono::duration<double>(end - mid).count();
+      }
+      for (char r : reached) {
+        caught[mode] += r;
+      }
+      out << "  " << agentCount << " agents " << (useFlow ? "following the flow field" : "heading straight") << ": "
+          << caught[mode] << " reached the player, " << searchSeconds * 1e6 / frames << " us/frame searching";
+      if (useFlow) {
+        out << " (" << flow.rebuilds << " searches)";
+      }
+      out << ", " << steerSeconds * 1e6 / frames << " us/frame steering and colliding" << std::endl;
+    }
+    if (caught[0] < caught[1]) {
+      passed = false;
+    }
+  }
+  out << (passed ? "Flow field reaches at least as many agents" : "Flow field reaches FEWER agents than heading straight") << std::endl;
+  return passed;
+}
+
+// Animations of the four animals as the game prepares them (compressed, baked, pose cache), without any GPU side.
+// Returns false if a model cannot be read.
+static bool loadSpeciesAnimations(Animation (&animations)[SPECIES_COUNT], PoseCache (&poseCaches)[SPECIES_COUNT], std::ostream &out) {
+  const char *paths[SPECIES_COUNT] = {"Models/Goat-01.gem", "Models/Pig.gem", "Models/Bull-dark.gem", "Models/Duck-mixed.gem"};
+  std::ostringstream discard;
+  for (int s = 0; s < SPECIES_COUNT; s++) {
+    GEMLoader::GEMModelSource source;
+    if (!source.open(paths[s]) || !source.animated) {
+      out << "Could not read " << paths[s] << std::endl;
+      return false;
+    }
+    createAnimation(source, animations[s]);
+    animations[s].compressClips(KeyframeTolerance(), discard);
+    animations[s].bake(60.0f, Matrix(), discard);
+    poseCaches[s].init(&animations[s], Matrix());
+  }
+  return true;
+}
+
+// Hammers the job system with the dependency shapes the frame uses: a parallel pass held back by another, a single
+// job after that, an empty pass held back by a job, and jobs that start and wait on more jobs from inside a worker. Every element must be written once
+// and each stage must see the one before it finished. Build with BENCH_SANITIZE_THREAD to run it under
+// ThreadSanitizer. Returns false on any lost, repeated or out of order job.
+static bool writeJobStressTest(std::ostream &out) {
+  const int rounds = 300;
+  const int count = 1000;
+  bool passed = true;
+  for (int threads : {1, 2, 3, 8}) {
+    JobSystem jobs;
+    jobs.start(threads);
+    long long total = 0;
+    int errors = 0;
+    std::vector<int> a(count), b(count);
+    std::vector<std::atomic<int>> visits(count);
+    for (int round = 0; round < rounds; round++) {
+      std::fill(a.begin(), a.end(), -1);
+      std::fill(b.begin(), b.end(), -1);
+      for (std::atomic<int> &v : visits) {
+        v = 0;
+      }
+      JobCounter first, second, third, nested;
+      std::atomic<long long> sum{0};
+      std::atomic<int> early{0};
+      jobs.parallelFor(first, count, 7, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+          a[i] = i;
+          visits[i]++;
+        }
+      });
+      jobs.parallelFor(
+          second, count, 13,
+          [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+              early += a[i] != i ? 1 : 0;
+              b[i] = a[i] * 2;
+            }
+          },
+          &first);
+      jobs.run(
+          third,
+          [&] {
+            long long partial = 0;
+            for (int v : b) {
+              partial += v;
+            }
+            sum += partial;
+          },
+          &second);
+      // A job that fans out and waits inside a worker, as a pass splitting its own work would
+      jobs.run(nested, [&] {
+        JobCounter inner;
+        jobs.parallelFor(inner, count, 64, [&](int begin, int end) {
+          for (int i = begin; i < end; i++) {
+            visits[i]++;
+          }
+        });
+        jobs.wait(inner);
+      });
+      // A pass held behind a job but given nothing to do, as the enemy update is with no enemies alive: it queues
+      // nothing, so its counter is done at once and the job it depends on has to be waited on by itself
+      JobCounter producer, empty;
+      std::atomic<bool> produced{false};
+      jobs.run(producer, [&] {
+        long long partial = 0;
+        for (int i = 0; i < count; i++) {
+          partial += visits[i];
+        }
+        produced = partial >= 0;
+      });
+      jobs.parallelFor(
+          empty, 0, 16, [&](int begin, int end) { errors++; }, &producer);
+      if (!empty.done()) {
+        errors++;
+      }
+      jobs.wait(empty);
+      jobs.wait(producer);
+      if (!produced) {
+        errors++;
+      }
+      jobs.wait(third);
+      jobs.wait(nested);
+      if (!first.done() || !second.done() || early > 0) {
+        errors++;
+      }
+      for (std::atomic<int> &v : visits) {
+        errors += v != 2 ? 1 : 0;
+      }
+      total += sum;
+    }
+    long long expected = (long long)rounds * (count - 1) * count;
+    bool ok = errors == 0 && total == expected;
+    passed = passed && ok;
+    out << "  " << threads << " threads: sum " << total << " of " << expected << ", " << errors << " errors" << std::endl;
+  }
+  out << (passed ? "Every job ran once and in order" : "Jobs were LOST, repeated or run out of order") << std::endl;
+  return passed;
+}
+
+// Runs a crowd of every species chasing a player who circles the middle of level.txt through the frame's enemy
+// passes (colliders, crowd hash, path search, AI and animation) on the job system with 1, 2, 4 ... threads, up to the
+// hardware's and at least 4. Reports the time per frame and the speedup over one thread. Returns false if a model
+// or the level cannot be read, or if any thread count leaves the enemies somewhere other than one thread does.
+static bool writeJobBenchmark(const std::string &levelFile, std::ostream &out) {
+  Animation animations[SPECIES_COUNT];
+  PoseCache poseCaches[SPECIES_COUNT];
+  Animation *const speciesAnimations[SPECIES_COUNT] = {&animations[0], &animations[1], &animations[2], &animations[3]};
+  PoseCache *const speciesPoseCaches[SPECIES_COUNT] = {&poseCaches[0], &poseCaches[1], &poseCaches[2], &poseCaches[3]};
+  if (!loadSpeciesAnimations(animations, poseCaches, out)) {
+    return false;
+  }
+  std::vector<AABB> colliders;
+  AABB area;
+  if (!readEnemyColliders(levelFile, colliders, area, out)) {
+    return false;
+  }
+  ColliderGrid grid;
+  grid.build(colliders);
+  HeightField heights;
+  heights.build(colliders);
+  FlowField flow;
+  AnimationLODTiers tiers;
+
+  const int perSpecies = 1000;
+  const int frames = 200;
+  const int grain = 16;
+  const float dt = 1.0f / 60.0f;
+  Vec3 centre = (area.min + area.max) * 0.5f;
+  int hardware = (int)std::max(1u, std::thread::hardware_concurrency());
+  out << perSpecies * SPECIES_COUNT << " enemies, " << frames << " frames, " << hardware << " hardware threads" << std::endl;
+
+  bool passed = true;
+  double oneThread = 0;
+  std::vector<Vec3> expected;
+  for (int threads = 1; threads <= std::max(hardware, 4); threads = threads < hardware && threads * 2 > hardware ? hardware : threads * 2) {
+    EnemyStore enemies;
+    enemies.init(speciesAnimations, speciesPoseCaches, perSpecies);
+    BenchmarkRandom random;
+    flow.build(colliders);
+    for (int s = 0; s < SPECIES_COUNT; s++) {
+      while (enemies.spawnedCount((Species)s) < perSpecies) {
+        Vec3 p(random.range(area.min.x, area.max.x), 0.0f, random.range(area.min.z, area.max.z));
+        if (!flow.isBlocked(p)) {
+          enemies.spawn((Species)s, p, Vec3(0, 0, 0));
+        }
+      }
+    }
+    JobSystem jobs;
+    jobs.start(threads);
+    std::vector<AABB> enemyColliders;
+    long long damage = 0;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < frames; f++) {
+      float angle = f * dt * 0.25f;
+      Vec3 feet = centre + Vec3(cosf(angle), 0.0f, sinf(angle)) * 8.0f;
+      JobCounter colliderJobs;
+      enemies.buildColliders(jobs, colliderJobs, enemyColliders, grain);
+      enemies.buildCrowd();
+      jobs.wait(colliderJobs);
+      JobCounter flowJob;
+      jobs.run(flowJob, [&flow, feet] { flow.update(feet, 2048); });
+      EnemyFrame frame;
+      frame.dt = dt;
+      frame.playerPos = feet + Vec3(0, 1.5f, 0);
+      frame.colliders = &grid;
+      frame.ground = &heights;
+      frame.flow = &flow;
+      frame.lod = &tiers;
+      frame.crowd = &enemies.crowd;
+      JobCounter enemyJobs;
+      enemies.update(jobs, enemyJobs, frame, grain, &flowJob);
+      jobs.wait(enemyJobs);
+      jobs.wait(flowJob);
+      for (int d : enemies.damage) {
+        damage += d;
+      }
+      enemies.removeFinished();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    if (threads == 1) {
+      oneThread = seconds;
+    }
+
+    std::vector<Vec3> positions;
+    for (int slot : enemies.live) {
+      positions.push_back(enemies.position[slot]);
+    }
+    bool same = threads == 1 || (positions.size() == expected.size() &&
+                                 memcmp(positions.data(), expected.data(), positions.size() * sizeof(Vec3)) == 0);
+    if (threads == 1) {
+      expected = positions;
+    }
+    passed = passed && same;
+    out << "  " << threads << " threads: " << seconds * 1000.0 / frames << " ms/frame, " << oneThread / seconds << "x, "
+        << damage << " damage dealt" << (same ? "" : ", enemies ended up elsewhere than with one thread") << std::endl;
+  }
+  out << (passed ? "Every thread count matches one thread" : "Thread counts DISAGREE") << std::endl;
+  return passed;
+}
+
+// Walks a crowd of every species in from the two entry points and after a player circling the middle of level.txt
+// on one thread, once deciding every frame and once with AILODTiers. Reports the time per frame, decisions made and
+// put off by the budget, and how many enemies reached the player. Returns false if a model or the level cannot be
+// read, or the tiers reach fewer than 95% of the enemies deciding every frame does.
+static bool writeAIBenchmark(const std::string &levelFile, std::ostream &out) {
+  Animation animations[SPECIES_COUNT];
+  PoseCache poseCaches[SPECIES_COUNT];
+  Animation *const speciesAnimations[SPECIES_COUNT] = {&animations[0], &animations[1], &animations[2], &animations[3]};
+  PoseCache *const speciesPoseCaches[SPECIES_COUNT] = {&poseCaches[0], &poseCaches[1], &poseCaches[2], &poseCaches[3]};
+  if (!loadSpeciesAnimations(animations, poseCaches, out)) {
+    return false;
+  }
+  std::vector<AABB> colliders;
+  AABB area;
+  if (!readEnemyColliders(levelFile, colliders, area, out)) {
+    return false;
+  }
+  ColliderGrid grid;
+  grid.build(colliders);
+  HeightField heights;
+  heights.build(colliders);
+  FlowField flow;
+  AnimationLODTiers animationTiers;
+
+  const int perSpecies = 500;
+  AILODTiers aiTiers;
+  aiTiers.budget = perSpecies * SPECIES_COUNT / 4;
+  const int frames = 600;
+  const float dt = 1.0f / 60.0f;
+  Vec3 centre = (area.min + area.max) * 0.5f;
+  Vec3 entryTargets[2] = {Vec3(-18, 0, -18), Vec3(18, 0, 18)};
+  out << perSpecies * SPECIES_COUNT << " enemies, " << frames << " frames" << std::endl;
+
+  int reached[2] = {0, 0};
+  for (int mode = 0; mode < 2; mode++) {
+    bool tiered = mode == 1;
+    EnemyStore enemies;
+    enemies.init(speciesAnimations, speciesPoseCaches, perSpecies);
+    BenchmarkRandom random;
+    flow.build(colliders);
+    for (int s = 0; s < SPECIES_COUNT; s++) {
+      while (enemies.spawnedCount((Species)s) < perSpecies) {
+        Vec3 p(random.range(area.min.x, area.max.x), 0.0f, random.range(area.min.z, area.max.z));
+        if (!flow.isBlocked(p)) {
+          Vec3 entryTarget = entryTargets[(p - entryTargets[0]).length() < (p - entryTargets[1]).length() ? 0 : 1];
+          enemies.spawn((Species)s, p, entryTarget);
+        }
+      }
+    }
+    JobSystem jobs;
+    jobs.start(1);
+    std::vector<char> caught(enemies.controller.size(), 0);
+    AIStats totals;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int f = 0; f < frames; f++) {
+      float angle = f * dt * 0.25f;
+      Vec3 feet = centre + Vec3(cosf(angle), 0.0f, sinf(angle)) * 8.0f;
+      flow.update(feet, 2048);
+      enemies.buildCrowd();
+      EnemyFrame frame;
+      frame.dt = dt;
+      frame.playerPos = feet + Vec3(0, 1.5f, 0);
+      frame.colliders = &grid;
+      frame.ground = &heights;
+      frame.flow = &flow;
+      frame.lod = &animationTiers;
+      frame.ai = tiered ? &aiTiers : nullptr;
+      frame.crowd = &enemies.crowd;
+      JobCounter enemyJobs;
+      enemies.update(jobs, enemyJobs, frame, 64);
+      jobs.wait(enemyJobs);
+      totals.add(enemies.aiStats);
+      for (int slot : enemies.live) {
+        Vec3 toPlayer = feet - enemies.position[slot];
+        toPlayer.y = 0.0f;
+        if (toPlayer.length() < 2.5f) {
+          caught[slot] = 1;
+        }
+      }
+      enemies.removeFinished();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - start).count();
+    for (char c : caught) {
+      reached[mode] += c;
+    }
+    out << "  " << (tiered ? "AI LOD tiers" : "Deciding every frame") << ": " << seconds * 1000.0 / frames << " ms/frame, "
+        << (double)totals.decisions / frames << " of " << (double)totals.updates / frames << " updates in full, "
+        << (double)totals.deferred / frames << " put off by the budget, " << reached[mode] << " reached the player" << std::endl;
+  }
+  bool passed = reached[1] * 100 >= reached[0] * 95;
+  out << (passed ? "AI LOD tiers reach nearly as many enemies" : "AI LOD tiers reach too FEW enemies") << std::endl;
+  return passed;
+}
+
+// Scatters growing crowds over a square the size of the arena and runs the game's crowd queries against them, once
+// by testing every enemy and once through SpatialHash: explosions (radius 5), melee swings (4 units, 60 degree half
+// angle) and the separation search around every enemy. Enemies move and the hash is rebuilt between batches.
+// Returns false if the hash ever finds a different set of enemies.
+static bool writeCrowdBenchmark(std::ostream &out) {
+  BenchmarkRandom random;
+  bool matched = true;
+  const float half = 50.0f;
+  const int batches = 10;
+  const int queriesPerBatch = 100;
+  const float explosionRadius = 5.0f;
+  const float meleeRange = 4.0f, meleeCos = 0.5f;
+  const float separationRadius = 2.26f; // Two bulls' footprints
+  for (int enemyCount : {250, 1000, 2500, 5000, 10000}) {
+    std::vector<Vec3> positions;
+    for (int e = 0; e < enemyCount; e++) {
+      positions.push_back(Vec3(random.range(-half, half), 0.0f, random.range(-half, half)));
+    }
+    SpatialHash hash;
+    std::vector<int> expected, found;
+    double buildSeconds = 0, bruteSeconds[2] = {0, 0}, hashSeconds[2] = {0, 0};
+    long long inRange[2] = {0, 0};
+    int differ = 0;
+    for (int b = 0; b < batches; b++) {
+      for (Vec3 &p : positions) {
+        p = p + Vec3(random.range(-0.5f, 0.5f), 0.0f, random.range(-0.5f, 0.5f));
+      }
+      auto buildStart = std::chrono::high_resolution_clock::now();
+      hash.build(positions);
+      buildSeconds += std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - buildStart).count();
+
+      for (int q = 0; q < queriesPerBatch; q++) {
+        Vec3 centre(random.range(-half, half), 1.5f, random.range(-half, half));
+        float yaw = random.range(0.0f, 6.28318f);
+        Vec3 forward = Vec3(sinf(yaw), 0, cosf(yaw)).normalize();
+        for (int kind = 0; kind < 2; kind++) {
+          // As the game's explosion and melee loops test each enemy
+          auto start = std::chrono::high_resolution_clock::now();
+          expected.clear();
+          for (int e = 0; e < enemyCount; e++) {
+            Vec3 toEnemy = positions[e] - centre;
+            if (kind == 0) {
+              toEnemy.y = 0;
+              if (toEnemy.length() < explosionRadius) {
+                expected.push_back(e);
+              }
+            } else if (toEnemy.length() < meleeRange && Dot(forward, toEnemy.normalize()) > meleeCos) {
+              expected.push_back(e);
+            }
+          }
+          auto mid = std::chrono::high_resolution_clock::now();
+          found.clear();
+          if (kind == 0) {
+            hash.queryRadius(centre, explosionRadius, found);
+          } else {
+            hash.queryCone(centre, forward, meleeRange, meleeCos, found);
+          }
+          auto end = std::chrono::high_resolution_clock::now();
+          bruteSeconds[kind] += std::chrono::duration<double>(mid - start).count();
+          hashSeconds[kind] += std::chrono::duration<double>(end - mid).count();
+          inRange[kind] += (long long)expected.size();
+          differ += expected != found ? 1 : 0;
+        }
+      }
+    }
+
+    // Every enemy's neighbours, as separation looks for them each frame
+    long long neighbours[2] = {0, 0};
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int e = 0; e < enemyCount; e++) {
+      for (int o = 0; o < enemyCount; o++) {
+        Vec3 offset = positions[o] - positions[e];
+        offset.y = 0;
+        neighbours[0] += (o != e && offset.length() < separationRadius) ? 1 : 0;
+      }
+    }
+    auto mid = std::chrono::high_resolution_clock::now();
+    for (int e = 0; e < enemyCount; e++) {
+      hash.visitRadius(positions[e], separationRadius, [&](int o) {
+        neighbours[1] += o != e ? 1 : 0;
+        return true;
+      });
+    }
+    auto end = std::chrono::high_resolution_clock::now();
+    double bruteMs = std::chrono::duration<double, std::milli>(mid - start).count();
+    double hashMs = std::chrono::duration<double, std::milli>(end - mid).count();
+    differ += neighbours[0] != neighbours[1] ? 1 : 0;
+
+    int queries = batches * queriesPerBatch;
+    double bruteUs[2], hashUs[2];
+    for (int kind = 0; kind < 2; kind++) {
+      bruteUs[kind] = bruteSeconds[kind] * 1e6 / queries;
+      hashUs[kind] = hashSeconds[kind] * 1e6 / queries;
+    }
+    out << enemyCount << " enemies (" << hash.bucketCount() << " buckets, built in " << buildSeconds * 1e6 / batches << " us):" << std::endl;
+    out << "  Explosion: " << (double)inRange[0] / queries << " enemies hit, " << bruteUs[0] << " us brute force, " << hashUs[0]
+        << " us hash (" << bruteUs[0] / hashUs[0] << "x)" << std::endl;
+    out << "  Melee: " << (double)inRange[1] / queries << " enemies hit, " << bruteUs[1] << " us brute force, " << hashUs[1]
+        << " us hash (" << bruteUs[1] / hashUs[1] << "x)" << std::endl;
+    out << "  Separation: " << (double)neighbours[0] / enemyCount << " neighbours each, " << bruteMs << " ms brute force, " << hashMs
+        << " ms hash (" << bruteMs / hashMs << "x)";
+    if (differ > 0) {
+      out << ", " << differ << " queries found different enemies";
+      matched = false;
+    }
+    out << std::endl;
+  }
+  out << (matched ? "Hash and brute force agree" : "Hash and brute force DISAGREE") << std::endl;
+  return matched;
+}
+
+// Walks Core's staging ring through a sequence of uploads and fence completions on a 1 KB ring: aligned offsets,
+// padding to the start when an allocation would straddle the end, refusing what does not fit behind the oldest
+// copy still in flight, and release moving tail up to each completed fence. Returns false if any step differs.
+static bool writeUploadRingTest(std::ostream &out) {
+  int failures = 0;
+  auto expect = [&](bool ok, const char *what) {
+    if (!ok) {
+      out << "  FAILED: " << what << std::endl;
+      failures++;
+    }
+  };
+  UploadRing ring;
+  ring.init(1024);
+  unsigned long long offset = ~0ull;
+  expect(ring.allocate(100, 256, offset) && offset == 0 && ring.head == 100, "first allocation at offset 0");
+  expect(ring.allocate(10, 256, offset) && offset == 256 && ring.head == 266, "second allocation aligned up to 256");
+  ring.retire(1);
+  expect(ring.allocate(400, 256, offset) && offset == 512 && ring.head == 912, "third allocation aligned up to 512");
+  ring.retire(2);
+  ring.retire(2);
+  expect(ring.inFlight.size() == 2 && ring.oldestFence() == 1, "retire with nothing new allocated adds no entry");
+
+  expect(!ring.allocate(2000, 16, offset), "allocation larger than the ring refused");
+  expect(!ring.allocate(200, 16, offset) && ring.head == 912, "allocation padded past the end refused while the start is in flight");
+  ring.release(0);
+  expect(ring.tail == 0 && ring.inFlight.size() == 2, "release before any fence completes keeps tail");
+  ring.release(1);
+  expect(ring.tail == 266 && ring.oldestFence() == 2, "release of fence 1 moves tail to its head");
+  expect(ring.allocate(200, 16, offset) && offset == 0 && ring.head == 1224, "allocation padded to the start of the ring");
+  expect(ring.used() == 958, "used counts the padding at the end");
+
+  ring.retire(3);
+  ring.release(3);
+  expect(ring.tail == 1224 && !ring.hasInFlight() && ring.used() == 0, "release of the last fence empties the ring");
+  expect(ring.allocate(64, 256, offset) && offset == 0 && ring.head == 2048 + 64, "empty ring starts again at offset 0");
+
+  out << (failures == 0 ? "Upload ring bookkeeping matches" : "Upload ring bookkeeping is WRONG") << std::endl;
+  return failures == 0;
+}
+
+// Packs instances of skeletons with different bone counts into one SkinPalette, reused as Model.h does per draw,
+// and reads the uploaded bytes back the way VSAnimInstanced.txt does: instance i starts at element
+// SV_InstanceID * paletteStride with its world matrix, followed by its bones. Returns false if the accessors or the
+// bytes disagree with that layout.
+static bool writeSkinPaletteTest(std::ostream &out) {
+  // Every element of every matrix different, and exact as a float
+  auto value = [](int palette, int instance, int bone, int element) {
+    return (float)(palette * 100000 + instance * 1000 + (bone + 1) * 16 + element);
+  };
+  auto fill = [&](int palette, int instance, int bone) {
+    Matrix m;
+    for (int j = 0; j < 16; j++) {
+      m.m[j] = value(palette, instance, bone, j);
+    }
+    return m;
+  };
+  const int boneCounts[] = {1, 4, 17, 53};
+  const int instanceCounts[] = {3, 1, 5, 2};
+  int failures = 0;
+  SkinPalette palette;
+  for (int p = 0; p < 4; p++) {
+    int bones = boneCounts[p];
+    palette.begin(bones);
+    for (int i = 0; i < instanceCounts[p]; i++) {
+      std::vector<Matrix> pose(bones);
+      for (int b = 0; b < bones; b++) {
+        pose[b] = fill(p, i, b);
+      }
+      palette.add(fill(p, i, -1), pose.data());
+    }
+    int errors = 0;
+    unsigned int stride = palette.stride();
+    errors += stride != (unsigned int)bones + 1 ? 1 : 0;
+    errors += palette.count != instanceCounts[p] ? 1 : 0;
+    errors += palette.sizeInBytes() != instanceCounts[p] * (bones + 1) * 16 * sizeof(float) ? 1 : 0;
+    const float *buffer = (const float *)palette.matrices.data();
+    for (unsigned int instanceID = 0; instanceID < (unsigned int)instanceCounts[p]; instanceID++) {
+      unsigned int base = instanceID * stride;
+      for (int b = -1; b < bones; b++) {
+        const float *shaderRead = buffer + (base + 1 + b) * 16;
+        const Matrix &packed = b < 0 ? palette.world(instanceID) : palette.bone(instanceID, b);
+        for (int j = 0; j < 16; j++) {
+          float expected = value(p, instanceID, b, j);
+          errors += shaderRead[j] != expected || packed.m[j] != expected ? 1 : 0;
+        }
+      }
+    }
+    out << "  " << bones << " bones x " << instanceCounts[p] << " instances: stride " << stride << ", " << palette.sizeInBytes()
+        << " bytes, " << errors << " errors" << std::endl;
+    failures += errors;
+  }
+  out << (failures == 0 ? "Palettes match the instanced skinning shader's layout" : "Palettes DISAGREE with the shader's layout")
+      << std::endl;
+  return failures == 0;
+}
+
+// One benchmark or check. run writes its report to out and returns false if the check fails or its input cannot
+// be read.
+struct BenchCommand {
+  const char *name;
+  const char *description;
+  bool (*run)(std::ostream &out);
+};
+
+static const BenchCommand benchCommands[] = {
+    {"cook", "Rebuilds every Models/*.gemc", [](std::ostream &out) { return GEMLoader::GEMCache::cookDirectory("Models", out); }},
+    {"bench-load", "Times loading every model in Models with GEMModelLoader and GEMModelView",
+     [](std::ostream &out) { return writeLoadBenchmark("Models", out); }},
+    {"cull-report", "Frustum culls the level's instances with SIMD and scalar tests",
+     [](std::ostream &out) { return writeCullReport("level.txt", out); }},
+    {"bench-anim", "Times skeleton sampling, animation LOD, baking and the pose cache on the bull",
+     [](std::ostream &out) { return writeAnimationBenchmark("Models/Bull-dark.gem", out); }},
+    {"compress-report", "Compresses the keyframes of every animated model in Models",
+     [](std::ostream &out) { return writeCompressionReport("Models", out); }},
+    {"bench-collision", "Times scene collision queries with and without the collider grid", writeCollisionBenchmark},
+    {"bench-raycast", "Times shooting rays through the scene and enemy trees", writeRaycastBenchmark},
+    {"bench-slab", "Checks the four box ray test against the scalar one and times both", writeSlabBenchmark},
+    {"height-report", "Checks the baked ground heights against the level colliders",
+     [](std::ostream &out) { return writeHeightFieldReport("level.txt", out); }},
+    {"bench-flow", "Runs crowds of agents through the level with and without the flow field",
+     [](std::ostream &out) { return writeFlowBenchmark("level.txt", out); }},
+    {"stress-jobs", "Checks the job system runs every job once and in dependency order under load", writeJobStressTest},
+    {"bench-jobs", "Runs the enemy passes on the job system with growing thread counts",
+     [](std::ostream &out) { return writeJobBenchmark("level.txt", out); }},
+    {"bench-ai", "Runs a crowd with and without AI LOD tiers", [](std::ostream &out) { return writeAIBenchmark("level.txt", out); }},
+    {"bench-crowd", "Times crowd queries through the spatial hash against testing every enemy", writeCrowdBenchmark},
+    {"bench-palette", "Checks instanced bone palettes against the layout the skinning shader reads", writeSkinPaletteTest},
+    {"bench-upload-ring", "Checks the staging ring's offsets, padding and fence bookkeeping", writeUploadRingTest},
+};
+
+// Runs each benchmark named on the command line, matched exactly, writing the reports to standard output. Run it
+// from the directory holding Models and level.txt. Returns 1 if any of them fails or is not known.
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "Usage: " << argv[0] << " <benchmark>..." << std::endl;
+    for (const BenchCommand &command : benchCommands) {
+      std::cout << "  " << command.name << ": " << command.description << std::endl;
+    }
+    return 1;
+  }
+  bool passed = true;
+  for (int a = 1; a < argc; a++) {
+    const BenchCommand *found = nullptr;
+    for (const BenchCommand &command : benchCommands) {
+      if (strcmp(argv[a], command.name) == 0) {
+        found = &command;
+      }
+    }
+    if (found == nullptr) {
+      std::cout << "Unknown benchmark " << argv[a] << ", run with no arguments for the list" << std::endl;
+      passed = false;
+      continue;
+    }
+    std::cout << "== " << found->name << std::endl;
+    if (!found->run(std::cout)) {
+      passed = false;
+    }
+  }
+  return passed ? 0 : 1;
+}
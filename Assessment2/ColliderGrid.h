@@ -0,0 +1,158 @@
+#pragma once
+#include "Collision.h"
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// Static colliders bucketed into a uniform grid over the x / z plane. Built once after the level is loaded,
+// then overlap and ground queries only look at the cells under the query instead of every collider.
+class ColliderGrid {
+public:
+  std::vector<AABB> colliders;
+
+  void build(const std::vector<AABB> &boxes, float size = 4.0f) {
+    colliders = boxes;
+    cellSize = size;
+    cellStart.clear();
+    cellItems.clear();
+    minCellX.clear();
+    minCellZ.clear();
+    if (colliders.empty()) {
+      columns = rows = 0;
+      return;
+    }
+
+    originX = originZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+    for (const auto &box : colliders) {
+      originX = std::min(originX, box.min.x);
+      originZ = std::min(originZ, box.min.z);
+      maxX = std::max(maxX, box.max.x);
+      maxZ = std::max(maxZ, box.max.z);
+    }
+    // Keep the grid to at most MAX_CELLS_PER_AXIS a side by growing the cells on very large levels
+    cellSize = std::max(cellSize, std::max(maxX - originX, maxZ - originZ) / MAX_CELLS_PER_AXIS);
+    invCellSize = 1.0f / cellSize;
+    columns = cellX(maxX) + 1;
+    rows = cellZ(maxZ) + 1;
+
+    // Count then fill, so every cell's indices sit together in cellItems and stay in collider order
+    cellStart.assign(columns * rows + 1, 0);
+    minCellX.resize(colliders.size());
+    minCellZ.resize(colliders.size());
+    for (int i = 0; i < (int)colliders.size(); i++) {
+      minCellX[i] = cellX(colliders[i].min.x);
+      minCellZ[i] = cellZ(colliders[i].min.z);
+      for (int z = minCellZ[i]; z <= cellZ(colliders[i].max.z); z++) {
+        for (int x = minCellX[i]; x <= cellX(colliders[i].max.x); x++) {
+          cellStart[z * columns + x + 1]++;
+        }
+      }
+    }
+    for (int c = 0; c < columns * rows; c++) {
+      cellStart[c + 1] += cellStart[c];
+    }
+    cellItems.resize(cellStart.back());
+    std::vector<int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (int i = 0; i < (int)colliders.size(); i++) {
+      for (int z = minCellZ[i]; z <= cellZ(colliders[i].max.z); z++) {
+        for (int x = minCellX[i]; x <= cellX(colliders[i].max.x); x++) {
+          cellItems[fill[z * columns + x]++] = i;
+        }
+      }
+    }
+  }
+
+  bool empty() const { return colliders.empty(); }
+
+  // Appends the index of every collider touching box (edges included) to out, in ascending order so they are
+  // visited in the same order as a loop over the whole list
+  void query(const AABB &box, std::vector<int> &out) const {
+    if (colliders.empty()) {
+      return;
+    }
+    int x0 = std::max(cellX(box.min.x), 0);
+    int z0 = std::max(cellZ(box.min.z), 0);
+    int x1 = std::min(cellX(box.max.x), columns - 1);
+    int z1 = std::min(cellZ(box.max.z), rows - 1);
+    size_t start = out.size();
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        for (int c = cellStart[z * columns + x]; c < cellStart[z * columns + x + 1]; c++) {
+          int i = cellItems[c];
+          // A collider spanning several cells is only reported from the first of them inside the query
+          if (x != std::max(minCellX[i], x0) || z != std::max(minCellZ[i], z0)) {
+            continue;
+          }
+          const AABB &other = colliders[i];
+          if (other.min.x <= box.max.x && other.max.x >= box.min.x && other.min.y <= box.max.y &&
+              other.max.y >= box.min.y && other.min.z <= box.max.z && other.max.z >= box.min.z) {
+            out.push_back(i);
+          }
+        }
+      }
+    }
+    std::sort(out.begin() + start, out.end());
+  }
+
+  // Walks the colliders a box may touch in collider order, the same order as a loop over the whole list, calling
+  // push(wall) for each one. push returns the box after any correction. Each correction is shallower than the box,
+  // so the colliders are looked up in the box grown by its own size, and again around the box (skipping those
+  // already visited) if the corrections add up to carry it outside that area.
+  template <typename Push> void resolve(AABB box, std::vector<int> &nearby, Push push) const {
+    AABB area = grown(box);
+    nearby.clear();
+    query(area, nearby);
+    for (size_t next = 0; next < nearby.size();) {
+      int index = nearby[next++];
+      box = push(colliders[index]);
+      if (box.min.x < area.min.x || box.min.y < area.min.y || box.min.z < area.min.z || box.max.x > area.max.x ||
+          box.max.y > area.max.y || box.max.z > area.max.z) {
+        area = grown(box);
+        nearby.clear();
+        query(area, nearby);
+        next = std::upper_bound(nearby.begin(), nearby.end(), index) - nearby.begin();
+      }
+    }
+  }
+
+  // Highest top face under the point that is no more than stepHeight above it, or -FLT_MAX if there is none
+  float surfaceBelow(const Vec3 &p, float stepHeight = 0.5f) const {
+    float surface = -FLT_MAX;
+    int x = cellX(p.x);
+    int z = cellZ(p.z);
+    if (colliders.empty() || x < 0 || z < 0 || x >= columns || z >= rows) {
+      return surface;
+    }
+    for (int c = cellStart[z * columns + x]; c < cellStart[z * columns + x + 1]; c++) {
+      const AABB &wall = colliders[cellItems[c]];
+      if (p.x >= wall.min.x && p.x <= wall.max.x && p.z >= wall.min.z && p.z <= wall.max.z &&
+          p.y >= wall.max.y - stepHeight && wall.max.y > surface) {
+        surface = wall.max.y;
+      }
+    }
+    return surface;
+  }
+
+  int cellCount() const { return columns * rows; }
+  int entryCount() const { return (int)cellItems.size(); }
+
+private:
+  static const int MAX_CELLS_PER_AXIS = 256;
+
+  float cellSize = 4.0f;
+  float invCellSize = 0.25f;
+  float originX = 0.0f, originZ = 0.0f;
+  int columns = 0, rows = 0;
+  std::vector<int> cellStart; // cellItems[cellStart[c] .. cellStart[c + 1]) are the colliders in cell c
+  std::vector<int> cellItems;
+  std::vector<int> minCellX, minCellZ;
+
+  static AABB grown(const AABB &box) {
+    Vec3 size = box.max - box.min;
+    return AABB(box.min - size, box.max + size);
+  }
+
+  int cellX(float x) const { return (int)floorf((x - originX) * invCellSize); }
+  int cellZ(float z) const { return (int)floorf((z - originZ) * invCellSize); }
+};
@@ -4,6 +4,7 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include <xmmintrin.h>
 
 struct AABB {
   Vec3 min;
@@ -22,6 +23,36 @@ struct AABB {
   }
 };
 
+// Up to four boxes stored as separate min / max arrays per axis so one ray can be tested against all of them at once
+struct AABBPacket {
+  float minX[4];
+  float minY[4];
+  float minZ[4];
+  float maxX[4];
+  float maxY[4];
+  float maxZ[4];
+  int count = 0;
+
+  void set(int lane, const AABB &box) {
+    minX[lane] = box.min.x;
+    minY[lane] = box.min.y;
+    minZ[lane] = box.min.z;
+    maxX[lane] = box.max.x;
+    maxY[lane] = box.max.y;
+    maxZ[lane] = box.max.z;
+  }
+
+  // Unused lanes hold a zero size box at the origin; rayAABBDistance4 masks them out
+  void clear() {
+    for (int lane = 0; lane < 4; lane++) {
+      set(lane, AABB(Vec3(0, 0, 0), Vec3(0, 0, 0)));
+    }
+    count = 0;
+  }
+
+  void add(const AABB &box) { set(count++, box); }
+};
+
 struct ModelBounds {
   float halfExtentX, halfExtentY, halfExtentZ;
 
@@ -98,6 +129,21 @@ inline AABB getStaticModelAABB(const std::string &modelName, Vec3 position) {
                                 Vec3(0.5f, 1.0f, 0.5f));
 }
 
+// Collider of a level object. Objects turned a quarter turn have their x and z extents swapped.
+inline AABB getLevelObjectAABB(const std::string &modelName, Vec3 position, float rotation) {
+  bool isRotated90 = (fabs(fmod(rotation, 180.0f) - 90.0f) < 1.0f);
+  if (isRotated90) {
+    auto it = StaticModelBounds.find(modelName);
+    if (it != StaticModelBounds.end()) {
+      Vec3 extent = it->second.toVec3();
+      Vec3 swappedExtent(extent.z, extent.y, extent.x);
+      Vec3 center = position + Vec3(0, extent.y, 0);
+      return AABB::fromCenterExtent(center, swappedExtent);
+    }
+  }
+  return getStaticModelAABB(modelName, position);
+}
+
 inline AABB getAnimatedModelAABB(const std::string &modelName, Vec3 position) {
   auto it = AnimatedModelBounds.find(modelName);
   if (it != AnimatedModelBounds.end()) {
@@ -149,78 +195,82 @@ public:
     }
   }
 
-  // Ray-AABB
+  // Ray-AABB, for one-off tests. Rays against many boxes go through rayAABBDistance4 or AABBTree::raycast.
   static bool rayIntersectsAABB(Vec3 rayOrigin, Vec3 rayDir, const AABB &box,
                                 float maxDist = 1000.0f) {
+    float distance;
+    return rayAABBDistance(rayOrigin, rayDir, box, maxDist, distance);
+  }
+
+  // Ray-AABB returning where the ray enters the box, or 0 if it starts inside
+  static bool rayAABBDistance(const Vec3 &rayOrigin, const Vec3 &rayDir, const AABB &box,
+                              float maxDist, float &distance) {
     float tmin = 0.0f;
     float tmax = maxDist;
+    if (!raySlab(rayOrigin.x, rayDir.x, box.min.x, box.max.x, tmin, tmax) ||
+        !raySlab(rayOrigin.y, rayDir.y, box.min.y, box.max.y, tmin, tmax) ||
+        !raySlab(rayOrigin.z, rayDir.z, box.min.z, box.max.z, tmin, tmax))
+      return false;
+    distance = tmin;
+    return true;
+  }
 
-    // X axis
-    if (fabsf(rayDir.x) < 0.0001f) {
-      if (rayOrigin.x < box.min.x || rayOrigin.x > box.max.x)
-        return false;
-    } else {
-      float invD = 1.0f / rayDir.x;
-      float t1 = (box.min.x - rayOrigin.x) * invD;
-      float t2 = (box.max.x - rayOrigin.x) * invD;
-
-      if (t1 > t2) {
-        float tmp = t1;
-        t1 = t2;
-        t2 = tmp;
-      }
-
-      tmin = std::max(tmin, t1);
-      tmax = std::min(tmax, t2);
+  // rayAABBDistance against every box of a packet. Bit i of the result is set if box i is hit, with its distance
+  // in distances[i]. Gives exactly the scalar results: the per-axis min / max operands are ordered so ties and
+  // signed zeros come out the same way as the comparisons in raySlab.
+  static int rayAABBDistance4(const Vec3 &rayOrigin, const Vec3 &rayDir, const AABBPacket &boxes, float maxDist,
+                              float *distances) {
+    __m128 tmin = _mm_setzero_ps();
+    __m128 tmax = _mm_set1_ps(maxDist);
+    __m128 inside = _mm_cmpeq_ps(tmin, tmin);
+    raySlab4(rayOrigin.x, rayDir.x, boxes.minX, boxes.maxX, tmin, tmax, inside);
+    raySlab4(rayOrigin.y, rayDir.y, boxes.minY, boxes.maxY, tmin, tmax, inside);
+    raySlab4(rayOrigin.z, rayDir.z, boxes.minZ, boxes.maxZ, tmin, tmax, inside);
+    _mm_storeu_ps(distances, tmin);
+    return _mm_movemask_ps(_mm_and_ps(inside, _mm_cmple_ps(tmin, tmax))) & ((1 << boxes.count) - 1);
+  }
 
-      if (tmin > tmax)
-        return false;
+private:
+  // One axis of rayAABBDistance4. Whether the ray is parallel to the axis is the same for every box.
+  static void raySlab4(float origin, float dir, const float *lo, const float *hi, __m128 &tmin, __m128 &tmax,
+                       __m128 &inside) {
+    __m128 o = _mm_set1_ps(origin);
+    __m128 vlo = _mm_loadu_ps(lo);
+    __m128 vhi = _mm_loadu_ps(hi);
+    if (fabsf(dir) < 0.0001f) {
+      inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(o, vlo), _mm_cmple_ps(o, vhi)));
+      return;
     }
 
-    // Y axis
-    if (fabsf(rayDir.y) < 0.0001f) {
-      if (rayOrigin.y < box.min.y || rayOrigin.y > box.max.y)
-        return false;
-    } else {
-      float invD = 1.0f / rayDir.y;
-      float t1 = (box.min.y - rayOrigin.y) * invD;
-      float t2 = (box.max.y - rayOrigin.y) * invD;
-
-      if (t1 > t2) {
-        float tmp = t1;
-        t1 = t2;
-        t2 = tmp;
-      }
-
-      tmin = std::max(tmin, t1);
-      tmax = std::min(tmax, t2);
-
-      if (tmin > tmax)
-        return false;
-    }
+    __m128 invD = _mm_set1_ps(1.0f / dir);
+    __m128 t1 = _mm_mul_ps(_mm_sub_ps(vlo, o), invD);
+    __m128 t2 = _mm_mul_ps(_mm_sub_ps(vhi, o), invD);
+    // _mm_min_ps(a, b) is a < b ? a : b, so these pick t1 on a tie like the swap in raySlab
+    __m128 tnear = _mm_min_ps(t2, t1);
+    __m128 tfar = _mm_max_ps(t1, t2);
+    tmin = _mm_max_ps(tnear, tmin);
+    tmax = _mm_min_ps(tfar, tmax);
+  }
 
-    // Z axis
-    if (fabsf(rayDir.z) < 0.0001f) {
-      if (rayOrigin.z < box.min.z || rayOrigin.z > box.max.z)
-        return false;
-    } else {
-      float invD = 1.0f / rayDir.z;
-      float t1 = (box.min.z - rayOrigin.z) * invD;
-      float t2 = (box.max.z - rayOrigin.z) * invD;
-
-      if (t1 > t2) {
-        float tmp = t1;
-        t1 = t2;
-        t2 = tmp;
-      }
+  // Narrows [tmin, tmax] to the part of the ray between the two planes of one axis
+  static bool raySlab(float origin, float dir, float lo, float hi, float &tmin,
+                      float &tmax) {
+    if (fabsf(dir) < 0.0001f)
+      return origin >= lo && origin <= hi;
 
-      tmin = std::max(tmin, t1);
-      tmax = std::min(tmax, t2);
+    float invD = 1.0f / dir;
+    float t1 = (lo - origin) * invD;
+    float t2 = (hi - origin) * invD;
 
-      if (tmin > tmax)
-        return false;
+    if (t1 > t2) {
+      float tmp = t1;
+      t1 = t2;
+      t2 = tmp;
     }
 
-    return true;
+    tmin = std::max(tmin, t1);
+    tmax = std::min(tmax, t2);
+
+    return tmin <= tmax;
   }
 };
@@ -1,10 +1,17 @@
 #pragma once
 
 #include "Animation.h"
-#include "Collision.h"
+#include "ColliderGrid.h"
+#include "FlowField.h"
 #include "GEMLoader.h"
+#include "HeightField.h"
+#ifdef _WIN32
 #include <Windows.h>
+#else
+#define VK_SHIFT 0x10 // Only the virtual key codes are needed, so the AI builds headless on other platforms
+#endif
 #include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -461,6 +468,50 @@ enum class EnemyState {
   REMOVED
 };
 
+struct AILODTier {
+  float maxDistance;
+  int decisionInterval; // Frames from one steering decision to the next
+};
+
+// How often enemies walking in (ENTERING) or chasing decide where to steer, by distance bands to the player,
+// nearest first. Between decisions they keep walking the way the last one chose. Enemies in the nearest band
+// decide every time they are due; the rest share budget decisions a frame, the longest overdue first.
+class AILODTiers {
+public:
+  std::vector<AILODTier> tiers;
+  int budget = 128;
+
+  AILODTiers() {
+    tiers.push_back({12.0f, 1});
+    tiers.push_back({30.0f, 2});
+    tiers.push_back({60.0f, 4});
+    tiers.push_back({FLT_MAX, 8});
+  }
+
+  int select(float distance) const {
+    for (const AILODTier &tier : tiers) {
+      if (distance <= tier.maxDistance) {
+        return tier.decisionInterval;
+      }
+    }
+    return tiers.empty() ? 1 : tiers.back().decisionInterval;
+  }
+};
+
+// Enemy updates, those run in full (a steering decision, or a state that always runs in full), and the due
+// decisions the budget put off
+struct AIStats {
+  long long updates = 0;
+  long long decisions = 0;
+  long long deferred = 0;
+
+  void add(const AIStats &other) {
+    updates += other.updates;
+    decisions += other.decisions;
+    deferred += other.deferred;
+  }
+};
+
 class EnemyController {
 private:
   AnimationInstance *instance = nullptr;
@@ -491,6 +542,12 @@ private:
   const float circlingJumpThreshold = 3.0f; 
   const float circlingRadius = 5.0f; 
 
+  // Steering between decisions
+  Vec3 heading;              // Direction the last decision walked in
+  bool hasHeading = false;   // Cleared by anything other than walking in or chasing
+  float coastTime = 0.0f;    // Seconds walked since the last decision
+  Vec3 separation;           // Push away from the crowd in units per second, only walked while chasing
+
   // Jump 
   float velocityY = 0.0f;
   bool isJumping = false;
@@ -499,6 +556,7 @@ private:
   const float defaultGroundY = 0.0f;
   const float heightTolerance = 1.0f;
   const float playerEyeHeight = 1.5f;
+  std::vector<int> nearbyColliders; // Scratch for ColliderGrid::resolve, kept to avoid allocating each frame
 
   // Entry path 
   Vec3 entryTarget; // Target position to move to before chasing
@@ -508,6 +566,7 @@ private:
   // Animation names
   std::string idleAnim, runAnim, attackAnim, hitAnim, deathAnim;
   std::string turnLeftAnim, turnRightAnim;
+  int idleClip = -1, runClip = -1, attackClip = -1, hitClip = -1, deathClip = -1;
 
   std::string getPrefix() { return isDuck ? "bird " : ""; }
 
@@ -548,6 +607,9 @@ public:
     isAvoiding = false;
     velocityY = 0.0f;
     isJumping = false;
+    hasHeading = false;
+    coastTime = 0.0f;
+    separation = Vec3(0, 0, 0);
 
     std::string prefix = getPrefix();
 
@@ -576,6 +638,14 @@ public:
     deathAnim = findAnim(prefix + "death");
     turnLeftAnim = findAnim(prefix + "turn");
     turnRightAnim = findAnim(prefix + "turn");
+
+    if (instance && instance->animation) {
+      idleClip = instance->animation->findClip(idleAnim);
+      runClip = instance->animation->findClip(runAnim);
+      attackClip = instance->animation->findClip(attackAnim);
+      hitClip = instance->animation->findClip(hitAnim);
+      deathClip = instance->animation->findClip(deathAnim);
+    }
   }
 
   void takeDamage(int damage, Vec3 knockbackDir) {
@@ -601,8 +671,11 @@ public:
   }
 
   bool update(float dt, Vec3 playerPos, int &playerDamageOut,
-              const std::vector<AABB> *staticColliders = nullptr,
-              const std::string &modelName = "") {
+              const ColliderGrid *staticColliders = nullptr,
+              const std::string &modelName = "",
+              const HeightField *ground = nullptr,
+              const FlowField *flow = nullptr,
+              bool decide = true) {
     if (!instance || !data || !initialized)
       return false;
     playerDamageOut = 0;
@@ -612,6 +685,16 @@ public:
       return false;
     }
 
+    // Between decisions only the walking is stepped; the next decision catches up on the time
+    if (!decide && hasHeading && isSteering()) {
+      applyGravity(dt, staticColliders, ground);
+      coast(dt, staticColliders, modelName);
+      return data->isAlive;
+    }
+    float elapsed = dt + coastTime; // Since the last decision
+    coastTime = 0.0f;
+    hasHeading = false;
+
     Vec3 toPlayer = playerPos - position;
     float playerFeetY = playerPos.y - playerEyeHeight;
     float heightDiff = playerFeetY - position.y;
@@ -620,35 +703,11 @@ public:
     float angleDiff = getAngleToTarget(position, playerPos, yaw);
     bool sameHeight = fabsf(heightDiff) < heightTolerance;
 
-    // Calculate dynamic ground height
-    float currentGroundY = defaultGroundY;
-    if (staticColliders && !staticColliders->empty()) {
-      for (const auto &wall : *staticColliders) {
-        if (position.x >= wall.min.x && position.x <= wall.max.x &&
-            position.z >= wall.min.z && position.z <= wall.max.z) {
-          if (position.y >= wall.max.y - 0.5f) {
-            if (wall.max.y > currentGroundY) {
-              currentGroundY = wall.max.y;
-            }
-          }
-        }
-      }
-    }
-
-    // Update jump physics
-    if (isJumping || position.y > currentGroundY) {
-      velocityY -= gravity * dt;
-      position.y += velocityY * dt;
-      if (position.y <= currentGroundY) {
-        position.y = currentGroundY;
-        velocityY = 0.0f;
-        isJumping = false;
-      }
-    }
+    applyGravity(dt, staticColliders, ground);
 
     switch (currentState) {
     case EnemyState::IDLE:
-      instance->update(idleAnim, dt);
+      instance->update(idleClip, dt);
       if (instance->animationFinished())
         instance->resetAnimationTime();
       currentState = EnemyState::CHASE;
@@ -670,21 +729,33 @@ public:
         Vec3 forward(sinf(yaw), 0, cosf(yaw));
         position = position + forward * data->moveSpeed * dt;
         lastPosition = position;
+        heading = forward;
+        hasHeading = true;
       }
 
-      instance->update(runAnim, dt);
+      instance->update(runClip, dt);
       if (instance->animationFinished())
         instance->resetAnimationTime();
     } break;
 
     case EnemyState::CHASE: {
+      // Follow the shared flow field around obstacles. The stuck detection and sideways avoidance are only the
+      // fallback for where it gives no direction: next to the player, or with no path out of the cell.
+      Vec3 flowDir;
+      bool following = flow && flow->direction(position, flowDir);
       Vec3 posDelta = position - lastPosition;
       posDelta.y = 0;
       float moveDistance = posDelta.length();
-      float expectedMove = data->moveSpeed * dt * 0.4f;
+      float expectedMove = data->moveSpeed * elapsed * 0.4f;
 
-      if (moveDistance < expectedMove) {
-        stuckTimer += dt;
+      if (following) {
+        stuckTimer = 0.0f;
+        isAvoiding = false;
+        directionLocked = false;
+        avoidanceAttempts = 0;
+        totalAvoidanceTime = 0.0f;
+      } else if (moveDistance < expectedMove) {
+        stuckTimer += elapsed;
         if (stuckTimer > stuckThreshold) {
           if (!isAvoiding) {
             isAvoiding = true;
@@ -716,14 +787,16 @@ public:
 
       lastPosition = position;
 
-      if (isAvoiding) {
-        avoidanceTimer += dt;
+      if (!following && isAvoiding) {
+        avoidanceTimer += elapsed;
         yaw += angleDiff * 0.2f;
         Vec3 forward(sinf(yaw), 0, cosf(yaw));
         Vec3 sideDir(cosf(yaw), 0, -sinf(yaw));
         Vec3 moveDir = forward * 0.5f + sideDir * (float)avoidanceDir * 0.7f;
         moveDir = moveDir.normalize();
-        position = position + moveDir * data->moveSpeed * dt;
+        position = position + (moveDir * data->moveSpeed + separation) * dt;
+        heading = moveDir;
+        hasHeading = true;
 
         if (staticColliders && !staticColliders->empty()) {
           resolveStaticCollisions(*staticColliders, modelName);
@@ -756,16 +829,23 @@ public:
           directionLocked = false;
         }
       } else {
-        yaw += angleDiff;
+        // Along the flow field, or straight for the player once close
+        if (following) {
+          yaw = atan2f(flowDir.x, flowDir.z);
+        } else {
+          yaw += angleDiff;
+        }
         Vec3 forward(sinf(yaw), 0, cosf(yaw));
-        position = position + forward * data->moveSpeed * dt;
+        position = position + (forward * data->moveSpeed + separation) * dt;
+        heading = forward;
+        hasHeading = true;
 
         if (staticColliders && !staticColliders->empty()) {
           resolveStaticCollisions(*staticColliders, modelName);
         }
       }
 
-      instance->update(runAnim, dt);
+      instance->update(runClip, dt);
       if (instance->animationFinished())
         instance->resetAnimationTime();
 
@@ -795,7 +875,7 @@ public:
       break;
 
     case EnemyState::ATTACK:
-      instance->update(attackAnim, dt);
+      instance->update(attackClip, dt);
       attackTimer += dt;
       if (!sameHeight) {
         currentState = EnemyState::CHASE;
@@ -821,7 +901,7 @@ public:
       break;
 
     case EnemyState::HIT_REACT:
-      instance->update(hitAnim, dt);
+      instance->update(hitClip, dt);
       hitReactTimer += dt;
       if (instance->animationFinished() || hitReactTimer > 1.0f) {
         currentState = EnemyState::CHASE;
@@ -830,7 +910,7 @@ public:
       break;
 
     case EnemyState::DEATH:
-      instance->update(deathAnim, dt);
+      instance->update(deathClip, dt);
       deathTimer += dt;
       if (deathTimer >= 1.0f) {
         currentState = EnemyState::REMOVED;
@@ -845,15 +925,65 @@ public:
     return data->isAlive;
   }
 
+  // Picks the animation LOD tier from the distance to the camera and whether the enemy is in view.
+  // Call before update so the tier applies to this frame's animation step.
+  void updateAnimationLOD(const AnimationLODTiers &tiers, const Vec3 &cameraPos, bool visible) {
+    if (!instance)
+      return;
+    Vec3 toCamera = cameraPos - position;
+    instance->setLOD(tiers.select(toCamera.length(), visible));
+  }
+
+  // Crowd push for the next update, applied while chasing before the collision resolve so walls still win
+  void setSeparation(const Vec3 &push) { separation = push; }
+
   bool isAlive() const { return data && data->isAlive; }
+  // Walking in or chasing, the states whose decisions AILODTiers spreads out
+  bool isSteering() const { return currentState == EnemyState::ENTERING || currentState == EnemyState::CHASE; }
   int getHealth() const { return data ? data->health : 0; }
   EnemyState getState() const { return currentState; }
 
 private:
-  void resolveStaticCollisions(const std::vector<AABB> &colliders,
+  void applyGravity(float dt, const ColliderGrid *staticColliders, const HeightField *ground) {
+    // Calculate dynamic ground height
+    float currentGroundY = defaultGroundY;
+    if (ground) {
+      currentGroundY = std::max(currentGroundY, ground->surfaceBelow(position));
+    } else if (staticColliders && !staticColliders->empty()) {
+      currentGroundY = std::max(currentGroundY, staticColliders->surfaceBelow(position));
+    }
+
+    // Update jump physics
+    if (isJumping || position.y > currentGroundY) {
+      velocityY -= gravity * dt;
+      position.y += velocityY * dt;
+      if (position.y <= currentGroundY) {
+        position.y = currentGroundY;
+        velocityY = 0.0f;
+        isJumping = false;
+      }
+    }
+  }
+
+  // Keeps walking along heading, pushed out of the colliders as a chasing enemy always is
+  void coast(float dt, const ColliderGrid *staticColliders, const std::string &modelName) {
+    coastTime += dt;
+    position = position + heading * data->moveSpeed * dt;
+    if (currentState == EnemyState::CHASE) {
+      position = position + separation * dt;
+      if (staticColliders && !staticColliders->empty()) {
+        resolveStaticCollisions(*staticColliders, modelName);
+      }
+    }
+    instance->update(runClip, dt);
+    if (instance->animationFinished())
+      instance->resetAnimationTime();
+  }
+
+  void resolveStaticCollisions(const ColliderGrid &colliders,
                                const std::string &modelName) {
     AABB enemyAABB = getAnimatedModelAABB(modelName, position);
-    for (const auto &wall : colliders) {
+    colliders.resolve(enemyAABB, nearbyColliders, [&](const AABB &wall) {
       CollisionInfo info = CollisionSystem::checkAABB(enemyAABB, wall);
       if (info.collided) {
         info.normal.y = 0;
@@ -862,6 +992,7 @@ private:
           enemyAABB = getAnimatedModelAABB(modelName, position);
         }
       }
-    }
+      return enemyAABB;
+    });
   }
 };
\ No newline at end of file
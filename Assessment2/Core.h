@@ -3,6 +3,8 @@
 #include <d3d12.h>
 #include <dxgi1_4.h>
 #include <vector>
+#include <deque>
+#include "UploadRing.h"
 
 #pragma comment(lib, "d3d12")
 #pragma comment(lib, "dxgi")
@@ -33,6 +35,18 @@ public:
 			WaitForSingleObject(eventHandle, INFINITE);
 		}
 	}
+	void waitFor(long long target)
+	{
+		if (fence->GetCompletedValue() < target)
+		{
+			fence->SetEventOnCompletion(target, eventHandle);
+			WaitForSingleObject(eventHandle, INFINITE);
+		}
+	}
+	long long completed()
+	{
+		return fence->GetCompletedValue();
+	}
 	~GPUFence()
 	{
 		CloseHandle(eventHandle);
@@ -40,6 +54,14 @@ public:
 	}
 };
 
+// State a buffer patched on the graphics queue was left in, and by which command list. Buffers decay to COMMON when
+// a command list finishes, so the state only holds within the list that set it.
+struct BufferState
+{
+	D3D12_RESOURCE_STATES state = D3D12_RESOURCE_STATE_COMMON;
+	unsigned long long commandList = 0; // Core::commandListsRun while it was recorded
+};
+
 class Barrier
 {
 public:
@@ -91,6 +113,107 @@ public:
 
 };
 
+// Linear allocator for per-draw constant data shared by every shader. Each frame in flight owns a list of
+// persistently mapped UPLOAD pages that grows on demand; beginFrame only rewinds a frame's pages after Core has
+// waited on that frame's fence, so the GPU is never reading what the CPU overwrites.
+class ConstantAllocator
+{
+public:
+	struct Page
+	{
+		ID3D12Resource* buffer;
+		unsigned char* data;
+		unsigned long long size;
+	};
+	static const unsigned long long PAGE_SIZE = 1024 * 1024;
+	ID3D12Device5* device = nullptr;
+	std::vector<Page> pages[2];
+	unsigned int page = 0;
+	unsigned long long pageOffset = 0;
+	unsigned int frame = 0;
+	unsigned long long frameBytes = 0;
+	unsigned long long lastFrameBytes = 0;
+	unsigned long long peakFrameBytes = 0;
+	unsigned int pagesAdded = 0; // Pages created by allocate, reported at exit with the peak
+	void init(ID3D12Device5* _device)
+	{
+		device = _device;
+	}
+	Page createPage(unsigned long long size)
+	{
+		Page p;
+		D3D12_HEAP_PROPERTIES heapProps = {};
+		heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+		D3D12_RESOURCE_DESC bufferDesc = {};
+		bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+		bufferDesc.Width = size;
+		bufferDesc.Height = 1;
+		bufferDesc.DepthOrArraySize = 1;
+		bufferDesc.MipLevels = 1;
+		bufferDesc.SampleDesc.Count = 1;
+		bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+		device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, IID_PPV_ARGS(&p.buffer));
+		D3D12_RANGE readRange = { 0, 0 };
+		p.buffer->Map(0, &readRange, (void**)&p.data);
+		p.size = size;
+		return p;
+	}
+	void beginFrame(unsigned int frameIndex)
+	{
+		lastFrameBytes = frameBytes;
+		if (frameBytes > peakFrameBytes)
+		{
+			peakFrameBytes = frameBytes;
+		}
+		frameBytes = 0;
+		frame = frameIndex;
+		page = 0;
+		pageOffset = 0;
+	}
+	// Returns the GPU address of size bytes copied from data, 256 byte aligned as CBVs require
+	D3D12_GPU_VIRTUAL_ADDRESS allocate(const void* data, unsigned int size)
+	{
+		ID3D12Resource* buffer;
+		unsigned long long offset;
+		return allocate(data, size, &buffer, &offset);
+	}
+	// Same, also returning the page and offset so the memory can be the source of a copy
+	D3D12_GPU_VIRTUAL_ADDRESS allocate(const void* data, unsigned int size, ID3D12Resource** buffer, unsigned long long* offset)
+	{
+		unsigned long long alignedSize = (size + 255) & ~255;
+		std::vector<Page>& framePages = pages[frame];
+		while (page < framePages.size() && pageOffset + alignedSize > framePages[page].size)
+		{
+			page++;
+			pageOffset = 0;
+		}
+		if (page == framePages.size())
+		{
+			framePages.push_back(createPage(alignedSize > PAGE_SIZE ? alignedSize : PAGE_SIZE));
+			pagesAdded++;
+		}
+		Page& p = framePages[page];
+		memcpy(p.data + pageOffset, data, size);
+		*buffer = p.buffer;
+		*offset = pageOffset;
+		D3D12_GPU_VIRTUAL_ADDRESS address = p.buffer->GetGPUVirtualAddress() + pageOffset;
+		pageOffset += alignedSize;
+		frameBytes += alignedSize;
+		return address;
+	}
+	void free()
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			for (Page& p : pages[i])
+			{
+				p.buffer->Unmap(0, NULL);
+				p.buffer->Release();
+			}
+			pages[i].clear();
+		}
+	}
+};
 
 class Core
 {
@@ -120,6 +243,24 @@ public:
 	int height;
 	HWND windowHandle;
 	DescriptorHeap srvHeap;
+	ConstantAllocator constantAllocator;
+	// Staging for uploadResource. Copies are recorded on the copy queue and go out together with submitUploads.
+	static const unsigned long long UPLOAD_RING_SIZE = 64ull * 1024 * 1024;
+	UploadRing uploadRing;
+	ID3D12Resource* uploadRingBuffer;
+	unsigned char* uploadRingData;
+	GPUFence copyFence;
+	ID3D12GraphicsCommandList4* copyCommandList;
+	std::vector<std::pair<long long, ID3D12CommandAllocator*>> copyCommandAllocators; // Fence value the allocator was last used with
+	bool copyCommandListOpen = false;
+	std::vector<std::pair<long long, ID3D12Resource*>> oversizedUploads; // Larger than the ring, released once their fence passes
+	std::vector<ID3D12Resource*> frameReleases[2]; // Released once the frame that let them go has finished on the GPU
+	unsigned long long commandListsRun = 0;
+	// Bytes copied by patchBuffer, per frame and since startup
+	unsigned long long frameUploadBytes = 0;
+	unsigned long long lastFrameUploadBytes = 0;
+	unsigned long long peakFrameUploadBytes = 0;
+	unsigned long long totalUploadBytes = 0;
 	void init(HWND hwnd, int _width, int _height)
 	{
 		// Find Adapter
@@ -226,6 +367,16 @@ public:
 		graphicsQueueFence[0].create(device);
 		graphicsQueueFence[1].create(device);
 
+		copyFence.create(device);
+		ID3D12CommandAllocator* copyCommandAllocator;
+		device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&copyCommandAllocator));
+		copyCommandAllocators.emplace_back(0, copyCommandAllocator);
+		device->CreateCommandList1(0, D3D12_COMMAND_LIST_TYPE_COPY, D3D12_COMMAND_LIST_FLAG_NONE, IID_PPV_ARGS(&copyCommandList));
+		uploadRingBuffer = createUploadBuffer(UPLOAD_RING_SIZE);
+		uploadRingBuffer->Map(0, nullptr, (void**)&uploadRingData);
+		uploadRing.init(UPLOAD_RING_SIZE);
+		constantAllocator.init(device);
+
 		srvHeap.init(device, 16384);
 		createRootSignature();
 
@@ -336,6 +487,13 @@ public:
 		rootParameterTex.DescriptorTable.pDescriptorRanges = &srvRange;
 		rootParameterTex.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
 		parameters.push_back(rootParameterTex);
+		// Structured buffer read by the vertex shader, such as the bone palettes of instanced skinned meshes
+		D3D12_ROOT_PARAMETER rootParameterSRVVS;
+		rootParameterSRVVS.ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+		rootParameterSRVVS.Descriptor.ShaderRegister = 0;
+		rootParameterSRVVS.Descriptor.RegisterSpace = 0;
+		rootParameterSRVVS.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+		parameters.push_back(rootParameterSRVVS);
 
 		D3D12_STATIC_SAMPLER_DESC staticSampler = {};
 		staticSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
@@ -376,13 +534,14 @@ public:
 	}
 	void runCommandList()
 	{
+		submitUploads();
 		getCommandList()->Close();
 		ID3D12CommandList* lists[] = { getCommandList() };
 		graphicsQueue->ExecuteCommandLists(1, lists);
+		commandListsRun++;
 	}
-	void uploadResource(ID3D12Resource* dstResource, const void* data, unsigned int size, D3D12_RESOURCE_STATES targetState, D3D12_PLACED_SUBRESOURCE_FOOTPRINT *texFootprint = NULL)
+	ID3D12Resource* createUploadBuffer(unsigned long long size)
 	{
-		unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
 		ID3D12Resource* uploadBuffer;
 		D3D12_HEAP_PROPERTIES heapProps = {};
 		heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
@@ -395,40 +554,142 @@ public:
 		bufferDesc.SampleDesc.Count = 1;
 		bufferDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 		device->CreateCommittedResource(&heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, IID_PPV_ARGS(&uploadBuffer));
+		return uploadBuffer;
+	}
+	// Returns ring space and allocators whose copies have finished
+	void retireUploads()
+	{
+		long long completed = copyFence.completed();
+		uploadRing.release(completed);
+		for (int i = 0; i < oversizedUploads.size(); i++)
+		{
+			if (oversizedUploads[i].first <= completed)
+			{
+				oversizedUploads[i].second->Release();
+				oversizedUploads[i] = oversizedUploads.back();
+				oversizedUploads.pop_back();
+				i--;
+			}
+		}
+	}
+	void openCopyCommandList()
+	{
+		if (copyCommandListOpen)
+		{
+			return;
+		}
+		long long completed = copyFence.completed();
+		ID3D12CommandAllocator* allocator = nullptr;
+		for (auto& entry : copyCommandAllocators)
+		{
+			if (entry.first <= completed)
+			{
+				entry.first = copyFence.value + 1;
+				allocator = entry.second;
+				break;
+			}
+		}
+		if (allocator == nullptr)
+		{
+			device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&allocator));
+			copyCommandAllocators.emplace_back(copyFence.value + 1, allocator);
+		}
+		allocator->Reset();
+		copyCommandList->Reset(allocator, NULL);
+		copyCommandListOpen = true;
+	}
+	// Copies data into the ring and records the copy on the copy queue. Nothing is submitted until submitUploads,
+	// which runCommandList calls before any graphics work. dstResource must be in the COMMON state; it is promoted
+	// to the state it is read in by its first use on the graphics queue.
+	void uploadResource(ID3D12Resource* dstResource, const void* data, unsigned int size, D3D12_PLACED_SUBRESOURCE_FOOTPRINT *texFootprint = NULL)
+	{
+		retireUploads();
+		ID3D12Resource* srcResource = uploadRingBuffer;
+		unsigned long long offset = 0;
+		if (size > UPLOAD_RING_SIZE)
+		{
+			srcResource = createUploadBuffer(size);
+			void* mappeddata = nullptr;
+			srcResource->Map(0, nullptr, &mappeddata);
+			memcpy(mappeddata, data, size);
+			srcResource->Unmap(0, nullptr);
+			oversizedUploads.push_back({ copyFence.value + 1, srcResource });
+		} else
+		{
+			while (!uploadRing.allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset))
+			{
+				// Ring is full, only now does the CPU wait for the oldest copies
+				if (copyCommandListOpen)
+				{
+					submitUploads();
+				}
+				copyFence.waitFor(uploadRing.oldestFence());
+				retireUploads();
+			}
+			memcpy(uploadRingData + offset, data, size);
+		}
 
-		void* mappeddata = nullptr;
-		uploadBuffer->Map(0, nullptr, &mappeddata);
-		memcpy(mappeddata, data, size);
-		uploadBuffer->Unmap(0, nullptr);
-
-		resetCommandList();
-
+		openCopyCommandList();
 		if (texFootprint != NULL)
 		{
 			D3D12_TEXTURE_COPY_LOCATION src = {};
-			src.pResource = uploadBuffer;
+			src.pResource = srcResource;
 			src.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
 			src.PlacedFootprint = *texFootprint;
+			src.PlacedFootprint.Offset = offset;
 			D3D12_TEXTURE_COPY_LOCATION dst = {};
 			dst.pResource = dstResource;
 			dst.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
 			dst.SubresourceIndex = 0;
-			getCommandList()->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+			copyCommandList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
 		} else
 		{
-			getCommandList()->CopyBufferRegion(dstResource, 0, uploadBuffer, 0, size);
+			copyCommandList->CopyBufferRegion(dstResource, 0, srcResource, offset, size);
 		}
-
-
-		Barrier::add(dstResource, D3D12_RESOURCE_STATE_COPY_DEST, targetState, getCommandList());
-
-		getCommandList()->Close();
-		ID3D12CommandList* lists[] = { getCommandList() };
-		graphicsQueue->ExecuteCommandLists(1, lists);
-
-		flushGraphicsQueue();
-
-		uploadBuffer->Release();
+	}
+	// Copies data into part of a DEFAULT heap buffer on the graphics command list, so it is ordered with the draws
+	// of this and earlier frames. Staging comes from the per-frame constant allocator. dstState is the state the
+	// buffer was left in by an earlier patch, so it can be patched again after a draw in the same command list; the
+	// buffer ends up in readState.
+	void patchBuffer(ID3D12Resource* dstResource, BufferState& dstState, unsigned long long dstOffset, const void* data, unsigned int size, D3D12_RESOURCE_STATES readState)
+	{
+		ID3D12Resource* srcResource;
+		unsigned long long srcOffset;
+		constantAllocator.allocate(data, size, &srcResource, &srcOffset);
+		ID3D12GraphicsCommandList4* commandList = getCommandList();
+		D3D12_RESOURCE_STATES before = dstState.commandList == commandListsRun ? dstState.state : D3D12_RESOURCE_STATE_COMMON;
+		if (before != D3D12_RESOURCE_STATE_COPY_DEST)
+		{
+			Barrier::add(dstResource, before, D3D12_RESOURCE_STATE_COPY_DEST, commandList);
+		}
+		commandList->CopyBufferRegion(dstResource, dstOffset, srcResource, srcOffset, size);
+		Barrier::add(dstResource, D3D12_RESOURCE_STATE_COPY_DEST, readState, commandList);
+		dstState.state = readState;
+		dstState.commandList = commandListsRun;
+		frameUploadBytes += size;
+		totalUploadBytes += size;
+	}
+	// Releases resource once the frame being recorded has finished on the GPU, as the constant allocator reuses
+	// its pages, so a buffer replaced mid-frame needs no wait
+	void releaseAfterFrame(ID3D12Resource* resource)
+	{
+		frameReleases[frameIndex()].push_back(resource);
+	}
+	// Submits every copy recorded since the last call as one copy queue submission. The graphics queue waits on
+	// the GPU for it, the CPU does not.
+	void submitUploads()
+	{
+		if (!copyCommandListOpen)
+		{
+			return;
+		}
+		copyCommandList->Close();
+		ID3D12CommandList* lists[] = { copyCommandList };
+		copyQueue->ExecuteCommandLists(1, lists);
+		copyFence.signal(copyQueue);
+		uploadRing.retire(copyFence.value);
+		graphicsQueue->Wait(copyFence.fence, copyFence.value);
+		copyCommandListOpen = false;
 	}
 	ID3D12GraphicsCommandList4* getCommandList()
 	{
@@ -439,6 +700,18 @@ public:
 	{
 		unsigned int frameIndex = swapchain->GetCurrentBackBufferIndex();
 		graphicsQueueFence[frameIndex].wait();
+		for (ID3D12Resource* resource : frameReleases[frameIndex])
+		{
+			resource->Release();
+		}
+		frameReleases[frameIndex].clear();
+		constantAllocator.beginFrame(frameIndex);
+		lastFrameUploadBytes = frameUploadBytes;
+		if (frameUploadBytes > peakFrameUploadBytes)
+		{
+			peakFrameUploadBytes = frameUploadBytes;
+		}
+		frameUploadBytes = 0;
 		D3D12_CPU_DESCRIPTOR_HANDLE renderTargetViewHandle = backbufferHeap->GetCPUDescriptorHandleForHeapStart();
 		unsigned int renderTargetViewDescriptorSize = device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 		renderTargetViewHandle.ptr += frameIndex * renderTargetViewDescriptorSize;
@@ -492,6 +765,24 @@ void beginRenderPass()
 			graphicsQueueFence[i].signal(graphicsQueue);
 			graphicsQueueFence[i].wait();
 		}
+		submitUploads();
+		copyFence.wait();
+		retireUploads();
+		for (int i = 0; i < 2; i++)
+		{
+			for (ID3D12Resource* resource : frameReleases[i])
+			{
+				resource->Release();
+			}
+		}
+		for (auto& entry : copyCommandAllocators)
+		{
+			entry.second->Release();
+		}
+		copyCommandList->Release();
+		uploadRingBuffer->Unmap(0, nullptr);
+		uploadRingBuffer->Release();
+		constantAllocator.free();
 		srvHeap.heap->Release();  
 		rootSignature->Release();
 		graphicsCommandList[0]->Release();
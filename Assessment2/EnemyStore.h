@@ -0,0 +1,317 @@
+#pragma once
+#include "Animation.h"
+#include "Collision.h"
+#include "Controller.h"
+#include "Frustum.h"
+#include "JobSystem.h"
+#include "SpatialHash.h"
+#include <algorithm>
+#include <string>
+#include <vector>
+
+// Kinds of enemy, in the order their records are saved
+enum class Species { GOAT, PIG, BULL, DUCK };
+const int SPECIES_COUNT = 4;
+
+// What every enemy of one species shares
+struct SpeciesInfo {
+  std::string modelName;
+  AnimalData stats;      // Health and attack an enemy spawns with
+  bool isDuck = false;   // Ducks use the "bird " animations
+  float healthBarHeight = 1.0f;
+  Animation *animation = nullptr; // The model's, so the store needs no GPU side
+  PoseCache *poseCache = nullptr;
+  Vec3 extent;           // Half size of the collision bounds, as getAnimatedModelAABB gives them
+  float footprint = 0.0f; // Larger half size on the x / z plane, the room it keeps from other enemies
+};
+
+// What every enemy reads while it updates, the same for all of them in a frame
+struct EnemyFrame {
+  float dt = 0.0f;
+  Vec3 playerPos; // Eye position, as EnemyController::update takes it
+  const ColliderGrid *colliders = nullptr;
+  const HeightField *ground = nullptr;
+  const FlowField *flow = nullptr;
+  const AnimationLODTiers *lod = nullptr;
+  const Frustum *view = nullptr; // Null counts every enemy as in view
+  const AILODTiers *ai = nullptr; // Null makes every enemy decide every frame
+  const SpatialHash *crowd = nullptr; // Positions indexed like live, to keep chasing enemies apart; null turns it off
+};
+
+// Every enemy in one structure of arrays, indexed by slot. Each species owns a fixed run of slots, handed out in
+// spawn order and only given back by clear(), so a slot's animation instance is set up for its model once. The
+// slots of the enemies still in play are kept packed in live, so each per-frame pass is one loop over those alone.
+class EnemyStore {
+public:
+  SpeciesInfo speciesInfo[SPECIES_COUNT];
+
+  std::vector<Species> species;
+  std::vector<Vec3> position;                 // Copied from the controller after each update
+  std::vector<float> yaw;
+  std::vector<AnimalData> data;               // Health and attack, used by the slot's controller
+  std::vector<AnimationInstance> animation;
+  std::vector<EnemyController> controller;    // AI state
+  std::vector<int> sinceDecision;             // Frames since the controller last decided where to steer
+  std::vector<int> live;                      // Slots spawned and not yet removed, in spawn order
+  SpatialHash crowd;                          // Positions of live as of the last buildCrowd, indexed like live
+
+  // Written by update for live[i]
+  std::vector<int> damage;                    // Dealt to the player
+  std::vector<int> bonesEvaluated;
+  std::vector<char> decide;                   // Whether it made a steering decision
+  AIStats aiStats;                            // Of the last update
+
+  // animations and poseCaches are indexed by Species. Call after the animations are loaded (and baked), as the
+  // instances share the pose caches.
+  void init(Animation *const (&animations)[SPECIES_COUNT], PoseCache *const (&poseCaches)[SPECIES_COUNT], int slotsPerSpecies) {
+    static const char *names[SPECIES_COUNT] = {"Goat-01", "Pig", "Bull-dark", "Duck-mixed"};
+    static const AnimalData stats[SPECIES_COUNT] = {AnimalData(70, 10, 3.0f, 8.0f), AnimalData(130, 10, 4.0f, 6.0f),
+                                                    AnimalData(100, 20, 3.5f, 7.5f), AnimalData(40, 5, 2.0f, 10.0f)};
+    static const float healthBarHeights[SPECIES_COUNT] = {1.5f, 1.0f, 2.0f, 1.0f};
+    perSpecies = slotsPerSpecies;
+    int capacity = perSpecies * SPECIES_COUNT;
+    species.resize(capacity);
+    position.assign(capacity, Vec3(0, 0, 0));
+    yaw.assign(capacity, 0.0f);
+    data.assign(capacity, AnimalData());
+    animation.resize(capacity);
+    controller.resize(capacity);
+    sinceDecision.assign(capacity, 0);
+    live.clear();
+    live.reserve(capacity);
+    widestFootprint = 0.0f;
+    for (int s = 0; s < SPECIES_COUNT; s++) {
+      SpeciesInfo &info = speciesInfo[s];
+      info.modelName = names[s];
+      info.stats = stats[s];
+      info.isDuck = (Species)s == Species::DUCK;
+      info.healthBarHeight = healthBarHeights[s];
+      info.animation = animations[s];
+      info.poseCache = poseCaches[s];
+      AABB bounds = getAnimatedModelAABB(info.modelName, Vec3(0, 0, 0));
+      info.extent = (bounds.max - bounds.min) * 0.5f;
+      info.footprint = std::max(info.extent.x, info.extent.z);
+      widestFootprint = std::max(widestFootprint, info.footprint);
+      spawned[s] = 0;
+      for (int i = 0; i < perSpecies; i++) {
+        int slot = slotOf((Species)s, i);
+        species[slot] = (Species)s;
+        animation[slot].init(info.animation, 0);
+        animation[slot].usePoseCache(info.poseCache);
+      }
+    }
+  }
+
+  // Takes the next slot of the species for an enemy at pos with full health, without putting it in play. Returns
+  // -1 once the species has used all its slots.
+  int add(Species s, const Vec3 &pos) {
+    if (spawned[(int)s] >= perSpecies) {
+      return -1;
+    }
+    int slot = slotOf(s, spawned[(int)s]++);
+    position[slot] = pos;
+    yaw[slot] = 0.0f;
+    data[slot] = speciesInfo[(int)s].stats;
+    controller[slot].shouldRemove = false;
+    return slot;
+  }
+
+  // Starts the AI of an added slot and puts it in play
+  void activate(int slot, const Vec3 &entryTarget) {
+    controller[slot].init(&animation[slot], &data[slot], position[slot], speciesInfo[(int)species[slot]].isDuck,
+                          entryTarget);
+    sinceDecision[slot] = 0;
+    live.push_back(slot);
+  }
+
+  int spawn(Species s, const Vec3 &pos, const Vec3 &entryTarget) {
+    int slot = add(s, pos);
+    if (slot >= 0) {
+      activate(slot, entryTarget);
+    }
+    return slot;
+  }
+
+  // Drops the enemies whose controllers have finished (died and played out their death) from live, keeping the
+  // rest in order. Only EnemyController::update finishes an enemy, so once after the update pass is enough.
+  void removeFinished() {
+    live.erase(std::remove_if(live.begin(), live.end(), [this](int slot) { return controller[slot].shouldRemove; }),
+               live.end());
+  }
+
+  // Picks the animation LOD and steps the AI and animation of every live enemy, grain enemies to a job, once after
+  // is done. Each job only writes its own enemies' slots and entries of damage and bonesEvaluated; the pose caches
+  // they share lock themselves, and separation reads the positions copied into frame.crowd rather than the ones
+  // being written. Wait on counter before reading the results or calling removeFinished.
+  void update(JobSystem &jobs, JobCounter &counter, const EnemyFrame &frame, int grain, JobCounter *after = nullptr) {
+    damage.assign(live.size(), 0);
+    bonesEvaluated.assign(live.size(), 0);
+    scheduleDecisions(frame);
+    jobs.parallelFor(counter, (int)live.size(), grain, [this, &frame](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        int slot = live[i];
+        EnemyController &ai = controller[slot];
+        const SpeciesInfo &kind = speciesInfo[(int)species[slot]];
+        if (frame.lod != nullptr) {
+          ai.updateAnimationLOD(*frame.lod, frame.playerPos, frame.view == nullptr || inView(slot, *frame.view));
+        }
+        // The push away from the crowd is part of the steering decision, so enemies coasting keep their last one
+        if (decide[i]) {
+          Vec3 push(0, 0, 0);
+          if (frame.crowd != nullptr && frame.crowd->size() == (int)live.size() && ai.getState() == EnemyState::CHASE) {
+            push = separation(i, *frame.crowd);
+          }
+          ai.setSeparation(push);
+        }
+        ai.update(frame.dt, frame.playerPos, damage[i], frame.colliders, kind.modelName, frame.ground, frame.flow,
+                  decide[i] != 0);
+        bonesEvaluated[i] = animation[slot].bonesEvaluated;
+        position[slot] = ai.position;
+        yaw[slot] = ai.yaw;
+      }
+    }, after);
+  }
+
+  // The bounds of every live enemy into colliders, in live order, grain enemies to a job
+  void buildColliders(JobSystem &jobs, JobCounter &counter, std::vector<AABB> &colliders, int grain) {
+    colliders.resize(live.size());
+    jobs.parallelFor(counter, (int)live.size(), grain, [this, &colliders](int begin, int end) {
+      for (int i = begin; i < end; i++) {
+        colliders[i] = bounds(live[i]);
+      }
+    });
+  }
+
+  // Rebuilds crowd from the positions of live. Call again whenever live changes before querying it, as its indices
+  // are positions in live.
+  void buildCrowd() {
+    crowdPositions.resize(live.size());
+    for (int i = 0; i < (int)live.size(); i++) {
+      crowdPositions[i] = position[live[i]];
+    }
+    crowd.build(crowdPositions);
+  }
+
+  // Furthest an enemy's bounds reach from its position on the x / z plane, to widen crowd queries for box tests
+  float reach() const {
+    float longest = 0.0f;
+    for (const SpeciesInfo &info : speciesInfo) {
+      longest = std::max(longest, Vec3(info.extent.x, 0, info.extent.z).length());
+    }
+    return longest;
+  }
+
+  void clear() {
+    live.clear();
+    for (int s = 0; s < SPECIES_COUNT; s++) {
+      spawned[s] = 0;
+    }
+  }
+
+  const SpeciesInfo &info(int slot) const { return speciesInfo[(int)species[slot]]; }
+
+  // Same box as getAnimatedModelAABB for the slot's model, without looking the model up by name
+  AABB bounds(int slot) const {
+    const Vec3 &extent = speciesInfo[(int)species[slot]].extent;
+    return AABB::fromCenterExtent(position[slot] + Vec3(0, extent.y, 0), extent);
+  }
+
+  // Slots taken by a species since the last clear, which are slotOf(s, 0 .. spawnedCount(s) - 1)
+  int spawnedCount(Species s) const { return spawned[(int)s]; }
+  int slotOf(Species s, int i) const { return (int)s * perSpecies + i; }
+
+private:
+  static constexpr float SEPARATION_SPEED = 3.0f; // Push at full overlap, in units per second
+  // Overlapping enemies that add to the push. Enemies attacking the player stand still and can pile up without
+  // limit, so the search stops here rather than growing with the pile.
+  static const int SEPARATION_NEIGHBOURS = 8;
+
+  int perSpecies = 0;
+  float widestFootprint = 0.0f;
+  std::vector<Vec3> crowdPositions;
+
+  struct Candidate {
+    int overdue; // Frames past the enemy's decision interval
+    float distance;
+    int index;   // Into live
+  };
+  std::vector<Candidate> candidates;
+
+  // Fills decide for this frame. Enemies not walking or chasing always run in full, and those in the nearest band
+  // decide whenever they are due. Other due enemies take the frame's budget, longest overdue then nearest first;
+  // the rest wait and are further overdue next frame.
+  void scheduleDecisions(const EnemyFrame &frame) {
+    decide.assign(live.size(), 1);
+    aiStats = AIStats();
+    aiStats.updates = (long long)live.size();
+    if (frame.ai != nullptr) {
+      candidates.clear();
+      int nearest = frame.ai->tiers.empty() ? 1 : frame.ai->tiers[0].decisionInterval;
+      for (int i = 0; i < (int)live.size(); i++) {
+        int slot = live[i];
+        if (!controller[slot].isSteering()) {
+          continue;
+        }
+        Vec3 toPlayer = frame.playerPos - position[slot];
+        toPlayer.y = 0;
+        float distance = toPlayer.length();
+        int interval = frame.ai->select(distance);
+        int overdue = sinceDecision[slot] + 1 - interval;
+        if (overdue < 0) {
+          decide[i] = 0;
+        } else if (interval > nearest) {
+          decide[i] = 0;
+          candidates.push_back({overdue, distance, i});
+        }
+      }
+      int granted = std::min((int)candidates.size(), std::max(frame.ai->budget, 0));
+      std::partial_sort(candidates.begin(), candidates.begin() + granted, candidates.end(), [](const Candidate &a, const Candidate &b) {
+        return a.overdue != b.overdue ? a.overdue > b.overdue : a.distance < b.distance;
+      });
+      for (int c = 0; c < granted; c++) {
+        decide[candidates[c].index] = 1;
+      }
+      aiStats.deferred = (long long)candidates.size() - granted;
+    }
+    for (int i = 0; i < (int)live.size(); i++) {
+      sinceDecision[live[i]] = decide[i] ? 0 : sinceDecision[live[i]] + 1;
+      aiStats.decisions += decide[i];
+    }
+  }
+
+  // Push on live[i] away from the first SEPARATION_NEIGHBOURS enemies found whose footprints overlap its own, each
+  // weighted by how deep the overlap is, up to SEPARATION_SPEED. Two enemies on the same spot part along x, the
+  // earlier one in live to -x.
+  Vec3 separation(int i, const SpatialHash &hash) const {
+    const Vec3 &self = hash.position(i);
+    float footprint = speciesInfo[(int)species[live[i]]].footprint;
+    Vec3 push(0, 0, 0);
+    int overlaps = 0;
+    hash.visitRadius(self, footprint + widestFootprint, [&](int j) {
+      if (j == i) {
+        return true;
+      }
+      Vec3 away = self - hash.position(j);
+      away.y = 0;
+      float gap = footprint + speciesInfo[(int)species[live[j]]].footprint;
+      float distance = away.length();
+      if (distance >= gap) {
+        return true;
+      }
+      away = distance > 0.001f ? away / distance : Vec3(i < j ? -1.0f : 1.0f, 0, 0);
+      push = push + away * (1.0f - distance / gap);
+      return ++overlaps < SEPARATION_NEIGHBOURS;
+    });
+    push = push * SEPARATION_SPEED;
+    float speed = push.length();
+    return speed > SEPARATION_SPEED ? push * (SEPARATION_SPEED / speed) : push;
+  }
+
+  // Tested against the collision bounds
+  bool inView(int slot, const Frustum &view) const {
+    AABB box = bounds(slot);
+    Vec3 center = (box.min + box.max) * 0.5f;
+    return view.sphereVisible(center.x, center.y, center.z, (box.max - center).length());
+  }
+  int spawned[SPECIES_COUNT] = {0, 0, 0, 0};
+};
@@ -0,0 +1,255 @@
+#pragma once
+#include "Collision.h"
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstdlib>
+#include <queue>
+#include <vector>
+
+// Directions toward a target over a grid on the x / z plane, shared by every chasing enemy. Cells under colliders
+// taller than a step, grown by the enemies' clearance, are blocked. The distances come from a Dijkstra search out
+// from the target's cell, which only starts again when the target moves to another cell and can be spread over
+// several frames; enemies keep following the last finished field until the new one is ready.
+class FlowField {
+public:
+  void build(const std::vector<AABB> &colliders, float size = 1.0f, float clearance = 0.75f, float stepHeight = 0.5f) {
+    cellSize = size;
+    invCellSize = 1.0f / cellSize;
+    targetCell = pendingCell = -1;
+    searching = false;
+    rebuilds = 0;
+    if (colliders.empty()) {
+      columns = rows = 0;
+      blocked.clear();
+      return;
+    }
+    originX = originZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+    for (const auto &box : colliders) {
+      originX = std::min(originX, box.min.x);
+      originZ = std::min(originZ, box.min.z);
+      maxX = std::max(maxX, box.max.x);
+      maxZ = std::max(maxZ, box.max.z);
+    }
+    columns = cellX(maxX) + 1;
+    rows = cellZ(maxZ) + 1;
+    blocked.assign(columns * rows, 0);
+    for (const auto &box : colliders) {
+      if (box.max.y <= stepHeight) {
+        continue;
+      }
+      // Cells whose centre is within clearance of the footprint
+      int x0 = std::max((int)ceilf((box.min.x - clearance - originX) * invCellSize - 0.5f), 0);
+      int z0 = std::max((int)ceilf((box.min.z - clearance - originZ) * invCellSize - 0.5f), 0);
+      int x1 = std::min((int)floorf((box.max.x + clearance - originX) * invCellSize - 0.5f), columns - 1);
+      int z1 = std::min((int)floorf((box.max.z + clearance - originZ) * invCellSize - 0.5f), rows - 1);
+      for (int z = z0; z <= z1; z++) {
+        for (int x = x0; x <= x1; x++) {
+          blocked[z * columns + x] = 1;
+        }
+      }
+    }
+    distance.assign(columns * rows, FLT_MAX);
+    nextCell.assign(columns * rows, -1);
+  }
+
+  // Restarts the search if target has moved to another cell, then settles up to budget cells of it. Returns true
+  // when a search finishes and its directions replace the ones being followed.
+  bool update(const Vec3 &target, int budget = INT_MAX) {
+    if (blocked.empty()) {
+      return false;
+    }
+    int cell = clampedCell(target);
+    if (cell != (searching ? pendingCell : targetCell)) {
+      pendingCell = cell;
+      searching = true;
+      building.assign(columns * rows, FLT_MAX);
+      open = std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>>();
+      seed(cell);
+    }
+    if (!searching) {
+      return false;
+    }
+    for (int settled = 0; settled < budget && !open.empty(); settled++) {
+      Entry entry = open.top();
+      open.pop();
+      if (entry.first > building[entry.second]) {
+        continue;
+      }
+      int x = entry.second % columns;
+      int z = entry.second / columns;
+      for (int n = 0; n < 8; n++) {
+        int next;
+        if (!step(x, z, n, next)) {
+          continue;
+        }
+        float d = entry.first + STEP_COST[n];
+        if (d < building[next]) {
+          building[next] = d;
+          open.push(Entry(d, next));
+        }
+      }
+    }
+    if (!open.empty()) {
+      return false;
+    }
+    distance.swap(building);
+    targetCell = pendingCell;
+    searching = false;
+    rebuilds++;
+    computeNextCells();
+    return true;
+  }
+
+  // Direction to walk from p, or false when p is next to the target's cell or its blocked patch (steer straight at
+  // the target instead) or no path leads out of its cell. An entity pushed into a blocked cell heads for the best
+  // open neighbour.
+  bool direction(const Vec3 &p, Vec3 &dir) const {
+    if (targetCell < 0) {
+      return false;
+    }
+    int x = cellX(p.x);
+    int z = cellZ(p.z);
+    if (x < 0 || z < 0 || x >= columns || z >= rows) {
+      return false;
+    }
+    int tx = targetCell % columns;
+    int tz = targetCell / columns;
+    if (std::abs(x - tx) <= 1 && std::abs(z - tz) <= 1) {
+      return false;
+    }
+    // Heading for the centre of the next cell rather than along a fixed direction per cell keeps entities near the
+    // middle of the cells, clear of the obstacle edges
+    int cell = z * columns + x;
+    int best = -1;
+    if (!blocked[cell] && distance[cell] < FLT_MAX) {
+      best = nextCell[cell];
+    } else {
+      for (int n = 0; n < 8; n++) {
+        int nx = x + OFFSET_X[n];
+        int nz = z + OFFSET_Z[n];
+        if (nx >= 0 && nz >= 0 && nx < columns && nz < rows && !blocked[nz * columns + nx] &&
+            distance[nz * columns + nx] < FLT_MAX && (best < 0 || distance[nz * columns + nx] < distance[best])) {
+          best = nz * columns + nx;
+        }
+      }
+    }
+    if (best < 0) {
+      return false;
+    }
+    dir = Vec3(originX + (best % columns + 0.5f) * cellSize - p.x, 0.0f, originZ + (best / columns + 0.5f) * cellSize - p.z);
+    if (dir.length() < 0.001f) {
+      return false;
+    }
+    dir = dir.normalize();
+    return true;
+  }
+
+  bool isBlocked(const Vec3 &p) const {
+    int x = cellX(p.x);
+    int z = cellZ(p.z);
+    return x >= 0 && z >= 0 && x < columns && z < rows && blocked[z * columns + x];
+  }
+
+  int cellCount() const { return columns * rows; }
+  int rebuilds = 0; // Searches finished since build
+
+private:
+  typedef std::pair<float, int> Entry; // Distance, cell
+  // Eight neighbours, the four straight ones first
+  static constexpr int OFFSET_X[8] = {1, -1, 0, 0, 1, 1, -1, -1};
+  static constexpr int OFFSET_Z[8] = {0, 0, 1, -1, 1, -1, 1, -1};
+  static constexpr int PATCH_RADIUS = 8;
+  static constexpr float STEP_COST[8] = {1.0f, 1.0f, 1.0f, 1.0f, 1.41421356f, 1.41421356f, 1.41421356f, 1.41421356f};
+
+  float cellSize = 1.0f;
+  float invCellSize = 1.0f;
+  float originX = 0.0f, originZ = 0.0f;
+  int columns = 0, rows = 0;
+  std::vector<unsigned char> blocked;
+  std::vector<float> distance;   // From the finished search
+  std::vector<int> nextCell;     // Open neighbour closest to the target, -1 for none
+  int targetCell = -1;
+
+  // The search in progress
+  std::vector<float> building;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> open;
+  int pendingCell = -1;
+  bool searching = false;
+
+  int cellX(float x) const { return (int)floorf((x - originX) * invCellSize); }
+  int cellZ(float z) const { return (int)floorf((z - originZ) * invCellSize); }
+
+  int clampedCell(const Vec3 &p) const {
+    int x = std::min(std::max(cellX(p.x), 0), columns - 1);
+    int z = std::min(std::max(cellZ(p.z), 0), rows - 1);
+    return z * columns + x;
+  }
+
+  // Neighbour n of cell (x, z) if it is inside the grid and open. Diagonal steps may not cut a blocked corner.
+  bool step(int x, int z, int n, int &next) const {
+    int nx = x + OFFSET_X[n];
+    int nz = z + OFFSET_Z[n];
+    if (nx < 0 || nz < 0 || nx >= columns || nz >= rows || blocked[nz * columns + nx]) {
+      return false;
+    }
+    if (n >= 4 && (blocked[z * columns + nx] || blocked[nz * columns + x])) {
+      return false;
+    }
+    next = nz * columns + nx;
+    return true;
+  }
+
+  // Starts the search from the target's cell. A target standing on or against an obstacle is in a blocked patch,
+  // so the search starts from the open cells bordering the patch within PATCH_RADIUS cells instead, at their
+  // distance from the target.
+  void seed(int cell) {
+    int tx = cell % columns;
+    int tz = cell / columns;
+    if (!blocked[cell]) {
+      building[cell] = 0.0f;
+      open.push(Entry(0.0f, cell));
+      return;
+    }
+    std::vector<int> patch(1, cell);
+    std::vector<unsigned char> visited(columns * rows, 0);
+    visited[cell] = 1;
+    for (size_t i = 0; i < patch.size(); i++) {
+      int x = patch[i] % columns;
+      int z = patch[i] / columns;
+      for (int n = 0; n < 8; n++) {
+        int nx = x + OFFSET_X[n];
+        int nz = z + OFFSET_Z[n];
+        if (nx < 0 || nz < 0 || nx >= columns || nz >= rows || std::abs(nx - tx) > PATCH_RADIUS || std::abs(nz - tz) > PATCH_RADIUS ||
+            visited[nz * columns + nx]) {
+          continue;
+        }
+        int next = nz * columns + nx;
+        visited[next] = 1;
+        if (blocked[next]) {
+          patch.push_back(next);
+        } else {
+          building[next] = sqrtf((float)((nx - tx) * (nx - tx) + (nz - tz) * (nz - tz)));
+          open.push(Entry(building[next], next));
+        }
+      }
+    }
+  }
+
+  void computeNextCells() {
+    for (int z = 0; z < rows; z++) {
+      for (int x = 0; x < columns; x++) {
+        int cell = z * columns + x;
+        int best = -1;
+        for (int n = 0; n < 8; n++) {
+          int next;
+          if (step(x, z, n, next) && distance[next] < distance[cell] && (best < 0 || distance[next] < distance[best])) {
+            best = next;
+          }
+        }
+        nextCell[cell] = best;
+      }
+    }
+  }
+};
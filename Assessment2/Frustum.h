@@ -0,0 +1,136 @@
+#pragma once
+#include "Maths.h"
+#include <cfloat>
+#include <vector>
+#include <xmmintrin.h>
+
+// View frustum as six planes (a, b, c, d) with normals facing inwards, so a point is inside when
+// a * x + b * y + c * z + d >= 0 for every plane
+struct Frustum {
+  float planes[6][4];
+  __m128 splatPlanes[6][4]; // Each plane coefficient broadcast to four lanes for InstanceBounds::cull
+
+  // Planes taken from the rows of the view projection matrix. Clip space is vp * p with 0 <= z <= w as in D3D.
+  static Frustum fromViewProjection(const Matrix &vp) {
+    Frustum f;
+    for (int i = 0; i < 4; i++) {
+      f.planes[0][i] = vp.a[3][i] + vp.a[0][i]; // left
+      f.planes[1][i] = vp.a[3][i] - vp.a[0][i]; // right
+      f.planes[2][i] = vp.a[3][i] + vp.a[1][i]; // bottom
+      f.planes[3][i] = vp.a[3][i] - vp.a[1][i]; // top
+      f.planes[4][i] = vp.a[2][i];              // near
+      f.planes[5][i] = vp.a[3][i] - vp.a[2][i]; // far
+    }
+    for (int p = 0; p < 6; p++) {
+      float length = sqrtf(SQ(f.planes[p][0]) + SQ(f.planes[p][1]) + SQ(f.planes[p][2]));
+      for (int i = 0; i < 4; i++) {
+        f.planes[p][i] /= length;
+        f.splatPlanes[p][i] = _mm_set1_ps(f.planes[p][i]);
+      }
+    }
+    return f;
+  }
+
+  bool sphereVisible(float x, float y, float z, float radius) const {
+    for (int p = 0; p < 6; p++) {
+      if (planes[p][0] * x + planes[p][1] * y + planes[p][2] * z + planes[p][3] < -radius) {
+        return false;
+      }
+    }
+    return true;
+  }
+};
+
+// Per-frame culling counters
+struct CullStats {
+  long long tested = 0;
+  long long visible = 0;
+
+  void add(const CullStats &other) {
+    tested += other.tested;
+    visible += other.visible;
+  }
+};
+
+// World space bounding spheres stored as separate x / y / z / radius arrays so four can be tested against a
+// plane at once. The arrays are padded to a multiple of four with spheres that can never be visible.
+class InstanceBounds {
+public:
+  std::vector<float> x, y, z, radius;
+  int count = 0;
+
+  void clear() {
+    x.clear();
+    y.clear();
+    z.clear();
+    radius.clear();
+    count = 0;
+  }
+
+  void add(const Vec3 &center, float r) {
+    if (count == x.size()) {
+      for (int i = 0; i < 4; i++) {
+        x.push_back(0.0f);
+        y.push_back(0.0f);
+        z.push_back(0.0f);
+        radius.push_back(-FLT_MAX);
+      }
+    }
+    x[count] = center.x;
+    y[count] = center.y;
+    z[count] = center.z;
+    radius[count] = r;
+    count++;
+  }
+
+  void set(int index, const Vec3 &center, float r) {
+    x[index] = center.x;
+    y[index] = center.y;
+    z[index] = center.z;
+    radius[index] = r;
+  }
+
+  // Appends the index of every sphere touching the frustum to visible, in instance order
+  CullStats cull(const Frustum &frustum, std::vector<int> &visible) const {
+    const __m128(*planes)[4] = frustum.splatPlanes;
+    const __m128 zero = _mm_setzero_ps();
+    size_t start = visible.size();
+    for (int i = 0; i < count; i += 4) {
+      __m128 px = _mm_loadu_ps(&x[i]);
+      __m128 py = _mm_loadu_ps(&y[i]);
+      __m128 pz = _mm_loadu_ps(&z[i]);
+      __m128 pr = _mm_loadu_ps(&radius[i]);
+      __m128 inside = _mm_cmpeq_ps(zero, zero);
+      for (int p = 0; p < 6; p++) {
+        __m128 d = _mm_add_ps(_mm_mul_ps(planes[p][0], px), _mm_mul_ps(planes[p][1], py));
+        d = _mm_add_ps(d, _mm_mul_ps(planes[p][2], pz));
+        d = _mm_add_ps(d, _mm_add_ps(planes[p][3], pr));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(d, zero));
+      }
+      int mask = _mm_movemask_ps(inside);
+      for (int lane = 0; lane < 4; lane++) {
+        if (mask & (1 << lane)) {
+          visible.push_back(i + lane);
+        }
+      }
+    }
+    CullStats stats;
+    stats.tested = count;
+    stats.visible = visible.size() - start;
+    return stats;
+  }
+
+  // One sphere at a time, used to check the SIMD path
+  CullStats cullScalar(const Frustum &frustum, std::vector<int> &visible) const {
+    size_t start = visible.size();
+    for (int i = 0; i < count; i++) {
+      if (frustum.sphereVisible(x[i], y[i], z[i], radius[i])) {
+        visible.push_back(i);
+      }
+    }
+    CullStats stats;
+    stats.tested = count;
+    stats.visible = visible.size() - start;
+    return stats;
+  }
+};
@@ -0,0 +1,501 @@
+#pragma once
+
+#include "GEMLoader.h"
+#include <chrono>
+#include <cstdio>
+#include <sys/stat.h>
+#ifndef _WIN32
+#include <dirent.h>
+#endif
+
+// Cooked model cache. A .gemc file sits next to its .gem source and holds the vertex and index arrays already in
+// STATIC_VERTEX / ANIMATED_VERTEX layout, texture names already resolved, and keyframes as one block per sequence.
+// It is keyed by the source size, write time and an FNV-1a hash of the source bytes.
+
+namespace GEMLoader
+{
+
+	// Texture naming rules, shared by the cooker and the uncooked load path
+	static void resolveTextureNames(const std::string& filename, bool animated, std::string texName, std::string& albedo, std::string& normal)
+	{
+		if (!animated)
+		{
+			albedo = "Models/Textures/Textures1_ALB.png";
+			normal = "Models/Textures/Textures1_NRM.png";
+			return;
+		}
+		if (filename.find("Duck-mixed") != std::string::npos || filename.find("Bull-dark") != std::string::npos ||
+			filename.find("Goat-01") != std::string::npos || filename.find("Pig") != std::string::npos)
+		{
+			texName = "T_Animalstextures_alb.png";
+		} else if (filename.find("AutomaticCarbine") != std::string::npos)
+		{
+			if (texName.find("arms") != std::string::npos)
+				texName = "arms_1_Albedo_alb.png";
+			else if (texName.find("Collimator") != std::string::npos)
+				texName = "AC5_Collimator_Albedo_alb.png";
+			else if (texName.find("Glass") != std::string::npos)
+				texName = "AC5_Collimator_Glass_Albedo_alb.png";
+			else if (texName.find("Bullet") != std::string::npos || texName.find("Shell") != std::string::npos)
+				texName = "AC5_Bullet_Shell_Albedo_alb.png";
+			else
+				texName = "AC5_Albedo_alb.png";
+		} else
+		{
+			if (texName.length() > 0 && texName.find(".png") == std::string::npos)
+			{
+				texName += ".png";
+			}
+		}
+
+		std::string normName = texName;
+		size_t pos = normName.find("_alb");
+		if (pos != std::string::npos)
+			normName.replace(pos, 4, "_nrm");
+		else
+		{
+			pos = normName.find("_ALB");
+			if (pos != std::string::npos)
+				normName.replace(pos, 4, "_NRM");
+			else
+			{
+				pos = normName.find_last_of(".");
+				if (pos != std::string::npos)
+					normName.insert(pos, "_nrm");
+			}
+		}
+
+		albedo = "Models/Textures/" + texName;
+		normal = "Models/Textures/" + normName;
+	}
+
+	class GEMCookedMesh
+	{
+	public:
+		std::string albedo;
+		std::string normal;
+		unsigned int vertexStride = 0;
+		unsigned int vertexCount = 0;
+		const unsigned char* vertices = nullptr;
+		GEMSpan<unsigned int> indices;
+	};
+
+	// Spans into a mapped .gemc file
+	class GEMCookedModel
+	{
+	public:
+		static const unsigned int MAGIC = 0x434D4547; // "GEMC"
+		static const unsigned int VERSION = 1;
+
+		GEMMappedFile file;
+		unsigned long long sourceHash = 0;
+		unsigned long long sourceSize = 0;
+		long long sourceTime = 0;
+		bool animated = false;
+		std::vector<GEMCookedMesh> meshes;
+		GEMAnimationView animation;
+
+		bool open(const std::string& filename)
+		{
+			meshes.clear();
+			animation.bones.clear();
+			animation.animations.clear();
+			if (!file.open(filename))
+			{
+				return false;
+			}
+			GEMReader reader(file.data, file.size);
+			if (reader.read<unsigned int>() != MAGIC || reader.read<unsigned int>() != VERSION)
+			{
+				file.close();
+				return false;
+			}
+			sourceHash = reader.read<unsigned long long>();
+			sourceSize = reader.read<unsigned long long>();
+			sourceTime = reader.read<long long>();
+			animated = reader.read<unsigned int>() != 0;
+			unsigned int meshesN = reader.read<unsigned int>();
+			for (unsigned int i = 0; i < meshesN && reader.ok; i++)
+			{
+				GEMCookedMesh mesh;
+				mesh.albedo = reader.readString();
+				mesh.normal = reader.readString();
+				mesh.vertexStride = reader.read<unsigned int>();
+				mesh.vertexCount = reader.read<unsigned int>();
+				unsigned int indicesN = reader.read<unsigned int>();
+				if (mesh.vertexStride != (animated ? sizeof(GEMAnimatedVertex) : sizeof(GEMStaticVertex)) ||
+					mesh.vertexCount > (reader.size - reader.offset) / mesh.vertexStride)
+				{
+					reader.ok = false;
+					break;
+				}
+				mesh.vertices = reader.take(static_cast<size_t>(mesh.vertexCount) * mesh.vertexStride);
+				mesh.indices = reader.readSpan<unsigned int>(indicesN);
+				meshes.push_back(mesh);
+			}
+			if (animated && reader.ok)
+			{
+				unsigned int bonesN = reader.read<unsigned int>();
+				for (unsigned int i = 0; i < bonesN && reader.ok; i++)
+				{
+					GEMBone bone;
+					bone.name = reader.readString();
+					bone.offset = reader.read<GEMMatrix>();
+					bone.parentIndex = reader.read<int>();
+					animation.bones.push_back(bone);
+				}
+				animation.globalInverse = reader.read<GEMMatrix>();
+				unsigned int sequencesN = reader.read<unsigned int>();
+				for (unsigned int i = 0; i < sequencesN && reader.ok; i++)
+				{
+					GEMAnimationSequenceView seq;
+					seq.name = reader.readString();
+					seq.ticksPerSecond = reader.read<float>();
+					seq.frameCount = reader.read<unsigned int>();
+					seq.bonesN = bonesN;
+					if (seq.frameStride() > 0 && seq.frameCount > (reader.size - reader.offset) / seq.frameStride())
+					{
+						reader.ok = false;
+						break;
+					}
+					seq.frames = reader.take(seq.frameStride() * seq.frameCount);
+					animation.animations.push_back(seq);
+				}
+			}
+			if (!reader.ok)
+			{
+				meshes.clear();
+				animation.bones.clear();
+				animation.animations.clear();
+				file.close();
+				return false;
+			}
+			return true;
+		}
+	};
+
+	class GEMCache
+	{
+	public:
+		static std::string cookedPath(const std::string& source)
+		{
+			return source + "c";
+		}
+
+		static unsigned long long hash(const unsigned char* data, size_t size)
+		{
+			unsigned long long h = 14695981039346656037ull;
+			for (size_t i = 0; i < size; i++)
+			{
+				h ^= data[i];
+				h *= 1099511628211ull;
+			}
+			return h;
+		}
+
+		// Size and last write time without opening the file
+		static bool fileStamp(const std::string& filename, unsigned long long& size, long long& time)
+		{
+#ifdef _WIN32
+			struct _stat64 st;
+			if (_stat64(filename.c_str(), &st) != 0)
+			{
+				return false;
+			}
+#else
+			struct stat st;
+			if (stat(filename.c_str(), &st) != 0)
+			{
+				return false;
+			}
+#endif
+			size = static_cast<unsigned long long>(st.st_size);
+			time = static_cast<long long>(st.st_mtime);
+			return true;
+		}
+
+		// Writes the new source size and write time over the ones in a cooked file's header, which follow the magic,
+		// version and hash
+		static bool restamp(const std::string& cookedFile, unsigned long long size, long long time)
+		{
+			std::fstream file(cookedFile, std::ios::binary | std::ios::in | std::ios::out);
+			if (!file.is_open())
+			{
+				return false;
+			}
+			file.seekp(2 * sizeof(unsigned int) + sizeof(unsigned long long));
+			file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+			file.write(reinterpret_cast<const char*>(&time), sizeof(time));
+			return file.good();
+		}
+
+		// Writes filename + "c". It is written to a temporary file first and renamed over the old one, so a failed or
+		// interrupted cook never leaves a partial file behind. Returns the number of bytes written, 0 on failure.
+		static size_t cook(const std::string& source)
+		{
+			GEMModelView view;
+			if (!view.open(source))
+			{
+				return 0;
+			}
+			unsigned long long size = 0;
+			long long time = 0;
+			fileStamp(source, size, time);
+
+			std::vector<unsigned char> out;
+			auto put = [&](const void* p, size_t bytes)
+			{
+				const unsigned char* b = static_cast<const unsigned char*>(p);
+				out.insert(out.end(), b, b + bytes);
+			};
+			auto putU32 = [&](unsigned int v)
+			{
+				put(&v, sizeof(unsigned int));
+			};
+			auto putString = [&](const std::string& s)
+			{
+				putU32(static_cast<unsigned int>(s.size()));
+				put(s.data(), s.size());
+			};
+
+			unsigned long long sourceHash = hash(view.file.data, view.file.size);
+			putU32(GEMCookedModel::MAGIC);
+			putU32(GEMCookedModel::VERSION);
+			put(&sourceHash, sizeof(sourceHash));
+			put(&size, sizeof(size));
+			put(&time, sizeof(time));
+			putU32(view.animated ? 1 : 0);
+			putU32(static_cast<unsigned int>(view.meshes.size()));
+			for (size_t i = 0; i < view.meshes.size(); i++)
+			{
+				const GEMMeshView& mesh = view.meshes[i];
+				std::string albedo;
+				std::string normal;
+				resolveTextureNames(source, view.animated, view.meshes[i].material.find("albedo").getValue(), albedo, normal);
+				putString(albedo);
+				putString(normal);
+				if (view.animated)
+				{
+					putU32(sizeof(GEMAnimatedVertex));
+					putU32(mesh.verticesAnimated.count);
+					putU32(mesh.indices.count);
+					put(mesh.verticesAnimated.data, mesh.verticesAnimated.sizeInBytes());
+				} else
+				{
+					putU32(sizeof(GEMStaticVertex));
+					putU32(mesh.verticesStatic.count);
+					putU32(mesh.indices.count);
+					put(mesh.verticesStatic.data, mesh.verticesStatic.sizeInBytes());
+				}
+				put(mesh.indices.data, mesh.indices.sizeInBytes());
+			}
+			if (view.animated)
+			{
+				putU32(static_cast<unsigned int>(view.animation.bones.size()));
+				for (size_t i = 0; i < view.animation.bones.size(); i++)
+				{
+					putString(view.animation.bones[i].name);
+					put(&view.animation.bones[i].offset, sizeof(GEMMatrix));
+					put(&view.animation.bones[i].parentIndex, sizeof(int));
+				}
+				put(&view.animation.globalInverse, sizeof(GEMMatrix));
+				putU32(static_cast<unsigned int>(view.animation.animations.size()));
+				for (size_t i = 0; i < view.animation.animations.size(); i++)
+				{
+					const GEMAnimationSequenceView& seq = view.animation.animations[i];
+					putString(seq.name);
+					put(&seq.ticksPerSecond, sizeof(float));
+					putU32(seq.frameCount);
+					put(seq.frames, seq.frameStride() * seq.frameCount);
+				}
+			}
+
+			std::string cookedFile = cookedPath(source);
+			std::string tempFile = cookedFile + ".tmp";
+			std::ofstream file(tempFile, std::ios::binary | std::ios::trunc);
+			if (!file.is_open())
+			{
+				return 0;
+			}
+			file.write(reinterpret_cast<const char*>(out.data()), out.size());
+			file.close();
+#ifdef _WIN32
+			bool replaced = file.good() && MoveFileExA(tempFile.c_str(), cookedFile.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+			bool replaced = file.good() && std::rename(tempFile.c_str(), cookedFile.c_str()) == 0;
+#endif
+			if (!replaced)
+			{
+				std::remove(tempFile.c_str());
+				return 0;
+			}
+			return out.size();
+		}
+
+		// Opens the cooked file for source, cooking it first if it is missing or stale.
+		// A cooked file without its source is used as is.
+		static bool load(const std::string& source, GEMCookedModel& cooked)
+		{
+			unsigned long long size = 0;
+			long long time = 0;
+			bool haveSource = fileStamp(source, size, time);
+			if (cooked.open(cookedPath(source)))
+			{
+				if (!haveSource || (cooked.sourceSize == size && cooked.sourceTime == time))
+				{
+					return true;
+				}
+				// Touched but possibly unchanged, only the hash decides. When it matches, the new stamp is recorded so
+				// the next load does not hash the source again.
+				GEMMappedFile sourceFile;
+				if (sourceFile.open(source) && hash(sourceFile.data, sourceFile.size) == cooked.sourceHash)
+				{
+					cooked.file.close();
+					restamp(cookedPath(source), size, time);
+					return cooked.open(cookedPath(source));
+				}
+				cooked.file.close();
+			}
+			if (!haveSource || cook(source) == 0)
+			{
+				return false;
+			}
+			return cooked.open(cookedPath(source));
+		}
+
+		static void listModels(const std::string& directory, std::vector<std::string>& files)
+		{
+#ifdef _WIN32
+			WIN32_FIND_DATAA data;
+			HANDLE find = FindFirstFileA((directory + "/*.gem").c_str(), &data);
+			if (find == INVALID_HANDLE_VALUE)
+			{
+				return;
+			}
+			do
+			{
+				files.push_back(directory + "/" + data.cFileName);
+			} while (FindNextFileA(find, &data));
+			FindClose(find);
+#else
+			DIR* dir = opendir(directory.c_str());
+			if (dir == NULL)
+			{
+				return;
+			}
+			while (dirent* entry = readdir(dir))
+			{
+				std::string name = entry->d_name;
+				if (name.size() > 4 && name.compare(name.size() - 4, 4, ".gem") == 0)
+				{
+					files.push_back(directory + "/" + name);
+				}
+			}
+			closedir(dir);
+#endif
+		}
+
+		// Cooks every .gem in directory and reports, per model, the bytes read and the load time of the raw parse
+		// with GEMModelLoader against the cooked open. Returns false if any model failed to cook.
+		static bool cookDirectory(const std::string& directory, std::ostream& report)
+		{
+			std::vector<std::string> files;
+			listModels(directory, files);
+			size_t rawBytes = 0;
+			size_t cookedBytes = 0;
+			double rawTime = 0;
+			double cookedTime = 0;
+			bool ok = true;
+			for (size_t i = 0; i < files.size(); i++)
+			{
+				size_t written = cook(files[i]);
+				if (written == 0)
+				{
+					report << files[i] << ": failed to cook" << std::endl;
+					ok = false;
+					continue;
+				}
+				unsigned long long size = 0;
+				long long time = 0;
+				fileStamp(files[i], size, time);
+				auto start = std::chrono::high_resolution_clock::now();
+				GEMModelLoader loader;
+				std::vector<GEMMesh> meshes;
+				GEMAnimation animation;
+				bool animated = loader.isAnimatedModel(files[i]);
+				if (animated)
+				{
+					loader.load(files[i], meshes, animation);
+				} else
+				{
+					loader.load(files[i], meshes);
+				}
+				for (size_t j = 0; j < meshes.size(); j++)
+				{
+					std::string albedo;
+					std::string normal;
+					resolveTextureNames(files[i], animated, meshes[j].material.find("albedo").getValue(), albedo, normal);
+				}
+				auto mid = std::chrono::high_resolution_clock::now();
+				GEMCookedModel cooked;
+				load(files[i], cooked);
+				auto end = std::chrono::high_resolution_clock::now();
+				double raw = std::chrono::duration<double, std::milli>(mid - start).count();
+				double fast = std::chrono::duration<double, std::milli>(end - mid).count();
+				report << files[i] << ": " << size << " -> " << written << " bytes, " << raw << " -> " << fast << " ms" << std::endl;
+				rawBytes += size;
+				cookedBytes += written;
+				rawTime += raw;
+				cookedTime += fast;
+			}
+			report << files.size() << " models, " << rawBytes << " bytes raw, " << cookedBytes << " bytes cooked ("
+				<< (static_cast<long long>(rawBytes) - static_cast<long long>(cookedBytes)) << " saved), "
+				<< rawTime << " ms raw, " << cookedTime << " ms cooked (" << (rawTime - cookedTime) << " saved)" << std::endl;
+			return ok;
+		}
+	};
+
+	// What the engine needs from a model: the cooked file when one exists or could be written, otherwise the raw
+	// source. Mesh and animation data point into whichever file is open.
+	class GEMModelSource
+	{
+	public:
+		GEMCookedModel cooked;
+		GEMModelView view;
+		bool animated = false;
+		std::vector<GEMCookedMesh> meshes;
+		const GEMAnimationView* animation = nullptr;
+
+		bool open(const std::string& filename)
+		{
+			meshes.clear();
+			animation = nullptr;
+			if (GEMCache::load(filename, cooked))
+			{
+				animated = cooked.animated;
+				meshes = cooked.meshes;
+				animation = &cooked.animation;
+				return true;
+			}
+			if (!view.open(filename))
+			{
+				return false;
+			}
+			animated = view.animated;
+			for (size_t i = 0; i < view.meshes.size(); i++)
+			{
+				const GEMMeshView& meshView = view.meshes[i];
+				GEMCookedMesh mesh;
+				resolveTextureNames(filename, animated, view.meshes[i].material.find("albedo").getValue(), mesh.albedo, mesh.normal);
+				mesh.vertexStride = animated ? sizeof(GEMAnimatedVertex) : sizeof(GEMStaticVertex);
+				mesh.vertexCount = animated ? meshView.verticesAnimated.count : meshView.verticesStatic.count;
+				mesh.vertices = animated ? reinterpret_cast<const unsigned char*>(meshView.verticesAnimated.data) : reinterpret_cast<const unsigned char*>(meshView.verticesStatic.data);
+				mesh.indices = meshView.indices;
+				meshes.push_back(mesh);
+			}
+			animation = &view.animation;
+			return true;
+		}
+	};
+
+};
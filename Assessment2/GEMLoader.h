@@ -29,6 +29,14 @@ SOFTWARE.
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <cstring>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#endif
 
 namespace GEMLoader
 {
@@ -394,4 +402,348 @@ namespace GEMLoader
 		}
 	};
 
+	// Read-only view of a whole file. On Windows the file is memory-mapped, elsewhere it is read with a single read call.
+	class GEMMappedFile
+	{
+	public:
+		const unsigned char* data = nullptr;
+		size_t size = 0;
+#ifdef _WIN32
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = NULL;
+#else
+		std::vector<unsigned char> storage;
+#endif
+		GEMMappedFile() = default;
+		GEMMappedFile(const GEMMappedFile&) = delete;
+		GEMMappedFile& operator=(const GEMMappedFile&) = delete;
+		bool open(const std::string& filename)
+		{
+			close();
+#ifdef _WIN32
+			file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			if (file == INVALID_HANDLE_VALUE)
+			{
+				return false;
+			}
+			LARGE_INTEGER fileSize;
+			if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+			{
+				close();
+				return false;
+			}
+			mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping == NULL)
+			{
+				close();
+				return false;
+			}
+			data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+			if (data == nullptr)
+			{
+				close();
+				return false;
+			}
+			size = static_cast<size_t>(fileSize.QuadPart);
+#else
+			std::ifstream in(filename, std::ios::binary | std::ios::ate);
+			if (!in.is_open())
+			{
+				return false;
+			}
+			std::streamoff fileSize = in.tellg();
+			if (fileSize <= 0)
+			{
+				return false;
+			}
+			storage.resize(static_cast<size_t>(fileSize));
+			in.seekg(0);
+			in.read(reinterpret_cast<char*>(storage.data()), fileSize);
+			data = storage.data();
+			size = storage.size();
+#endif
+			return true;
+		}
+		void close()
+		{
+#ifdef _WIN32
+			if (data)
+			{
+				UnmapViewOfFile(data);
+			}
+			if (mapping != NULL)
+			{
+				CloseHandle(mapping);
+				mapping = NULL;
+			}
+			if (file != INVALID_HANDLE_VALUE)
+			{
+				CloseHandle(file);
+				file = INVALID_HANDLE_VALUE;
+			}
+#else
+			storage.clear();
+#endif
+			data = nullptr;
+			size = 0;
+		}
+		~GEMMappedFile()
+		{
+			close();
+		}
+	};
+
+	// Pointer + count into a mapped file. Element types are the packed on-disk structs, so no conversion is needed.
+	template<typename T>
+	struct GEMSpan
+	{
+		const T* data = nullptr;
+		unsigned int count = 0;
+		const T& operator[](unsigned int i) const
+		{
+			return data[i];
+		}
+		const T* begin() const
+		{
+			return data;
+		}
+		const T* end() const
+		{
+			return data + count;
+		}
+		bool empty() const
+		{
+			return count == 0;
+		}
+		size_t sizeInBytes() const
+		{
+			return static_cast<size_t>(count) * sizeof(T);
+		}
+	};
+
+	// Bounds checked cursor over a mapped file
+	class GEMReader
+	{
+	public:
+		const unsigned char* data;
+		size_t size;
+		size_t offset;
+		bool ok;
+		GEMReader(const unsigned char* _data, size_t _size)
+		{
+			data = _data;
+			size = _size;
+			offset = 0;
+			ok = true;
+		}
+		const unsigned char* take(size_t bytes)
+		{
+			if (!ok || bytes > size - offset)
+			{
+				ok = false;
+				return nullptr;
+			}
+			const unsigned char* p = data + offset;
+			offset += bytes;
+			return p;
+		}
+		template<typename T>
+		T read()
+		{
+			T v;
+			memset(&v, 0, sizeof(T));
+			const unsigned char* p = take(sizeof(T));
+			if (p)
+			{
+				memcpy(&v, p, sizeof(T));
+			}
+			return v;
+		}
+		template<typename T>
+		GEMSpan<T> readSpan(unsigned int count)
+		{
+			GEMSpan<T> span;
+			if (count > (size - offset) / sizeof(T))
+			{
+				ok = false;
+				return span;
+			}
+			span.data = reinterpret_cast<const T*>(take(static_cast<size_t>(count) * sizeof(T)));
+			span.count = span.data ? count : 0;
+			return span;
+		}
+		std::string readString()
+		{
+			int l = read<int>();
+			if (l < 0)
+			{
+				ok = false;
+				return "";
+			}
+			const unsigned char* p = take(static_cast<size_t>(l));
+			if (!p)
+			{
+				return "";
+			}
+			// Stored strings may carry trailing nulls, match loadString which stops at the first one
+			size_t n = 0;
+			while (n < static_cast<size_t>(l) && p[n] != 0)
+			{
+				n++;
+			}
+			return std::string(reinterpret_cast<const char*>(p), n);
+		}
+	};
+
+	class GEMMeshView
+	{
+	public:
+		GEMMaterial material;
+		GEMSpan<GEMStaticVertex> verticesStatic;
+		GEMSpan<GEMAnimatedVertex> verticesAnimated;
+		GEMSpan<unsigned int> indices;
+		bool isAnimated() const
+		{
+			return verticesAnimated.count > 0;
+		}
+	};
+
+	// Frames are stored back to back as [positions][rotations][scales], each bonesN long
+	class GEMAnimationSequenceView
+	{
+	public:
+		std::string name;
+		float ticksPerSecond = 0;
+		unsigned int frameCount = 0;
+		unsigned int bonesN = 0;
+		const unsigned char* frames = nullptr;
+		size_t frameStride() const
+		{
+			return static_cast<size_t>(bonesN) * (sizeof(GEMVec3) + sizeof(GEMQuaternion) + sizeof(GEMVec3));
+		}
+		GEMSpan<GEMVec3> positions(unsigned int frame) const
+		{
+			GEMSpan<GEMVec3> span;
+			span.data = reinterpret_cast<const GEMVec3*>(frames + (frame * frameStride()));
+			span.count = bonesN;
+			return span;
+		}
+		GEMSpan<GEMQuaternion> rotations(unsigned int frame) const
+		{
+			GEMSpan<GEMQuaternion> span;
+			span.data = reinterpret_cast<const GEMQuaternion*>(frames + (frame * frameStride()) + (bonesN * sizeof(GEMVec3)));
+			span.count = bonesN;
+			return span;
+		}
+		GEMSpan<GEMVec3> scales(unsigned int frame) const
+		{
+			GEMSpan<GEMVec3> span;
+			span.data = reinterpret_cast<const GEMVec3*>(frames + (frame * frameStride()) + (bonesN * (sizeof(GEMVec3) + sizeof(GEMQuaternion))));
+			span.count = bonesN;
+			return span;
+		}
+	};
+
+	class GEMAnimationView
+	{
+	public:
+		std::vector<GEMBone> bones;
+		std::vector<GEMAnimationSequenceView> animations;
+		GEMMatrix globalInverse;
+	};
+
+	// Memory-mapped loader. open() validates every section size once, afterwards vertex, index and keyframe
+	// data is read straight out of the mapping. Spans stay valid for the lifetime of the view.
+	class GEMModelView
+	{
+	public:
+		GEMMappedFile file;
+		bool animated = false;
+		std::vector<GEMMeshView> meshes;
+		GEMAnimationView animation;
+
+		bool open(const std::string& filename)
+		{
+			meshes.clear();
+			animation.bones.clear();
+			animation.animations.clear();
+			if (!file.open(filename))
+			{
+				std::cout << filename << " could not be opened" << std::endl;
+				return false;
+			}
+			GEMReader reader(file.data, file.size);
+			if (reader.read<unsigned int>() != 4058972161)
+			{
+				std::cout << filename << " is not a GE Model File" << std::endl;
+				file.close();
+				return false;
+			}
+			animated = reader.read<unsigned int>() != 0;
+			unsigned int meshesN = reader.read<unsigned int>();
+			for (unsigned int i = 0; i < meshesN && reader.ok; i++)
+			{
+				GEMMeshView mesh;
+				unsigned int propertiesN = reader.read<unsigned int>();
+				for (unsigned int j = 0; j < propertiesN && reader.ok; j++)
+				{
+					GEMMaterialProperty prop;
+					prop.name = reader.readString();
+					prop.value = reader.readString();
+					mesh.material.properties.push_back(prop);
+				}
+				unsigned int verticesN = reader.read<unsigned int>();
+				if (animated)
+				{
+					mesh.verticesAnimated = reader.readSpan<GEMAnimatedVertex>(verticesN);
+				} else
+				{
+					mesh.verticesStatic = reader.readSpan<GEMStaticVertex>(verticesN);
+				}
+				mesh.indices = reader.readSpan<unsigned int>(reader.read<unsigned int>());
+				meshes.push_back(mesh);
+			}
+			if (animated && reader.ok)
+			{
+				unsigned int bonesN = reader.read<unsigned int>();
+				for (unsigned int i = 0; i < bonesN && reader.ok; i++)
+				{
+					GEMBone bone;
+					bone.name = reader.readString();
+					bone.offset = reader.read<GEMMatrix>();
+					bone.parentIndex = reader.read<int>();
+					animation.bones.push_back(bone);
+				}
+				animation.globalInverse = reader.read<GEMMatrix>();
+				unsigned int sequencesN = reader.read<unsigned int>();
+				for (unsigned int i = 0; i < sequencesN && reader.ok; i++)
+				{
+					GEMAnimationSequenceView aseq;
+					aseq.name = reader.readString();
+					int frames = reader.read<int>();
+					aseq.ticksPerSecond = reader.read<float>();
+					aseq.bonesN = bonesN;
+					if (frames < 0 || (aseq.frameStride() > 0 && static_cast<size_t>(frames) > (reader.size - reader.offset) / aseq.frameStride()))
+					{
+						reader.ok = false;
+						break;
+					}
+					aseq.frameCount = static_cast<unsigned int>(frames);
+					aseq.frames = reader.take(aseq.frameStride() * aseq.frameCount);
+					animation.animations.push_back(aseq);
+				}
+			}
+			if (!reader.ok)
+			{
+				std::cout << filename << " is truncated or corrupt" << std::endl;
+				meshes.clear();
+				animation.bones.clear();
+				animation.animations.clear();
+				file.close();
+				return false;
+			}
+			return true;
+		}
+	};
+
 };
\ No newline at end of file
@@ -1,8 +1,14 @@
 #include "Animation.h"
+#include "AssetLoader.h"
 #include "Camera.h"
+#include "ColliderGrid.h"
 #include "Collision.h"
 #include "Controller.h"
 #include "Core.h"
+#include "EnemyStore.h"
+#include "FlowField.h"
+#include "HeightField.h"
+#include "JobSystem.h"
 #include "LevelLoader.h"
 #include "Maths.h"
 #include "Mesh.h"
@@ -10,15 +16,18 @@
 #include "PSO.h"
 #include "Shaders.h"
 #include "Sounds.h"
+#include "SpatialHash.h"
 #include "Texture.h"
 #include "Timer.h"
 #include "Window.h"
 #include <d3dcompiler.h>
 #include <fstream>
+#include <sstream>
 
 #pragma comment(lib, "d3dcompiler.lib")
 #define WIDTH 1920
 #define HEIGHT 1080
+
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nCmdShow) {
   Window window;
   window.create(WIDTH, HEIGHT, "Escape from TakoFarm");
@@ -78,17 +87,54 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
   std::vector<AABB> enemySceneColliders; 
   std::vector<std::pair<std::string, Vec3>> staticModelPositions;
 
-  // Load all static models 
+  AnimatedModel goatModel, pigModel, bullModel, duckModel, gunModel;
+
+  // Load all models and their textures. Files are decoded on worker threads and every GPU upload goes out in one batch.
+  AssetLoader assetLoader;
+  std::vector<StaticModel *> staticModelList;
+  std::vector<std::string> staticModelPaths;
   for (const auto &name : staticModelNames) {
     StaticModel *model = new StaticModel();
-    model->load(&core, "Models/" + name + ".gem");
-
-    for (size_t i = 0; i < model->textureFilenames.size(); i++) {
-      textures.getTexture(model->textureFilenames[i], &core);
-      textures.getTexture(model->normalFilenames[i], &core);
-    }
-
     staticModels[name] = model;
+    staticModelList.push_back(model);
+    staticModelPaths.push_back("Models/" + name + ".gem");
+  }
+  std::vector<AnimatedModel *> animatedModelList = {&goatModel, &pigModel, &bullModel, &duckModel, &gunModel};
+  std::vector<std::string> animatedModelPaths = {"Models/Goat-01.gem", "Models/Pig.gem", "Models/Bull-dark.gem",
+                                                 "Models/Duck-mixed.gem", "Models/AutomaticCarbine.gem"};
+  assetLoader.loadModels(&core, staticModelList, staticModelPaths, animatedModelList, animatedModelPaths, &psos, &shaders);
+
+  std::vector<std::string> textureList;
+  for (StaticModel *model : staticModelList) {
+    textureList.insert(textureList.end(), model->textureFilenames.begin(), model->textureFilenames.end());
+    textureList.insert(textureList.end(), model->normalFilenames.begin(), model->normalFilenames.end());
+  }
+  for (AnimatedModel *model : animatedModelList) {
+    textureList.insert(textureList.end(), model->textureFilenames.begin(), model->textureFilenames.end());
+    textureList.insert(textureList.end(), model->normalFilenames.begin(), model->normalFilenames.end());
+  }
+  textureList.push_back("Resources/fail.png");
+  textureList.push_back("Resources/victory.png");
+  textureList.push_back("Resources/menu.png");
+  assetLoader.loadTextures(&core, textures, textureList);
+  assetLoader.submitUploads(&core);
+
+  // "-bench-constants" times constant updates by name against resolved handles and exits. It needs the compiled
+  // shaders, so unlike the headless benchmarks in Bench.cpp it runs inside the game.
+  std::istringstream arguments(lpCmdLine != nullptr ? lpCmdLine : "");
+  bool benchConstants = false;
+  for (std::string argument; arguments >> argument;) {
+    benchConstants = benchConstants || argument == "-bench-constants";
+  }
+  if (benchConstants) {
+    std::ofstream report("constant_bench.txt");
+    Matrix matrix;
+    std::vector<Matrix> bones(256);
+    shaders.benchmarkConstant("AnimatedNormalMapped", "staticMeshBuffer", "W", &matrix, 100000, report);
+    shaders.benchmarkConstant("AnimatedNormalMapped", "staticMeshBuffer", "VP", &matrix, 100000, report);
+    shaders.benchmarkConstant("AnimatedNormalMapped", "staticMeshBuffer", "bones", bones.data(), 100000, report);
+    MessageBoxA(NULL, "Constant update timings written to constant_bench.txt", "Benchmark", MB_OK);
+    return 0;
   }
 
   // Load level from file
@@ -102,35 +148,15 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
       }
 
       StaticModel *model = it->second;
-      Matrix scale = Matrix::scaling(Vec3(obj.scale, obj.scale, obj.scale));
-      Matrix rot = Matrix::rotateY(obj.rotation * 3.14159f / 180.0f);
-      Matrix trans = Matrix::translation(obj.position);
 
       // Will be rendered separately for explosion control
       if (obj.modelName != "barrel_003") {
-        model->addInstance(scale * rot * trans);
+        model->addInstance(obj.transform());
       }
 
       // Add collision if enabled
       if (obj.hasCollision) {
-        // Handle rotated collision boxes 
-        float rotRad = obj.rotation * 3.14159f / 180.0f;
-        bool isRotated90 = (fabs(fmod(obj.rotation, 180.0f) - 90.0f) < 1.0f);
-        AABB colliderAABB;
-
-        if (isRotated90) {
-          auto it = StaticModelBounds.find(obj.modelName);
-          if (it != StaticModelBounds.end()) {
-            Vec3 extent = it->second.toVec3();
-            Vec3 swappedExtent(extent.z, extent.y, extent.x); 
-            Vec3 center = obj.position + Vec3(0, extent.y, 0);
-            colliderAABB = AABB::fromCenterExtent(center, swappedExtent);
-          } else {
-            colliderAABB = getStaticModelAABB(obj.modelName, obj.position);
-          }
-        } else {
-          colliderAABB = getStaticModelAABB(obj.modelName, obj.position);
-        }
+        AABB colliderAABB = getLevelObjectAABB(obj.modelName, obj.position, obj.rotation);
 
         // Add to player colliders 
         sceneColliders.push_back(colliderAABB);
@@ -152,11 +178,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     sceneColliders.push_back(AABB(Vec3(-50, -1.0f, -50), Vec3(50, -0.5f, 50)));
   }
 
-  // Upload all instances
-  for (auto &pair : staticModels) {
-    pair.second->uploadInstances(&core);
-  }
-
   // Invisible boundary walls 
   AABB leftBoundary(Vec3(-50, -20, -50), Vec3(-22, 50, 50));
   sceneColliders.push_back(leftBoundary);
@@ -185,6 +206,21 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
   enemySceneColliders.push_back(AABB(Vec3(30, -20, 25), Vec3(35, 50, 45))); 
   enemySceneColliders.push_back(AABB(Vec3(8, -20, 40), Vec3(35, 50, 45))); 
 
+  // The colliders never move once the level is built, so bucket them once for the per-frame queries
+  ColliderGrid sceneGrid, enemySceneGrid;
+  sceneGrid.build(sceneColliders);
+  enemySceneGrid.build(enemySceneColliders);
+  AABBTree sceneTree;
+  sceneTree.build(sceneColliders);
+  AABBTree enemyTree; // Refit to animalColliders once a frame, for the shots
+  HeightField sceneHeights, enemySceneHeights;
+  sceneHeights.build(sceneColliders);
+  enemySceneHeights.build(enemySceneColliders);
+  FlowField enemyFlow;
+  enemyFlow.build(enemySceneColliders);
+  const int FLOW_CELLS_PER_FRAME = 2048; // Cells of the path search settled per frame
+  std::vector<int> nearbyColliders;
+
   AABB playerLocalAABB(Vec3(-0.3f, 0.0f, -0.3f), Vec3(0.3f, 1.8f, 0.3f));
   auto loadAnimated = [&](AnimatedModel &model, std::string path, float speed, AnimationInstance &inst, AnimationController &ctrl) {
     model.load(&core, path, &psos, &shaders);
@@ -195,75 +231,40 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     inst.init(&model.animation, 0);
     ctrl.init(&inst, speed);
   };
-  AnimatedModel goatModel, pigModel, bullModel, duckModel, gunModel;
-  // Create enemy pool (max 50) 
+  // Enemy slots per species (max 50) 
   const int MAX_ENEMIES = 50;
-  std::vector<AnimationInstance> goatInstPool(MAX_ENEMIES);
-  std::vector<AnimationInstance> pigInstPool(MAX_ENEMIES);
-  std::vector<AnimationInstance> bullInstPool(MAX_ENEMIES);
-  std::vector<AnimationInstance> duckInstPool(MAX_ENEMIES);
-  std::vector<AnimationController> goatCtrlPool(MAX_ENEMIES);
-  std::vector<AnimationController> pigCtrlPool(MAX_ENEMIES);
-  std::vector<AnimationController> bullCtrlPool(MAX_ENEMIES);
-  std::vector<AnimationController> duckCtrlPool(MAX_ENEMIES);
 
   AnimationInstance gunInst;
   GunAnimationController gunCtrl;
 
-  // Load animated models
-  auto loadAnimatedModel = [&](AnimatedModel &model, std::string path) {
-    model.load(&core, path, &psos, &shaders);
-    for (size_t i = 0; i < model.textureFilenames.size(); i++) {
-      textures.getTexture(model.textureFilenames[i], &core);
-      textures.getTexture(model.normalFilenames[i], &core);
-    }
-  };
-
-  loadAnimatedModel(goatModel, "Models/Goat-01.gem");
-  loadAnimatedModel(pigModel, "Models/Pig.gem");
-  loadAnimatedModel(bullModel, "Models/Bull-dark.gem");
-  loadAnimatedModel(duckModel, "Models/Duck-mixed.gem");
-
-  // Initialize animation instance pools
-  for (int i = 0; i < MAX_ENEMIES; i++) {
-    goatInstPool[i].init(&goatModel.animation, 0);
-    goatCtrlPool[i].init(&goatInstPool[i], 3.0f);
-    pigInstPool[i].init(&pigModel.animation, 0);
-    pigCtrlPool[i].init(&pigInstPool[i], 3.0f);
-    bullInstPool[i].init(&bullModel.animation, 0);
-    bullCtrlPool[i].init(&bullInstPool[i], 3.0f);
-    duckInstPool[i].init(&duckModel.animation, 0);
-    duckCtrlPool[i].init(&duckInstPool[i], 3.0f);
+  // Baked animation: skinning matrices of the animals precomputed at BAKE_SAMPLES_PER_SECOND, so poses are a
+  // table lookup and blend. Models left out of this list are evaluated live. At the pose cache's rate the
+  // cached poses fall exactly on baked samples.
+  const float BAKE_SAMPLES_PER_SECOND = 60.0f;
+  std::vector<std::pair<std::string, AnimatedModel *>> bakedModels = {
+      {"Goat-01", &goatModel}, {"Pig", &pigModel}, {"Bull-dark", &bullModel}, {"Duck-mixed", &duckModel}};
+  for (auto &baked : bakedModels) {
+    std::cout << "Baking " << baked.first << " animation:" << std::endl;
+    baked.second->animation.bake(BAKE_SAMPLES_PER_SECOND, Matrix(), std::cout);
   }
 
-  gunModel.load(&core, "Models/AutomaticCarbine.gem", &psos, &shaders);
-  for (size_t i = 0; i < gunModel.textureFilenames.size(); i++) {
-    textures.getTexture(gunModel.textureFilenames[i], &core);
-    textures.getTexture(gunModel.normalFilenames[i], &core);
-  }
+  // Every enemy of every species in one store, so each pass over them is a single loop
+  EnemyStore enemies;
+  AnimatedModel *const speciesModels[SPECIES_COUNT] = {&goatModel, &pigModel, &bullModel, &duckModel};
+  Animation *const speciesAnimations[SPECIES_COUNT] = {&goatModel.animation, &pigModel.animation, &bullModel.animation,
+                                                       &duckModel.animation};
+  PoseCache *const speciesPoseCaches[SPECIES_COUNT] = {&goatModel.poseCache, &pigModel.poseCache, &bullModel.poseCache,
+                                                       &duckModel.poseCache};
+  enemies.init(speciesAnimations, speciesPoseCaches, MAX_ENEMIES);
+
+  // The enemy passes run as jobs across the hardware threads, this one included
+  JobSystem jobs;
+  jobs.start((int)std::max(1u, std::thread::hardware_concurrency()));
+  const int ENEMY_JOB_GRAIN = 16; // Enemies per job
+
   gunInst.init(&gunModel.animation, 0);
   gunCtrl.init(&gunInst);
 
-  // Enemy data pool
-  std::vector<AnimalData> goatDataPool(MAX_ENEMIES);
-  std::vector<AnimalData> pigDataPool(MAX_ENEMIES);
-  std::vector<AnimalData> bullDataPool(MAX_ENEMIES);
-  std::vector<AnimalData> duckDataPool(MAX_ENEMIES);
-
-  // Enemy AI pools
-  std::vector<EnemyController> goatAIPool(MAX_ENEMIES);
-  std::vector<EnemyController> pigAIPool(MAX_ENEMIES);
-  std::vector<EnemyController> bullAIPool(MAX_ENEMIES);
-  std::vector<EnemyController> duckAIPool(MAX_ENEMIES);
-  std::vector<Vec3> goatPosPool(MAX_ENEMIES);
-  std::vector<Vec3> pigPosPool(MAX_ENEMIES);
-  std::vector<Vec3> bullPosPool(MAX_ENEMIES);
-  std::vector<Vec3> duckPosPool(MAX_ENEMIES);
-  std::vector<bool> goatActivePool(MAX_ENEMIES, false);
-  std::vector<bool> pigActivePool(MAX_ENEMIES, false);
-  std::vector<bool> bullActivePool(MAX_ENEMIES, false);
-  std::vector<bool> duckActivePool(MAX_ENEMIES, false);
-
   // Spawn points
   Vec3 spawnFrontLeft(-18, 0, -28);
   Vec3 spawnBackRight(18, 0, 28);
@@ -276,41 +277,15 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
   const float GAME_START_DELAY = 2.0f;
   const float BACK_TO_FRONT_INTERVAL = 4.0f; 
   const float FRONT_TO_BACK_INTERVAL = 6.0f; 
-  int nextGoatIdx = 0, nextPigIdx = 0, nextBullIdx = 0, nextDuckIdx = 0;
-
-  // Spawn enemy with entry target 
-  auto spawnEnemy = [&](const std::string &type, Vec3 pos, Vec3 entryTarget) {
-    if (type == "duck" && nextDuckIdx < MAX_ENEMIES) {
-      int idx = nextDuckIdx++;
-      duckPosPool[idx] = pos;
-      duckDataPool[idx] = AnimalData(40, 5, 2.0f, 10.0f);
-      duckAIPool[idx].init(&duckInstPool[idx], &duckDataPool[idx], pos, true, entryTarget);
-      duckActivePool[idx] = true;
-    } else if (type == "goat" && nextGoatIdx < MAX_ENEMIES) {
-      int idx = nextGoatIdx++;
-      goatPosPool[idx] = pos;
-      goatDataPool[idx] = AnimalData(70, 10, 3.0f, 8.0f);
-      goatAIPool[idx].init(&goatInstPool[idx], &goatDataPool[idx], pos, false, entryTarget);
-      goatActivePool[idx] = true;
-    } else if (type == "pig" && nextPigIdx < MAX_ENEMIES) {
-      int idx = nextPigIdx++;
-      pigPosPool[idx] = pos;
-      pigDataPool[idx] = AnimalData(130, 10, 4.0f, 6.0f);
-      pigAIPool[idx].init(&pigInstPool[idx], &pigDataPool[idx], pos, false, entryTarget);
-      pigActivePool[idx] = true;
-    } else if (type == "bull" && nextBullIdx < MAX_ENEMIES) {
-      int idx = nextBullIdx++;
-      bullPosPool[idx] = pos;
-      bullDataPool[idx] = AnimalData(100, 20, 3.5f, 7.5f);
-      bullAIPool[idx].init(&bullInstPool[idx], &bullDataPool[idx], pos, false, entryTarget);
-      bullActivePool[idx] = true;
-    }
-  };
+
+  // Spawn enemy with entry target, ignored once the species has used all its slots
+  auto spawnEnemy = [&](Species type, Vec3 pos, Vec3 entryTarget) { enemies.spawn(type, pos, entryTarget); };
 
   Vec3 entryTargetFront(-18, 0, -18); 
   Vec3 entryTargetBack(18, 0, 18);    
 
   std::vector<AABB> animalColliders;
+  std::vector<int> nearbyEnemies; // Scratch for crowd queries, indices into enemies.live
 
   // Explosive barrels
   struct ExplosiveBarrel {
@@ -332,6 +307,13 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
       explosiveBarrels.push_back(barrel);
     }
   }
+  // One instance per barrel, in the same order, hidden while the barrel is destroyed
+  StaticModel *barrelModel = staticModels["barrel_003"];
+  for (const auto &barrel : explosiveBarrels) {
+    Matrix scale = Matrix::scaling(Vec3(0.01f, 0.01f, 0.01f));
+    Matrix trans = Matrix::translation(barrel.position);
+    barrelModel->addInstance(scale * trans);
+  }
 
   AABB victoryPlatformAABB;
   bool foundVictoryPlatform = false;
@@ -352,22 +334,10 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
   HitMarker hitMarker;
   hitMarker.init(&core, &shaders, &psos);
   SoundManager soundManager;
-  soundManager.load("Resources/hit.wav");
-  soundManager.load("Resources/Fire.wav");
-  soundManager.load("Resources/Reload.wav");
-  soundManager.load("Resources/DryFire.wav");
-  soundManager.load("Resources/enemyAttack.wav");
-  soundManager.load("Resources/playerHurt.wav");
-  soundManager.load("Resources/kill.wav");
-  soundManager.load("Resources/Melee.wav");
-  soundManager.load("Resources/jump.wav");
-  soundManager.load("Resources/step.wav");
-  soundManager.load("Resources/heal.wav");
-  soundManager.load("Resources/pickup.wav");
-  soundManager.load("Resources/explosion.wav");
-  soundManager.load("Resources/generator.wav");
-  soundManager.load("Resources/click.wav");
-  soundManager.load("Resources/finish.wav");
+  assetLoader.loadSounds(soundManager, {"Resources/hit.wav", "Resources/Fire.wav", "Resources/Reload.wav", "Resources/DryFire.wav",
+      "Resources/enemyAttack.wav", "Resources/playerHurt.wav", "Resources/kill.wav", "Resources/Melee.wav",
+      "Resources/jump.wav", "Resources/step.wav", "Resources/heal.wav", "Resources/pickup.wav",
+      "Resources/explosion.wav", "Resources/generator.wav", "Resources/click.wav", "Resources/finish.wav"});
   soundManager.loadMusic("Resources/music.wav");
   soundManager.playMusic();
   LightData lightData;
@@ -380,9 +350,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
 
   FullScreenUI fullScreenUI;
   fullScreenUI.init(&core, &shaders, &psos);
-  textures.getTexture("Resources/fail.png", &core);
-  textures.getTexture("Resources/victory.png", &core);
-  textures.getTexture("Resources/menu.png", &core);
+  std::ofstream timelineReport("startup_timeline.txt");
+  assetLoader.timeline.write(timelineReport);
 
   // Player data
   int playerHealth = 100;
@@ -419,6 +388,12 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
   float ammoCooldown = 0.0f; // 15s cooldown for box_004 (ammo)
   bool prevKeyE = false;     // Edge detection for E key
 
+  CullStats cullTotals;
+  long long cullFrames = 0;
+  AnimationLODTiers animationLOD;
+  AnimationLODStats animationTotals;
+  AILODTiers aiLOD;
+  AIStats aiTotals;
   while (1) {
     core.beginFrame();
     float dt = timer.dt();
@@ -479,17 +454,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         spawnTimer = 0.0f;
         spawnWave = 0;
         gameStarted = false;
-        // Reset enemy pools
-        nextGoatIdx = 0;
-        nextPigIdx = 0;
-        nextBullIdx = 0;
-        nextDuckIdx = 0;
-        for (int i = 0; i < MAX_ENEMIES; i++) {
-          goatActivePool[i] = false;
-          pigActivePool[i] = false;
-          bullActivePool[i] = false;
-          duckActivePool[i] = false;
-        }
+        // Reset enemies
+        enemies.clear();
         // Reset player position and gun state
         camera.position = Vec3(0, 1.5f, 0);
         camera.yaw = 0;
@@ -558,88 +524,28 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
             explosiveBarrels[i].isActive = (active == 1);
           }
 
-          // Enemy counts
-          loadFile >> nextGoatIdx >> nextPigIdx >> nextBullIdx >> nextDuckIdx;
-
-          // Reset all pools first
-          for (int i = 0; i < MAX_ENEMIES; i++) {
-            goatActivePool[i] = false;
-            pigActivePool[i] = false;
-            bullActivePool[i] = false;
-            duckActivePool[i] = false;
-          }
-
-          // Load goat data
-          for (int i = 0; i < nextGoatIdx; i++) {
-            int active, hp, removed;
-            float x, y, z;
-            loadFile >> active >> x >> y >> z >> hp >> removed;
-            goatPosPool[i] = Vec3(x, y, z);
-            goatDataPool[i] = AnimalData(70, 10, 3.0f, 8.0f);
-            goatDataPool[i].health = hp;
-            if (removed == 1) {
-              // Dead enemy marked as inactive and removed
-              goatActivePool[i] = false;
-              goatAIPool[i].shouldRemove = true;
-            } else if (active == 1) {
-              goatActivePool[i] = true;
-              goatAIPool[i].init(&goatInstPool[i], &goatDataPool[i], goatPosPool[i], false, Vec3(0, 0, 0));
-            } else {
-              goatActivePool[i] = false;
-            }
+          // Enemy counts, then each species' enemies in slot order
+          int enemyCounts[SPECIES_COUNT];
+          for (int k = 0; k < SPECIES_COUNT; k++) {
+            loadFile >> enemyCounts[k];
           }
-          // Load pig data
-          for (int i = 0; i < nextPigIdx; i++) {
-            int active, hp, removed;
-            float x, y, z;
-            loadFile >> active >> x >> y >> z >> hp >> removed;
-            pigPosPool[i] = Vec3(x, y, z);
-            pigDataPool[i] = AnimalData(130, 10, 4.0f, 6.0f);
-            pigDataPool[i].health = hp;
-            if (removed == 1) {
-              pigActivePool[i] = false;
-              pigAIPool[i].shouldRemove = true;
-            } else if (active == 1) {
-              pigActivePool[i] = true;
-              pigAIPool[i].init(&pigInstPool[i], &pigDataPool[i], pigPosPool[i], false, Vec3(0, 0, 0));
-            } else {
-              pigActivePool[i] = false;
-            }
-          }
-          // Load bull data
-          for (int i = 0; i < nextBullIdx; i++) {
-            int active, hp, removed;
-            float x, y, z;
-            loadFile >> active >> x >> y >> z >> hp >> removed;
-            bullPosPool[i] = Vec3(x, y, z);
-            bullDataPool[i] = AnimalData(100, 20, 3.5f, 7.5f);
-            bullDataPool[i].health = hp;
-            if (removed == 1) {
-              bullActivePool[i] = false;
-              bullAIPool[i].shouldRemove = true;
-            } else if (active == 1) {
-              bullActivePool[i] = true;
-              bullAIPool[i].init(&bullInstPool[i], &bullDataPool[i], bullPosPool[i], false, Vec3(0, 0, 0));
-            } else {
-              bullActivePool[i] = false;
-            }
-          }
-          // Load duck data
-          for (int i = 0; i < nextDuckIdx; i++) {
-            int active, hp, removed;
-            float x, y, z;
-            loadFile >> active >> x >> y >> z >> hp >> removed;
-            duckPosPool[i] = Vec3(x, y, z);
-            duckDataPool[i] = AnimalData(40, 5, 2.0f, 10.0f);
-            duckDataPool[i].health = hp;
-            if (removed == 1) {
-              duckActivePool[i] = false;
-              duckAIPool[i].shouldRemove = true;
-            } else if (active == 1) {
-              duckActivePool[i] = true;
-              duckAIPool[i].init(&duckInstPool[i], &duckDataPool[i], duckPosPool[i], true, Vec3(0, 0, 0));
-            } else {
-              duckActivePool[i] = false;
+          enemies.clear();
+          for (int k = 0; k < SPECIES_COUNT; k++) {
+            for (int i = 0; i < enemyCounts[k]; i++) {
+              int active, hp, removed;
+              float x, y, z;
+              loadFile >> active >> x >> y >> z >> hp >> removed;
+              int slot = enemies.add((Species)k, Vec3(x, y, z));
+              if (slot < 0) {
+                continue;
+              }
+              enemies.data[slot].health = hp;
+              if (removed == 0 && active == 1) {
+                enemies.activate(slot, Vec3(0, 0, 0));
+              } else {
+                // Dead enemy kept out of play
+                enemies.controller[slot].shouldRemove = true;
+              }
             }
           }
 
@@ -687,16 +593,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         spawnTimer = 0.0f;
         spawnWave = 0;
         gameStarted = false;
-        nextGoatIdx = 0;
-        nextPigIdx = 0;
-        nextBullIdx = 0;
-        nextDuckIdx = 0;
-        for (int i = 0; i < MAX_ENEMIES; i++) {
-          goatActivePool[i] = false;
-          pigActivePool[i] = false;
-          bullActivePool[i] = false;
-          duckActivePool[i] = false;
-        }
+        enemies.clear();
         // Reset player position and gun state
         camera.position = Vec3(0, 1.5f, 0);
         camera.yaw = 0;
@@ -755,28 +652,18 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         for (const auto &barrel : explosiveBarrels) {
           saveFile << (barrel.isActive ? 1 : 0) << " " << barrel.health << "\n";
         }
-        // Enemy counts
-        saveFile << nextGoatIdx << " " << nextPigIdx << " " << nextBullIdx << " " << nextDuckIdx << "\n";
-        // Active enemy data
-        for (int i = 0; i < nextGoatIdx; i++) {
-          saveFile << (goatActivePool[i] ? 1 : 0) << " ";
-          saveFile << goatPosPool[i].x << " " << goatPosPool[i].y << " " << goatPosPool[i].z << " ";
-          saveFile << goatDataPool[i].health << " " << (goatAIPool[i].shouldRemove ? 1 : 0) << "\n";
+        // Enemy counts, then each species' enemies in slot order
+        for (int k = 0; k < SPECIES_COUNT; k++) {
+          saveFile << enemies.spawnedCount((Species)k) << (k + 1 < SPECIES_COUNT ? " " : "\n");
         }
-        for (int i = 0; i < nextPigIdx; i++) {
-          saveFile << (pigActivePool[i] ? 1 : 0) << " ";
-          saveFile << pigPosPool[i].x << " " << pigPosPool[i].y << " " << pigPosPool[i].z << " ";
-          saveFile << pigDataPool[i].health << " " << (pigAIPool[i].shouldRemove ? 1 : 0) << "\n";
-        }
-        for (int i = 0; i < nextBullIdx; i++) {
-          saveFile << (bullActivePool[i] ? 1 : 0) << " ";
-          saveFile << bullPosPool[i].x << " " << bullPosPool[i].y << " " << bullPosPool[i].z << " ";
-          saveFile << bullDataPool[i].health << " " << (bullAIPool[i].shouldRemove ? 1 : 0) << "\n";
-        }
-        for (int i = 0; i < nextDuckIdx; i++) {
-          saveFile << (duckActivePool[i] ? 1 : 0) << " ";
-          saveFile << duckPosPool[i].x << " " << duckPosPool[i].y << " " << duckPosPool[i].z << " ";
-          saveFile << duckDataPool[i].health << " " << (duckAIPool[i].shouldRemove ? 1 : 0) << "\n";
+        for (int k = 0; k < SPECIES_COUNT; k++) {
+          for (int i = 0; i < enemies.spawnedCount((Species)k); i++) {
+            int slot = enemies.slotOf((Species)k, i);
+            bool removed = enemies.controller[slot].shouldRemove;
+            saveFile << (removed ? 0 : 1) << " ";
+            saveFile << enemies.position[slot].x << " " << enemies.position[slot].y << " " << enemies.position[slot].z << " ";
+            saveFile << enemies.data[slot].health << " " << (removed ? 1 : 0) << "\n";
+          }
         }
         saveFile.close();
       }
@@ -811,7 +698,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     bool eJustPressed = window.keys['E'] && !prevKeyE;
     prevKeyE = window.keys['E'];
 
-    // Pickup interactions
+    // Pickup interactions. These test a handful of boxes on the frame E is pressed, each behind its own range and
+    // cooldown check, so they stay on the scalar ray test rather than being packed for rayAABBDistance4.
     if (eJustPressed && (foundHealBox || foundAmmoBox)) {
       Vec3 forward = Vec3(sinf(camera.yaw) * cosf(camera.pitch), sinf(camera.pitch), cosf(camera.yaw) * cosf(camera.pitch)).normalize();
 
@@ -885,26 +773,21 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     t += dt;
     Vec3 playerFeetPos = camera.position - Vec3(0, 1.5f, 0);
     AABB playerWorldAABB = playerLocalAABB.transform(playerFeetPos);
-    for (const auto &wall : sceneColliders) {CollisionInfo info = CollisionSystem::checkAABB(playerWorldAABB, wall);
+    sceneGrid.resolve(playerWorldAABB, nearbyColliders, [&](const AABB &wall) {
+      CollisionInfo info = CollisionSystem::checkAABB(playerWorldAABB, wall);
       if (info.collided) {
         CollisionSystem::resolveCollision(playerFeetPos, info);
         camera.position = playerFeetPos + Vec3(0, 1.5f, 0);
         playerWorldAABB = playerLocalAABB.transform(playerFeetPos);
       }
-    }
+      return playerWorldAABB;
+    });
 
     // Detect ground height
     float groundHeight = camera.defaultGroundY;
-    Vec3 playerXZ = Vec3(playerFeetPos.x, 0, playerFeetPos.z);
-    for (const auto &wall : sceneColliders) {
-      if (playerFeetPos.x >= wall.min.x && playerFeetPos.x <= wall.max.x && playerFeetPos.z >= wall.min.z && playerFeetPos.z <= wall.max.z) {
-        if (playerFeetPos.y >= wall.max.y - 0.5f) {
-          float surfaceHeight = wall.max.y + 1.5f;
-          if (surfaceHeight > groundHeight) {
-            groundHeight = surfaceHeight;
-          }
-        }
-      }
+    float surface = sceneHeights.surfaceBelow(playerFeetPos);
+    if (surface + 1.5f > groundHeight) {
+      groundHeight = surface + 1.5f;
     }
     camera.setGroundHeight(groundHeight);
 
@@ -915,11 +798,11 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
       spawnTimer = 0.0f;
       spawnWave = 0;
       // First wave (2 duck, 2 goat, 1 pig)
-      spawnEnemy("duck", spawnBackRight + Vec3(-2, 0, 0), entryTargetBack);
-      spawnEnemy("duck", spawnBackRight + Vec3(2, 0, 0), entryTargetBack);
-      spawnEnemy("goat", spawnBackRight + Vec3(-1, 0, 0), entryTargetBack);
-      spawnEnemy("goat", spawnBackRight + Vec3(1, 0, 0), entryTargetBack);
-      spawnEnemy("pig", spawnBackRight, entryTargetBack);
+      spawnEnemy(Species::DUCK, spawnBackRight + Vec3(-2, 0, 0), entryTargetBack);
+      spawnEnemy(Species::DUCK, spawnBackRight + Vec3(2, 0, 0), entryTargetBack);
+      spawnEnemy(Species::GOAT, spawnBackRight + Vec3(-1, 0, 0), entryTargetBack);
+      spawnEnemy(Species::GOAT, spawnBackRight + Vec3(1, 0, 0), entryTargetBack);
+      spawnEnemy(Species::PIG, spawnBackRight, entryTargetBack);
     }
     if (gameStarted) {
       spawnTimer += dt;
@@ -929,51 +812,42 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         spawnWave = (spawnWave + 1) % 2;
         if (spawnWave == 1) {
           // Front spawn (1 goat, 1 pig, 1 bull)
-          spawnEnemy("goat", spawnFrontLeft + Vec3(-1, 0, 0), entryTargetFront);
-          spawnEnemy("pig", spawnFrontLeft, entryTargetFront);
-          spawnEnemy("bull", spawnFrontLeft + Vec3(1, 0, 0), entryTargetFront);
+          spawnEnemy(Species::GOAT, spawnFrontLeft + Vec3(-1, 0, 0), entryTargetFront);
+          spawnEnemy(Species::PIG, spawnFrontLeft, entryTargetFront);
+          spawnEnemy(Species::BULL, spawnFrontLeft + Vec3(1, 0, 0), entryTargetFront);
         } else {
           // Back spawn (2 duck, 2 goat, 1 pig)
-          spawnEnemy("duck", spawnBackRight + Vec3(-2, 0, 0), entryTargetBack);
-          spawnEnemy("duck", spawnBackRight + Vec3(2, 0, 0), entryTargetBack);
-          spawnEnemy("goat", spawnBackRight + Vec3(-1, 0, 0), entryTargetBack);
-          spawnEnemy("goat", spawnBackRight + Vec3(1, 0, 0), entryTargetBack);
-          spawnEnemy("pig", spawnBackRight, entryTargetBack);
+          spawnEnemy(Species::DUCK, spawnBackRight + Vec3(-2, 0, 0), entryTargetBack);
+          spawnEnemy(Species::DUCK, spawnBackRight + Vec3(2, 0, 0), entryTargetBack);
+          spawnEnemy(Species::GOAT, spawnBackRight + Vec3(-1, 0, 0), entryTargetBack);
+          spawnEnemy(Species::GOAT, spawnBackRight + Vec3(1, 0, 0), entryTargetBack);
+          spawnEnemy(Species::PIG, spawnBackRight, entryTargetBack);
         }
       }
     }
 
     // Build animal colliders from active enemies
     AABB deadAABB(Vec3(0, 0, 0), Vec3(0, 0, 0));
-    animalColliders.clear();
+    JobCounter colliderJobs;
+    enemies.buildColliders(jobs, colliderJobs, animalColliders, ENEMY_JOB_GRAIN);
     std::vector<EnemyController *> activeEnemies;
-
-    for (int i = 0; i < nextGoatIdx; i++) {
-      if (goatActivePool[i] && !goatAIPool[i].shouldRemove) {
-        animalColliders.push_back(getAnimatedModelAABB("Goat-01", goatPosPool[i]));
-        activeEnemies.push_back(&goatAIPool[i]);
-      }
-    }
-    for (int i = 0; i < nextPigIdx; i++) {
-      if (pigActivePool[i] && !pigAIPool[i].shouldRemove) {
-        animalColliders.push_back(getAnimatedModelAABB("Pig", pigPosPool[i]));
-        activeEnemies.push_back(&pigAIPool[i]);
-      }
-    }
-    for (int i = 0; i < nextBullIdx; i++) {
-      if (bullActivePool[i] && !bullAIPool[i].shouldRemove) {
-        animalColliders.push_back(getAnimatedModelAABB("Bull-dark", bullPosPool[i]));
-        activeEnemies.push_back(&bullAIPool[i]);
-      }
+    for (int slot : enemies.live) {
+      activeEnemies.push_back(&enemies.controller[slot]);
     }
-    for (int i = 0; i < nextDuckIdx; i++) {
-      if (duckActivePool[i] && !duckAIPool[i].shouldRemove) {
-        animalColliders.push_back(getAnimatedModelAABB("Duck-mixed", duckPosPool[i]));
-        activeEnemies.push_back(&duckAIPool[i]);
-      }
-    }
-
-    for (int i = 0; i < animalColliders.size(); i++) {
+    enemies.buildCrowd();
+    jobs.wait(colliderJobs);
+    enemyTree.refit(animalColliders);
+
+    // Only the animals near the player are tested, in the same order as before. A player pushed further than
+    // searchMargin from where the search was made is searched around again, carrying on past the last one tested.
+    Vec3 playerExtent = (playerLocalAABB.max - playerLocalAABB.min) * 0.5f;
+    const float searchMargin = 1.0f;
+    float searchRadius = enemies.reach() + Vec3(playerExtent.x, 0, playerExtent.z).length() + searchMargin;
+    Vec3 searchCentre = (playerWorldAABB.min + playerWorldAABB.max) * 0.5f;
+    nearbyEnemies.clear();
+    enemies.crowd.queryRadius(searchCentre, searchRadius, nearbyEnemies);
+    for (size_t next = 0; next < nearbyEnemies.size();) {
+      int i = nearbyEnemies[next++];
       CollisionInfo info = CollisionSystem::checkAABB(playerWorldAABB, animalColliders[i]);
       if (info.collided) {
         if (fabsf(info.normal.y) > 0.5f) {
@@ -990,13 +864,29 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         }
         camera.position = playerFeetPos + Vec3(0, 1.5f, 0);
         playerWorldAABB = playerLocalAABB.transform(playerFeetPos);
+        Vec3 centre = (playerWorldAABB.min + playerWorldAABB.max) * 0.5f;
+        if (Vec3(centre.x - searchCentre.x, 0, centre.z - searchCentre.z).length() > searchMargin) {
+          searchCentre = centre;
+          nearbyEnemies.clear();
+          enemies.crowd.queryRadius(searchCentre, searchRadius, nearbyEnemies);
+          next = std::upper_bound(nearbyEnemies.begin(), nearbyEnemies.end(), i) - nearbyEnemies.begin();
+        }
       }
     }
+    // Paths toward the player's feet, searched again only when the player changes cell. The search runs on a
+    // worker while the static models are drawn.
+    JobCounter flowJob;
+    Vec3 flowTarget = camera.position - Vec3(0, 1.5f, 0);
+    jobs.run(flowJob, [&enemyFlow, flowTarget, FLOW_CELLS_PER_FRAME] { enemyFlow.update(flowTarget, FLOW_CELLS_PER_FRAME); });
+
     lightData.cameraPos = camera.position;
     Matrix p = Matrix::perspective(0.01f, 10000.0f, (float)WIDTH / (float)HEIGHT, 60.0f);
     Matrix v = camera.getViewMatrix();
     Matrix vp = v * p;
     core.beginRenderPass();
+    for (size_t i = 0; i < explosiveBarrels.size(); i++) {
+      barrelModel->setInstanceHidden(i, !explosiveBarrels[i].isActive);
+    }
     for (auto it = staticModels.begin(); it != staticModels.end(); ++it) {
         StaticModel* model = it->second;
         if (it->first == "grass_003") {
@@ -1005,52 +895,40 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         else {
             model->drawInstanced(&core, &psos, &shaders, vp, &textures, lightData);
         }
+        cullTotals.add(model->cullStats);
     }
-    StaticModel* barrelModel = staticModels["barrel_003"];
-    if (barrelModel) {
-      barrelModel->clearInstances();
-      for (const auto &barrel : explosiveBarrels) {
-        if (barrel.isActive) {
-          Matrix scale = Matrix::scaling(Vec3(0.01f, 0.01f, 0.01f));
-          Matrix trans = Matrix::translation(barrel.position);
-          barrelModel->addInstance(scale * trans);
-        }
-      }
-      barrelModel->uploadInstances(&core);
-      barrelModel->drawInstanced(&core, &psos, &shaders, vp, &textures, lightData);
-    }
-    // Update enemy AI and get damage to player
-    int enemyDamage = 0;
-    int totalDamage = 0;
+    // Animation LOD from distance and visibility, tested against the bounds used for collisions
+    Frustum viewFrustum = Frustum::fromViewProjection(vp);
+
+    // Update enemy AI and get damage to player, once the path search is done
+    EnemyFrame enemyFrame;
+    enemyFrame.dt = dt;
+    enemyFrame.playerPos = camera.position;
+    enemyFrame.colliders = &enemySceneGrid;
+    enemyFrame.ground = &enemySceneHeights;
+    enemyFrame.flow = &enemyFlow;
+    enemyFrame.lod = &animationLOD;
+    enemyFrame.view = &viewFrustum;
+    enemyFrame.ai = &aiLOD;
+    enemyFrame.crowd = &enemies.crowd;
+    JobCounter enemyJobs;
+    enemies.update(jobs, enemyJobs, enemyFrame, ENEMY_JOB_GRAIN, &flowJob);
+    jobs.wait(enemyJobs);
+    // With no enemies alive nothing waited on the search, and it must not outlive flowJob or overlap the next one
+    jobs.wait(flowJob);
 
-    for (int i = 0; i < nextGoatIdx; i++) {
-      if (goatActivePool[i] && !goatAIPool[i].shouldRemove) {
-        goatAIPool[i].update(dt, camera.position, enemyDamage, &enemySceneColliders, "Goat-01");
-        totalDamage += enemyDamage;
-        goatPosPool[i] = goatAIPool[i].position;
-      }
-    }
-    for (int i = 0; i < nextPigIdx; i++) {
-      if (pigActivePool[i] && !pigAIPool[i].shouldRemove) {
-        pigAIPool[i].update(dt, camera.position, enemyDamage, &enemySceneColliders, "Pig");
-        totalDamage += enemyDamage;
-        pigPosPool[i] = pigAIPool[i].position;
-      }
-    }
-    for (int i = 0; i < nextBullIdx; i++) {
-      if (bullActivePool[i] && !bullAIPool[i].shouldRemove) {
-        bullAIPool[i].update(dt, camera.position, enemyDamage, &enemySceneColliders, "Bull-dark");
-        totalDamage += enemyDamage;
-        bullPosPool[i] = bullAIPool[i].position;
-      }
-    }
-    for (int i = 0; i < nextDuckIdx; i++) {
-      if (duckActivePool[i] && !duckAIPool[i].shouldRemove) {
-        duckAIPool[i].update(dt, camera.position, enemyDamage, &enemySceneColliders, "Duck-mixed");
-        totalDamage += enemyDamage;
-        duckPosPool[i] = duckAIPool[i].position;
-      }
+    int totalDamage = 0;
+    AnimationLODStats animationBones;
+    for (int i = 0; i < (int)enemies.live.size(); i++) {
+      totalDamage += enemies.damage[i];
+      animationBones.evaluated += enemies.bonesEvaluated[i];
+      animationBones.fullRate += enemies.info(enemies.live[i]).animation->bonesSize();
     }
+    enemies.removeFinished();
+    // Again for the area damage below, now that the enemies have moved and some have gone
+    enemies.buildCrowd();
+    animationTotals.add(animationBones);
+    aiTotals.add(enemies.aiStats);
 
     // Apply enemy damage to player
     if (totalDamage > 0) {
@@ -1071,7 +949,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
       Vec3 forward = Vec3(sinf(camera.yaw) * cosf(camera.pitch), sinf(camera.pitch), cosf(camera.yaw) * cosf(camera.pitch)).normalize();
       bulletSystem.spawn();
       bulletSystem.spawn();
-      HitResult hitResult = bulletSystem.checkHit(camera.position, forward, activeEnemies, animalColliders, sceneColliders, gunCtrl.getDamage());
+      HitResult hitResult = bulletSystem.checkHit(camera.position, forward, activeEnemies, enemyTree, sceneTree, gunCtrl.getDamage());
       if (hitResult == HitResult::KILL) {
         hitMarker.triggerKill();
         soundManager.play("Resources/hit.wav");
@@ -1148,7 +1026,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
             const float explosionRadius = 5.0f;
             const int explosionDamage = 60;
 
-            auto damageEnemy = [&](EnemyController &ai, Vec3 &pos, bool isDuck) {
+            auto damageEnemy = [&](EnemyController &ai, const Vec3 &pos) {
               if (ai.shouldRemove)
                 return;
               Vec3 toEnemy = pos - barrel.position;
@@ -1164,21 +1042,10 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
               }
             };
 
-            for (int i = 0; i < nextGoatIdx; i++) {
-              if (goatActivePool[i])
-                damageEnemy(goatAIPool[i], goatPosPool[i], false);
-            }
-            for (int i = 0; i < nextPigIdx; i++) {
-              if (pigActivePool[i])
-                damageEnemy(pigAIPool[i], pigPosPool[i], false);
-            }
-            for (int i = 0; i < nextBullIdx; i++) {
-              if (bullActivePool[i])
-                damageEnemy(bullAIPool[i], bullPosPool[i], false);
-            }
-            for (int i = 0; i < nextDuckIdx; i++) {
-              if (duckActivePool[i])
-                damageEnemy(duckAIPool[i], duckPosPool[i], true);
+            nearbyEnemies.clear();
+            enemies.crowd.queryRadius(barrel.position, explosionRadius, nearbyEnemies);
+            for (int i : nearbyEnemies) {
+              damageEnemy(enemies.controller[enemies.live[i]], enemies.position[enemies.live[i]]);
             }
 
             // Damage player if in explosion radius
@@ -1240,7 +1107,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
       bool meleeHit = false;
       bool meleeKill = false;
 
-      auto handleMelee = [&](EnemyController &enemy, Vec3 &enemyPos) {
+      auto handleMelee = [&](EnemyController &enemy, const Vec3 &enemyPos) {
         if (enemy.shouldRemove)
           return;
 
@@ -1260,21 +1127,10 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
         }
       };
 
-      for (int i = 0; i < nextGoatIdx; i++) {
-        if (goatActivePool[i])
-          handleMelee(goatAIPool[i], goatPosPool[i]);
-      }
-      for (int i = 0; i < nextPigIdx; i++) {
-        if (pigActivePool[i])
-          handleMelee(pigAIPool[i], pigPosPool[i]);
-      }
-      for (int i = 0; i < nextBullIdx; i++) {
-        if (bullActivePool[i])
-          handleMelee(bullAIPool[i], bullPosPool[i]);
-      }
-      for (int i = 0; i < nextDuckIdx; i++) {
-        if (duckActivePool[i])
-          handleMelee(duckAIPool[i], duckPosPool[i]);
+      nearbyEnemies.clear();
+      enemies.crowd.queryCone(camera.position, forward, 4.0f, 0.5f, nearbyEnemies);
+      for (int i : nearbyEnemies) {
+        handleMelee(enemies.controller[enemies.live[i]], enemies.position[enemies.live[i]]);
       }
 
       // Trigger hitmarker for melee attacks
@@ -1321,7 +1177,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
               const float explosionRadius = 5.0f;
               const int explosionDamage = 60;
 
-              auto damageEnemyMelee = [&](EnemyController &ai, Vec3 &pos) {
+              auto damageEnemyMelee = [&](EnemyController &ai, const Vec3 &pos) {
                 if (ai.shouldRemove)
                   return;
                 Vec3 toEnemy = pos - barrel.position;
@@ -1336,21 +1192,10 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
                 }
               };
 
-              for (int i = 0; i < nextGoatIdx; i++) {
-                if (goatActivePool[i])
-                  damageEnemyMelee(goatAIPool[i], goatPosPool[i]);
-              }
-              for (int i = 0; i < nextPigIdx; i++) {
-                if (pigActivePool[i])
-                  damageEnemyMelee(pigAIPool[i], pigPosPool[i]);
-              }
-              for (int i = 0; i < nextBullIdx; i++) {
-                if (bullActivePool[i])
-                  damageEnemyMelee(bullAIPool[i], bullPosPool[i]);
-              }
-              for (int i = 0; i < nextDuckIdx; i++) {
-                if (duckActivePool[i])
-                  damageEnemyMelee(duckAIPool[i], duckPosPool[i]);
+              nearbyEnemies.clear();
+              enemies.crowd.queryRadius(barrel.position, explosionRadius, nearbyEnemies);
+              for (int i : nearbyEnemies) {
+                damageEnemyMelee(enemies.controller[enemies.live[i]], enemies.position[enemies.live[i]]);
               }
 
               Vec3 toPlayer = camera.position - barrel.position;
@@ -1389,30 +1234,16 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     Matrix commonScale = Matrix::scaling(Vec3(0.01f, 0.01f, 0.01f));
     float modelYawOffset = 0.0f;
 
-    // Draw enemies
-    for (int i = 0; i < nextGoatIdx; i++) {
-      if (goatActivePool[i] && !goatAIPool[i].shouldRemove) {
-        Matrix W = commonScale * Matrix::rotateY(goatAIPool[i].yaw + modelYawOffset) * Matrix::translation(goatPosPool[i]);
-        goatModel.draw(&core, &psos, &shaders, &goatInstPool[i], vp, W, &textures, lightData);
-      }
-    }
-    for (int i = 0; i < nextPigIdx; i++) {
-      if (pigActivePool[i] && !pigAIPool[i].shouldRemove) {
-        Matrix W = commonScale * Matrix::rotateY(pigAIPool[i].yaw + modelYawOffset) * Matrix::translation(pigPosPool[i]);
-        pigModel.draw(&core, &psos, &shaders, &pigInstPool[i], vp, W, &textures, lightData);
-      }
+    // Draw enemies, each species' instances collected into its model in one pass
+    for (AnimatedModel *model : speciesModels) {
+      model->beginInstances();
     }
-    for (int i = 0; i < nextBullIdx; i++) {
-      if (bullActivePool[i] && !bullAIPool[i].shouldRemove) {
-        Matrix W = commonScale * Matrix::rotateY(bullAIPool[i].yaw + modelYawOffset) * Matrix::translation(bullPosPool[i]);
-        bullModel.draw(&core, &psos, &shaders, &bullInstPool[i], vp, W, &textures, lightData);
-      }
+    for (int slot : enemies.live) {
+      Matrix W = commonScale * Matrix::rotateY(enemies.yaw[slot] + modelYawOffset) * Matrix::translation(enemies.position[slot]);
+      speciesModels[(int)enemies.species[slot]]->addInstance(&enemies.animation[slot], W);
     }
-    for (int i = 0; i < nextDuckIdx; i++) {
-      if (duckActivePool[i] && !duckAIPool[i].shouldRemove) {
-        Matrix W = commonScale * Matrix::rotateY(duckAIPool[i].yaw + modelYawOffset) * Matrix::translation(duckPosPool[i]);
-        duckModel.draw(&core, &psos, &shaders, &duckInstPool[i], vp, W, &textures, lightData);
-      }
+    for (AnimatedModel *model : speciesModels) {
+      model->drawInstances(&core, &psos, &shaders, vp, &textures, lightData);
     }
 
     Matrix camWorld = v;
@@ -1451,25 +1282,9 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     gameUI.drawProgressBar(&core, &shaders, &psos, taskProgress, taskCompleted);
 
     // Draw enemy health bars 
-    for (int i = 0; i < nextGoatIdx; i++) {
-      if (goatActivePool[i] && !goatAIPool[i].shouldRemove) {
-        gameUI.drawEnemyHealth(&core, &shaders, &psos, vp, goatPosPool[i], goatDataPool[i].health, goatDataPool[i].maxHealth, 1.5f);
-      }
-    }
-    for (int i = 0; i < nextPigIdx; i++) {
-      if (pigActivePool[i] && !pigAIPool[i].shouldRemove) {
-        gameUI.drawEnemyHealth(&core, &shaders, &psos, vp, pigPosPool[i], pigDataPool[i].health, pigDataPool[i].maxHealth, 1.0f);
-      }
-    }
-    for (int i = 0; i < nextBullIdx; i++) {
-      if (bullActivePool[i] && !bullAIPool[i].shouldRemove) {
-        gameUI.drawEnemyHealth(&core, &shaders, &psos, vp, bullPosPool[i], bullDataPool[i].health, bullDataPool[i].maxHealth, 2.0f);
-      }
-    }
-    for (int i = 0; i < nextDuckIdx; i++) {
-      if (duckActivePool[i] && !duckAIPool[i].shouldRemove) {
-        gameUI.drawEnemyHealth(&core, &shaders, &psos, vp, duckPosPool[i], duckDataPool[i].health, duckDataPool[i].maxHealth, 1.0f);
-      }
+    for (int slot : enemies.live) {
+      gameUI.drawEnemyHealth(&core, &shaders, &psos, vp, enemies.position[slot], enemies.data[slot].health,
+                             enemies.data[slot].maxHealth, enemies.info(slot).healthBarHeight);
     }
 
     // Draw bullets
@@ -1500,10 +1315,35 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PSTR lpCmdLine, int nC
     }
 
     core.finishFrame();
+    cullFrames++;
   }
 
   core.flushGraphicsQueue();
 
+  if (cullFrames > 0) {
+    std::cout << "Frustum culling: " << (double)cullTotals.visible / cullFrames << " of " << (double)cullTotals.tested / cullFrames
+              << " static instances visible per frame over " << cullFrames << " frames" << std::endl;
+  }
+  if (cullFrames > 0 && animationTotals.fullRate > 0) {
+    std::cout << "Animation LOD: " << (double)animationTotals.evaluated / cullFrames << " of " << (double)animationTotals.fullRate / cullFrames
+              << " enemy bones evaluated per frame" << std::endl;
+  }
+  if (cullFrames > 0 && aiTotals.updates > 0) {
+    std::cout << "Enemy AI: " << (double)aiTotals.decisions / cullFrames << " of " << (double)aiTotals.updates / cullFrames
+              << " enemy updates in full per frame, " << (double)aiTotals.deferred / cullFrames << " decisions put off by the budget"
+              << std::endl;
+  }
+  for (AnimatedModel *model : {&goatModel, &pigModel, &bullModel, &duckModel}) {
+    if (model->poseCache.hits + model->poseCache.misses > 0) {
+      std::cout << "Pose cache: " << model->poseCache.hits << " shared and " << model->poseCache.misses << " evaluated poses, "
+                << model->poseCache.refs.size() << " slots" << std::endl;
+    }
+  }
+  std::cout << "Constant allocator: " << core.constantAllocator.pagesAdded << " pages added, at most "
+            << core.constantAllocator.peakFrameBytes << " bytes in one frame" << std::endl;
+  std::cout << "Instance uploads: " << core.totalUploadBytes << " bytes in total, at most " << core.peakFrameUploadBytes << " bytes in one frame"
+            << std::endl;
+
   for (auto &pair : staticModels) {
     delete pair.second;
   }
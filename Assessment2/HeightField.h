@@ -0,0 +1,143 @@
+#pragma once
+#include "Collision.h"
+#include <algorithm>
+#include <cfloat>
+#include <vector>
+
+// The tops of the level colliders baked into a fine grid over the x / z plane, so finding the ground under an
+// entity is one cell lookup. A cell takes the tops of every collider covering its centre, so answers can differ from
+// testing the colliders themselves only within one cell of a collider's edge.
+class HeightField {
+public:
+  void build(const std::vector<AABB> &colliders, float size = 0.25f) {
+    cellSize = size;
+    overflowCells = 0;
+    if (colliders.empty()) {
+      columns = rows = 0;
+      cells.clear();
+      return;
+    }
+    originX = originZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxZ = -FLT_MAX;
+    for (const auto &box : colliders) {
+      originX = std::min(originX, box.min.x);
+      originZ = std::min(originZ, box.min.z);
+      maxX = std::max(maxX, box.max.x);
+      maxZ = std::max(maxZ, box.max.z);
+    }
+    cellSize = std::max(cellSize, std::max(maxX - originX, maxZ - originZ) / MAX_CELLS_PER_AXIS);
+    invCellSize = 1.0f / cellSize;
+    columns = cellX(maxX) + 1;
+    rows = cellZ(maxZ) + 1;
+    cells.assign(columns * rows, Cell());
+    for (const auto &box : colliders) {
+      bake(box);
+    }
+  }
+
+  // Bakes the cells under area again from colliders, for when a collider there is added, removed or moved. The
+  // new colliders must lie inside the area the field was built over.
+  void patch(const AABB &area, const std::vector<AABB> &colliders) {
+    int x0, z0, x1, z1;
+    if (!coveredCells(area, x0, z0, x1, z1)) {
+      return;
+    }
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        cells[z * columns + x] = Cell();
+      }
+    }
+    AABB patched(Vec3(originX + x0 * cellSize, -FLT_MAX, originZ + z0 * cellSize),
+                 Vec3(originX + (x1 + 1) * cellSize, FLT_MAX, originZ + (z1 + 1) * cellSize));
+    for (const auto &box : colliders) {
+      AABB clipped(Vec3(std::max(box.min.x, patched.min.x), box.min.y, std::max(box.min.z, patched.min.z)),
+                   Vec3(std::min(box.max.x, patched.max.x), box.max.y, std::min(box.max.z, patched.max.z)));
+      if (clipped.min.x <= clipped.max.x && clipped.min.z <= clipped.max.z) {
+        bake(clipped);
+      }
+    }
+  }
+
+  // Same answer as ColliderGrid::surfaceBelow: the highest top under the point that is no more than stepHeight
+  // above it, or -FLT_MAX if there is none
+  float surfaceBelow(const Vec3 &p, float stepHeight = 0.5f) const {
+    int x = cellX(p.x);
+    int z = cellZ(p.z);
+    if (x < 0 || z < 0 || x >= columns || z >= rows) {
+      return -FLT_MAX;
+    }
+    const Cell &cell = cells[z * columns + x];
+    for (int i = 0; i < cell.count; i++) {
+      if (p.y >= cell.tops[i] - stepHeight) {
+        return cell.tops[i];
+      }
+    }
+    return -FLT_MAX;
+  }
+
+  int cellCount() const { return columns * rows; }
+  float resolution() const { return cellSize; }
+  int overflowCells = 0; // Cells with more distinct tops than MAX_LAYERS, which keep the highest
+
+private:
+  static const int MAX_CELLS_PER_AXIS = 1024;
+  static const int MAX_LAYERS = 4;
+
+  // Distinct collider tops over the cell, highest first
+  struct Cell {
+    float tops[MAX_LAYERS];
+    int count = 0;
+  };
+
+  float cellSize = 0.25f;
+  float invCellSize = 4.0f;
+  float originX = 0.0f, originZ = 0.0f;
+  int columns = 0, rows = 0;
+  std::vector<Cell> cells;
+
+  int cellX(float x) const { return (int)floorf((x - originX) * invCellSize); }
+  int cellZ(float z) const { return (int)floorf((z - originZ) * invCellSize); }
+
+  // Range of cells whose centres lie inside the footprint of box, false if there are none
+  bool coveredCells(const AABB &box, int &x0, int &z0, int &x1, int &z1) const {
+    x0 = std::max((int)ceilf((box.min.x - originX) * invCellSize - 0.5f), 0);
+    z0 = std::max((int)ceilf((box.min.z - originZ) * invCellSize - 0.5f), 0);
+    x1 = std::min((int)floorf((box.max.x - originX) * invCellSize - 0.5f), columns - 1);
+    z1 = std::min((int)floorf((box.max.z - originZ) * invCellSize - 0.5f), rows - 1);
+    return x0 <= x1 && z0 <= z1;
+  }
+
+  void bake(const AABB &box) {
+    int x0, z0, x1, z1;
+    if (!coveredCells(box, x0, z0, x1, z1)) {
+      return;
+    }
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        addTop(cells[z * columns + x], box.max.y);
+      }
+    }
+  }
+
+  void addTop(Cell &cell, float top) {
+    int i = 0;
+    while (i < cell.count && cell.tops[i] > top) {
+      i++;
+    }
+    if (i < cell.count && cell.tops[i] == top) {
+      return;
+    }
+    if (cell.count == MAX_LAYERS) {
+      overflowCells++;
+      if (i == MAX_LAYERS) {
+        return;
+      }
+    } else {
+      cell.count++;
+    }
+    for (int j = cell.count - 1; j > i; j--) {
+      cell.tops[j] = cell.tops[j - 1];
+    }
+    cell.tops[i] = top;
+  }
+};
@@ -0,0 +1,199 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the unfinished jobs started against it. Wait on it with JobSystem::wait, or pass it as the after of
+// other jobs to hold them back until it reaches zero. It can be reused once it has.
+class JobCounter {
+public:
+  bool done() {
+    std::lock_guard<std::mutex> guard(mutex);
+    return pending == 0;
+  }
+
+private:
+  friend class JobSystem;
+  struct Job {
+    std::function<void()> task;
+    JobCounter *counter = nullptr;
+  };
+  // pending and held only change under the mutex, and the last job to finish releases it before anyone waiting
+  // can see zero, so a counter on the waiter's stack is never touched after the wait returns
+  std::mutex mutex;
+  int pending = 0;
+  std::vector<Job> held; // Jobs waiting for this counter to reach zero
+};
+
+// Work-stealing scheduler for the per-frame passes. Each thread has its own queue: it takes the newest job from
+// the back of its own queue, and when that is empty steals the oldest from the front of another's. The thread
+// that calls start() is thread 0 and runs jobs while it waits, so start(1) runs everything on the caller.
+class JobSystem {
+public:
+  ~JobSystem() { stop(); }
+
+  void start(int threads) {
+    stop();
+    threads = std::max(threads, 1);
+    queues.clear();
+    for (int t = 0; t < threads; t++) {
+      queues.push_back(std::unique_ptr<Queue>(new Queue()));
+    }
+    running = true;
+    for (int t = 1; t < threads; t++) {
+      workers.emplace_back([this, t] { work(t); });
+    }
+  }
+
+  // Jobs still queued are dropped, so wait for everything started first
+  void stop() {
+    {
+      std::lock_guard<std::mutex> guard(sleepMutex);
+      running = false;
+    }
+    wake.notify_all();
+    for (std::thread &worker : workers) {
+      worker.join();
+    }
+    workers.clear();
+  }
+
+  int threadCount() const { return (int)queues.size(); }
+
+  // Queues task against counter, or holds it until after reaches zero if after is given
+  void run(JobCounter &counter, std::function<void()> task, JobCounter *after = nullptr) {
+    JobCounter::Job job;
+    job.task = std::move(task);
+    job.counter = &counter;
+    {
+      std::lock_guard<std::mutex> guard(counter.mutex);
+      counter.pending++;
+    }
+    if (after != nullptr) {
+      std::lock_guard<std::mutex> guard(after->mutex);
+      if (after->pending > 0) {
+        after->held.push_back(std::move(job));
+        return;
+      }
+    }
+    push(std::move(job));
+  }
+
+  // Runs body(begin, end) over [0, count) in ranges of up to grain, as one job each. With count 0 nothing is
+  // queued, so waiting on counter does not wait for after; wait on after as well if that matters.
+  void parallelFor(JobCounter &counter, int count, int grain, const std::function<void(int, int)> &body,
+                   JobCounter *after = nullptr) {
+    grain = std::max(grain, 1);
+    for (int begin = 0; begin < count; begin += grain) {
+      int end = std::min(begin + grain, count);
+      run(counter, [body, begin, end] { body(begin, end); }, after);
+    }
+  }
+
+  // Runs queued jobs, this thread's first, until counter reaches zero
+  void wait(JobCounter &counter) {
+    int self = threadIndex();
+    while (!counter.done()) {
+      if (!runOne(self)) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<JobCounter::Job> jobs;
+  };
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::atomic<int> queued{0};
+  std::mutex sleepMutex;
+  std::condition_variable wake;
+  bool running = false;
+
+  // Index of the calling thread's queue. Threads the system did not start share queue 0 with the one that did.
+  static int &threadIndex() {
+    thread_local int index = 0;
+    return index;
+  }
+
+  void push(JobCounter::Job job) {
+    Queue &queue = *queues[std::min(threadIndex(), (int)queues.size() - 1)];
+    {
+      std::lock_guard<std::mutex> guard(queue.mutex);
+      queue.jobs.push_back(std::move(job));
+    }
+    queued++;
+    // Taking the lock orders this against a worker checking queued before it sleeps, so the wake is not lost
+    { std::lock_guard<std::mutex> guard(sleepMutex); }
+    wake.notify_one();
+  }
+
+  bool take(int self, JobCounter::Job &job) {
+    {
+      Queue &own = *queues[self];
+      std::lock_guard<std::mutex> guard(own.mutex);
+      if (!own.jobs.empty()) {
+        job = std::move(own.jobs.back());
+        own.jobs.pop_back();
+        return true;
+      }
+    }
+    for (int i = 1; i < (int)queues.size(); i++) {
+      Queue &victim = *queues[(self + i) % queues.size()];
+      std::lock_guard<std::mutex> guard(victim.mutex);
+      if (!victim.jobs.empty()) {
+        job = std::move(victim.jobs.front());
+        victim.jobs.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool runOne(int self) {
+    JobCounter::Job job;
+    if (!take(self, job)) {
+      return false;
+    }
+    queued--;
+    job.task();
+    finish(*job.counter);
+    return true;
+  }
+
+  // Jobs held back by the counter are queued on this thread once its last job is done
+  void finish(JobCounter &counter) {
+    std::vector<JobCounter::Job> released;
+    {
+      std::lock_guard<std::mutex> guard(counter.mutex);
+      if (--counter.pending == 0) {
+        released.swap(counter.held);
+      }
+    }
+    for (JobCounter::Job &job : released) {
+      push(std::move(job));
+    }
+  }
+
+  void work(int self) {
+    threadIndex() = self;
+    while (true) {
+      if (runOne(self)) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wake.wait(lock, [this] { return queued > 0 || !running; });
+      if (!running) {
+        return;
+      }
+    }
+  }
+};
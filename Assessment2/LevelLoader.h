@@ -14,6 +14,13 @@ struct LevelObject {
   float rotation; 
   float scale;
   bool hasCollision;
+
+  Matrix transform() const {
+    Matrix scaleMatrix = Matrix::scaling(Vec3(scale, scale, scale));
+    Matrix rot = Matrix::rotateY(rotation * 3.14159f / 180.0f);
+    Matrix trans = Matrix::translation(position);
+    return scaleMatrix * rot * trans;
+  }
 };
 
 // Level loader from txt file
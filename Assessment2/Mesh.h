@@ -76,13 +76,13 @@ public:
 class Mesh
 {
 public:
-	ID3D12Resource* vertexBuffer;
-	ID3D12Resource* indexBuffer;
+	ID3D12Resource* vertexBuffer = nullptr;
+	ID3D12Resource* indexBuffer = nullptr;
 	D3D12_VERTEX_BUFFER_VIEW vbView;
 	D3D12_INDEX_BUFFER_VIEW ibView;
 	D3D12_INPUT_LAYOUT_DESC inputLayoutDesc;
 	unsigned int numMeshIndices;
-	void init(Core* core, void* vertices, int vertexSizeInBytes, int numVertices, unsigned int* indices, int numIndices)
+	void init(Core* core, const void* vertices, int vertexSizeInBytes, int numVertices, const unsigned int* indices, int numIndices)
 	{
 		D3D12_HEAP_PROPERTIES heapprops;
 		memset(&heapprops, 0, sizeof(D3D12_HEAP_PROPERTIES));
@@ -103,7 +103,7 @@ public:
 		HRESULT hr;
 		hr = core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &vbDesc, D3D12_RESOURCE_STATE_COMMON, NULL, IID_PPV_ARGS(&vertexBuffer));
 
-		core->uploadResource(vertexBuffer, vertices, numVertices * vertexSizeInBytes, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+		core->uploadResource(vertexBuffer, vertices, numVertices * vertexSizeInBytes);
 
 		D3D12_RESOURCE_DESC ibDesc;
 		memset(&ibDesc, 0, sizeof(D3D12_RESOURCE_DESC));
@@ -117,7 +117,7 @@ public:
 		ibDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
 		hr = core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &ibDesc, D3D12_RESOURCE_STATE_COMMON, NULL, IID_PPV_ARGS(&indexBuffer));
 
-		core->uploadResource(indexBuffer, indices, numIndices * sizeof(unsigned int), D3D12_RESOURCE_STATE_INDEX_BUFFER);
+		core->uploadResource(indexBuffer, indices, numIndices * sizeof(unsigned int));
 
 		vbView.BufferLocation = vertexBuffer->GetGPUVirtualAddress();
 		vbView.StrideInBytes = vertexSizeInBytes;
@@ -1,12 +1,16 @@
 #pragma once
 #include "Animation.h"
+#include "BVH.h"
 #include "Camera.h"
 #include "Collision.h"
 #include "Controller.h"
 #include "Core.h"
+#include "Frustum.h"
+#include "GEMCache.h"
 #include "GEMLoader.h"
 #include "Maths.h"
 #include "Mesh.h"
+#include "ModelData.h"
 #include "PSO.h"
 #include "Shaders.h"
 #include "Texture.h"
@@ -267,9 +271,25 @@ public:
 // Game UI
 class GameUI {
 private:
+  struct UIShader {
+    ShaderHandle shader;
+    ID3D12PipelineState *pso = nullptr;
+    ConstantHandle vp, w;
+  };
+
   Mesh barMesh;
   bool initialized = false;
   float aspectRatio = 16.0f / 9.0f;
+  UIShader green, red, black, blue, darkBlue, yellow;
+
+  UIShader resolveUIShader(Shaders *shaders, PSOManager *psos, const std::string &name) {
+    UIShader ui;
+    ui.shader = shaders->resolve(name);
+    ui.pso = psos->find(name + "PSO");
+    ui.vp = shaders->resolveConstantVS(name, "staticMeshBuffer", "VP");
+    ui.w = shaders->resolveConstantVS(name, "staticMeshBuffer", "W");
+    return ui;
+  }
 
   void createBarMesh(Core *core, Shaders *shaders, PSOManager *psos) {
     std::vector<STATIC_VERTEX> vertices;
@@ -304,11 +324,18 @@ private:
     psos->createPSO(core, "UIDarkBluePSO", shaders->find("UIDarkBlue")->vs, shaders->find("UIDarkBlue")->ps, VertexLayoutCache::getStaticLayout());
     psos->createPSO(core, "UIYellowPSO", shaders->find("UIYellow")->vs, shaders->find("UIYellow")->ps, VertexLayoutCache::getStaticLayout());
 
+    green = resolveUIShader(shaders, psos, "UIGreen");
+    red = resolveUIShader(shaders, psos, "UIRed");
+    black = resolveUIShader(shaders, psos, "UIBlack");
+    blue = resolveUIShader(shaders, psos, "UIBlue");
+    darkBlue = resolveUIShader(shaders, psos, "UIDarkBlue");
+    yellow = resolveUIShader(shaders, psos, "UIYellow");
+
     initialized = true;
   }
 
   void drawRect(Core *core, Shaders *shaders, PSOManager *psos, float x, float y, float width, float height,
-                const std::string &shaderName, const std::string &psoName, float zOffset = 0.0f) {
+                const UIShader &ui, float zOffset = 0.0f) {
     if (!initialized)
       return;
 
@@ -317,10 +344,10 @@ private:
     Matrix w = scale * trans;
     Matrix identity;
 
-    shaders->updateConstantVS(shaderName, "staticMeshBuffer", "VP", &identity);
-    shaders->updateConstantVS(shaderName, "staticMeshBuffer", "W", &w);
-    shaders->apply(core, shaderName);
-    psos->bind(core, psoName);
+    Shaders::updateConstant(ui.vp, &identity);
+    Shaders::updateConstant(ui.w, &w);
+    shaders->apply(core, ui.shader);
+    psos->bind(core, ui.pso);
     barMesh.draw(core);
   }
 
@@ -334,31 +361,31 @@ public:
     float t = 0.004f;
     float tY = t / aspectRatio;
     // Black background (border)
-    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, "UIBlack", "UIBlackPSO", 0.2f);
+    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, black, 0.2f);
     // Red background (middle)
-    drawRect(core, shaders, psos, x, y, width, height, "UIRed", "UIRedPSO", 0.1f);
+    drawRect(core, shaders, psos, x, y, width, height, red, 0.1f);
     // Green fill (front)
     if (percent > 0.01f) {
-      drawRect(core, shaders, psos, x, y, width * percent, height, "UIGreen", "UIGreenPSO", 0.0f);
+      drawRect(core, shaders, psos, x, y, width * percent, height, green, 0.0f);
     }
   }
 
   void drawAmmoBar(Core *core, Shaders *shaders, PSOManager *psos, float x, float y, float width, float height, float percent) {
     float t = 0.004f;
     float tY = t / aspectRatio;
-    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, "UIBlack", "UIBlackPSO", 0.2f);
-    drawRect(core, shaders, psos, x, y, width, height, "UIRed", "UIRedPSO", 0.1f);
+    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, black, 0.2f);
+    drawRect(core, shaders, psos, x, y, width, height, red, 0.1f);
     if (percent > 0.01f) {
-      drawRect(core, shaders, psos, x, y, width * percent, height, "UIBlue", "UIBluePSO", 0.0f);
+      drawRect(core, shaders, psos, x, y, width * percent, height, blue, 0.0f);
     }
   }
 
   void drawReserveBar(Core *core, Shaders *shaders, PSOManager *psos, float x, float y, float width, float height, float percent) {
     float t = 0.002f; 
     float tY = t / aspectRatio;
-    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, "UIBlack", "UIBlackPSO", 0.2f);
+    drawRect(core, shaders, psos, x - t, y - tY, width + 2 * t, height + 2 * tY, black, 0.2f);
     if (percent > 0.01f) {
-      drawRect(core, shaders, psos, x, y, width * percent, height, "UIDarkBlue", "UIDarkBluePSO", 0.0f);
+      drawRect(core, shaders, psos, x, y, width * percent, height, darkBlue, 0.0f);
     }
   }
 
@@ -396,13 +423,13 @@ public:
     float t = 0.002f; 
     float tY = t / aspectRatio;
 
-    drawRect(core, shaders, psos, x - t, y - tY, barWidth + 2 * t, barHeight + 2 * tY, "UIBlack", "UIBlackPSO", 0.2f);
+    drawRect(core, shaders, psos, x - t, y - tY, barWidth + 2 * t, barHeight + 2 * tY, black, 0.2f);
 
     if (percent > 0.01f) {
       if (completed) {
-        drawRect(core, shaders, psos, x, y, barWidth * percent, barHeight, "UIGreen", "UIGreenPSO", 0.0f);
+        drawRect(core, shaders, psos, x, y, barWidth * percent, barHeight, green, 0.0f);
       } else {
-        drawRect(core, shaders, psos, x, y, barWidth * percent, barHeight, "UIYellow", "UIYellowPSO", 0.0f);
+        drawRect(core, shaders, psos, x, y, barWidth * percent, barHeight, yellow, 0.0f);
       }
     }
   }
@@ -445,6 +472,9 @@ class BulletSystem {
 public:
   std::vector<Bullet> bullets;
   Mesh bulletMesh;
+  ShaderHandle shader;
+  ID3D12PipelineState *pso = nullptr;
+  ConstantHandle vpHandle, wHandle;
   bool initialized = false;
   float aspectRatio = 16.0f / 9.0f;
 
@@ -476,6 +506,10 @@ public:
 
     shaders->load(core, "BulletShader", "VS.txt", "PSBullet.txt");
     psos->createPSO(core, "BulletPSO", shaders->find("BulletShader")->vs, shaders->find("BulletShader")->ps, VertexLayoutCache::getStaticLayout());
+    shader = shaders->resolve("BulletShader");
+    pso = psos->find("BulletPSO");
+    vpHandle = shaders->resolveConstantVS("BulletShader", "staticMeshBuffer", "VP");
+    wHandle = shaders->resolveConstantVS("BulletShader", "staticMeshBuffer", "W");
 
     initialized = true;
   }
@@ -489,30 +523,32 @@ public:
     b.active = true;
     bullets.push_back(b);
   }
-  HitResult checkHit(Vec3 rayOrigin, Vec3 rayDir, std::vector<EnemyController *> &enemies, std::vector<AABB> &colliders,
-                     std::vector<AABB> &sceneColliders, int damage) {
-    float maxDist = 1000.0f;
-    rayDir = rayDir.normalize();
+  // Nearest enemy along the ray that is not behind scene geometry. enemyTree is refit to the enemy boxes once a
+  // frame, with box j belonging to enemies[j].
+  RayHit raycast(Vec3 rayOrigin, Vec3 rayDir, std::vector<EnemyController *> &enemies, const AABBTree &enemyTree,
+                 const AABBTree &sceneTree, float maxDist = 1000.0f) {
+    return raycastPast(sceneTree, enemyTree, rayOrigin, rayDir.normalize(), maxDist,
+                       [&enemies](int j) { return !enemies[j]->shouldRemove; });
+  }
 
-    for (size_t j = 0; j < enemies.size(); j++) {
-      if (enemies[j]->shouldRemove)
-        continue;
-      if (CollisionSystem::rayIntersectsAABB(rayOrigin, rayDir, colliders[j], maxDist)) {
-        Vec3 noKnockback(0, 0, 0);
-        // Check health before damage
-        int healthBefore = enemies[j]->getHealth();
-        enemies[j]->takeDamage(damage, noKnockback);
-        int healthAfter = enemies[j]->getHealth();
-
-        // Return KILL if enemy died from this hit
-        if (healthBefore > 0 && healthAfter <= 0) {
-          return HitResult::KILL;
-        }
-        return HitResult::HIT;
-      }
+  HitResult checkHit(Vec3 rayOrigin, Vec3 rayDir, std::vector<EnemyController *> &enemies, const AABBTree &enemyTree,
+                     const AABBTree &sceneTree, int damage) {
+    RayHit hit = raycast(rayOrigin, rayDir, enemies, enemyTree, sceneTree);
+    if (!hit.hit()) {
+      return HitResult::NONE;
     }
 
-    return HitResult::NONE;
+    Vec3 noKnockback(0, 0, 0);
+    // Check health before damage
+    int healthBefore = enemies[hit.index]->getHealth();
+    enemies[hit.index]->takeDamage(damage, noKnockback);
+    int healthAfter = enemies[hit.index]->getHealth();
+
+    // Return KILL if enemy died from this hit
+    if (healthBefore > 0 && healthAfter <= 0) {
+      return HitResult::KILL;
+    }
+    return HitResult::HIT;
   }
 
   void update(float dt) {
@@ -549,11 +585,10 @@ public:
     if (!initialized || bullets.empty())
       return;
 
-    shaders->apply(core, "BulletShader");
-    psos->bind(core, "BulletPSO");
+    psos->bind(core, pso);
 
     Matrix identity;
-    shaders->updateConstantVS("BulletShader", "staticMeshBuffer", "VP", &identity);
+    Shaders::updateConstant(vpHandle, &identity);
 
     for (const auto &b : bullets) {
       float dx = endX - b.screenX;
@@ -565,72 +600,167 @@ public:
       Matrix trans = Matrix::translation(Vec3(b.screenX, b.screenY, 0));
       Matrix w = rot * trans;
 
-      shaders->updateConstantVS("BulletShader", "staticMeshBuffer", "W", &w);
+      Shaders::updateConstant(wHandle, &w);
+      shaders->apply(core, shader);
       bulletMesh.draw(core);
     }
   }
 };
 
+static_assert(sizeof(STATIC_VERTEX) == sizeof(GEMLoader::GEMStaticVertex), "STATIC_VERTEX must match the .gem vertex layout");
+static_assert(sizeof(ANIMATED_VERTEX) == sizeof(GEMLoader::GEMAnimatedVertex), "ANIMATED_VERTEX must match the .gem vertex layout");
+
+// Handles for the lit model shaders, resolved once per shader instead of per variable per draw
+struct LitShaderHandles {
+  std::string name;
+  ShaderHandle shader;
+  ID3D12PipelineState *pso = nullptr;
+  ConstantHandle w, vp, bones, time;
+  ConstantHandle cameraPos, lightDir, lightColor, ambientStrength;
+  TextureHandle tex;
+
+  void resolve(Shaders *shaders, PSOManager *psos, const std::string &shaderName, const std::string &vsBufferName) {
+    name = shaderName;
+    shader = shaders->resolve(shaderName);
+    pso = psos->find(shaderName + "PSO");
+    w = shaders->resolveConstantVS(shaderName, vsBufferName, "W");
+    vp = shaders->resolveConstantVS(shaderName, vsBufferName, "VP");
+    bones = shaders->resolveConstantVS(shaderName, vsBufferName, "bones");
+    time = shaders->resolveConstantVS(shaderName, vsBufferName, "Time");
+    cameraPos = shaders->resolveConstantPS(shaderName, "LightBuffer", "cameraPos");
+    lightDir = shaders->resolveConstantPS(shaderName, "LightBuffer", "lightDir");
+    lightColor = shaders->resolveConstantPS(shaderName, "LightBuffer", "lightColor");
+    ambientStrength = shaders->resolveConstantPS(shaderName, "LightBuffer", "ambientStrength");
+    tex = shaders->resolveTexturePS(shaderName, "tex");
+  }
+
+  void updateLight(const LightData &lightData) {
+    Shaders::updateConstant(cameraPos, &lightData.cameraPos);
+    Shaders::updateConstant(lightDir, &lightData.lightDir);
+    Shaders::updateConstant(lightColor, &lightData.lightColor);
+    Shaders::updateConstant(ambientStrength, &lightData.ambientStrength);
+  }
+};
+
 class StaticModel {
 public:
   std::vector<Mesh *> meshes;
   std::vector<std::string> textureFilenames;
   std::vector<std::string> normalFilenames;
 
+  std::vector<int> textureHeapOffsets;
+  LitShaderHandles handles;
+
+  // Model space bounding sphere, from the mesh vertices
+  Vec3 boundsCenter;
+  float boundsRadius = 0.0f;
+
+  // Instances live in a DEFAULT heap buffer. Changed instances are tracked as one dirty range and patched
+  // before the next draw, hidden instances are skipped by culling and cost no upload.
+  static const int MAX_RUN_GAP = 4; // Culled instances drawn anyway to join two visible runs
   std::vector<Matrix> instanceTransforms;
+  std::vector<char> instanceHidden;
+  InstanceBounds instanceBounds;
+  std::vector<int> visibleInstances;
+  std::vector<std::pair<int, int>> visibleRuns; // First instance and count
+  CullStats cullStats;
   ID3D12Resource *instanceBuffer = nullptr;
+  BufferState instanceBufferState;
   D3D12_VERTEX_BUFFER_VIEW instanceBufferView;
-  int maxInstances = 0;
+  int instanceCapacity = 0;
+  int dirtyBegin = 0;
+  int dirtyEnd = 0;
 
   void load(Core *core, std::string filename) {
-    GEMLoader::GEMModelLoader loader;
+    GEMLoader::GEMModelSource source;
+    if (!source.open(filename)) {
+      exit(0);
+    }
+    create(core, source);
+  }
+
+  // GPU side of load, so the file can be opened on another thread
+  void create(Core *core, const GEMLoader::GEMModelSource &source) {
     textureFilenames.clear();
     normalFilenames.clear();
-    std::vector<GEMLoader::GEMMesh> gemmeshes;
-    loader.load(filename, gemmeshes);
-    for (int i = 0; i < gemmeshes.size(); i++) {
+    for (int i = 0; i < source.meshes.size(); i++) {
+      const GEMLoader::GEMCookedMesh &gemmesh = source.meshes[i];
       Mesh *mesh = new Mesh();
-      std::vector<STATIC_VERTEX> vertices;
-      for (int j = 0; j < gemmeshes[i].verticesStatic.size(); j++) {
-        STATIC_VERTEX v;
-        memcpy(&v, &gemmeshes[i].verticesStatic[j], sizeof(STATIC_VERTEX));
-        vertices.push_back(v);
-      }
-      textureFilenames.push_back("Models/Textures/Textures1_ALB.png");
-      normalFilenames.push_back("Models/Textures/Textures1_NRM.png");
-      mesh->init(core, vertices, gemmeshes[i].indices);
+      textureFilenames.push_back(gemmesh.albedo);
+      normalFilenames.push_back(gemmesh.normal);
+      mesh->init(core, gemmesh.vertices, gemmesh.vertexStride, gemmesh.vertexCount, gemmesh.indices.data, gemmesh.indices.count);
+      mesh->inputLayoutDesc = VertexLayoutCache::getStaticLayout();
       meshes.push_back(mesh);
     }
+    computeModelBounds(source, boundsCenter, boundsRadius);
+  }
+
+  void markDirty(int index) {
+    if (dirtyBegin == dirtyEnd) {
+      dirtyBegin = index;
+      dirtyEnd = index + 1;
+    } else {
+      dirtyBegin = std::min(dirtyBegin, index);
+      dirtyEnd = std::max(dirtyEnd, index + 1);
+    }
   }
 
-  void addInstance(Matrix transform) {
+  int addInstance(Matrix transform) {
     instanceTransforms.push_back(transform);
+    instanceHidden.push_back(0);
+    Vec3 center;
+    float radius;
+    transformBounds(transform, boundsCenter, boundsRadius, center, radius);
+    instanceBounds.add(center, radius);
+    markDirty(instanceTransforms.size() - 1);
+    return instanceTransforms.size() - 1;
   }
 
-  void clearInstances() { instanceTransforms.clear(); }
+  void setInstance(int index, Matrix transform) {
+    instanceTransforms[index] = transform;
+    if (!instanceHidden[index]) {
+      Vec3 center;
+      float radius;
+      transformBounds(transform, boundsCenter, boundsRadius, center, radius);
+      instanceBounds.set(index, center, radius);
+    }
+    markDirty(index);
+  }
 
-  void uploadInstances(Core *core) {
-    if (instanceTransforms.empty())
+  void setInstanceHidden(int index, bool hidden) {
+    if (instanceHidden[index] == (char)hidden)
       return;
+    instanceHidden[index] = hidden;
+    Vec3 center;
+    float radius;
+    transformBounds(instanceTransforms[index], boundsCenter, boundsRadius, center, radius);
+    instanceBounds.set(index, center, hidden ? -FLT_MAX : radius);
+  }
 
-    int numInstances = instanceTransforms.size();
-    int bufferSize = numInstances * sizeof(Matrix);
-
-    if (instanceBuffer == nullptr || numInstances > maxInstances) {
-      if (instanceBuffer)
-        instanceBuffer->Release();
+  void clearInstances() {
+    instanceTransforms.clear();
+    instanceHidden.clear();
+    instanceBounds.clear();
+    dirtyBegin = dirtyEnd = 0;
+  }
 
-      maxInstances = numInstances + 100;
-      int newSize = maxInstances * sizeof(Matrix);
+  // Copies the dirty range into the instance buffer, recreating it first if the instances no longer fit
+  void uploadInstances(Core *core) {
+    if (instanceTransforms.size() > instanceCapacity) {
+      // Draws already recorded may still read the old buffer, so it goes once this frame is done with it
+      if (instanceBuffer) {
+        core->releaseAfterFrame(instanceBuffer);
+      }
+      instanceCapacity = instanceTransforms.size();
 
       D3D12_HEAP_PROPERTIES heapProps = {};
-      heapProps.Type = D3D12_HEAP_TYPE_UPLOAD;
+      heapProps.Type = D3D12_HEAP_TYPE_DEFAULT;
       heapProps.CreationNodeMask = 1;
       heapProps.VisibleNodeMask = 1;
 
       D3D12_RESOURCE_DESC bufferDesc = {};
       bufferDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-      bufferDesc.Width = newSize;
+      bufferDesc.Width = instanceCapacity * sizeof(Matrix);
       bufferDesc.Height = 1;
       bufferDesc.DepthOrArraySize = 1;
       bufferDesc.MipLevels = 1;
@@ -639,39 +769,68 @@ public:
 
       core->device->CreateCommittedResource(
           &heapProps, D3D12_HEAP_FLAG_NONE, &bufferDesc,
-          D3D12_RESOURCE_STATE_GENERIC_READ, nullptr,
+          D3D12_RESOURCE_STATE_COMMON, nullptr,
           IID_PPV_ARGS(&instanceBuffer));
-    }
+      instanceBufferState = BufferState();
 
-    void *mappedData;
-    instanceBuffer->Map(0, nullptr, &mappedData);
-    memcpy(mappedData, instanceTransforms.data(), bufferSize);
-    instanceBuffer->Unmap(0, nullptr);
+      instanceBufferView.BufferLocation = instanceBuffer->GetGPUVirtualAddress();
+      instanceBufferView.SizeInBytes = instanceCapacity * sizeof(Matrix);
+      instanceBufferView.StrideInBytes = sizeof(Matrix);
+      dirtyBegin = 0;
+      dirtyEnd = instanceTransforms.size();
+    }
+    if (dirtyBegin == dirtyEnd)
+      return;
+    core->patchBuffer(instanceBuffer, instanceBufferState, dirtyBegin * sizeof(Matrix), &instanceTransforms[dirtyBegin],
+                      (dirtyEnd - dirtyBegin) * sizeof(Matrix), D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER);
+    dirtyBegin = dirtyEnd = 0;
+  }
 
-    instanceBufferView.BufferLocation = instanceBuffer->GetGPUVirtualAddress();
-    instanceBufferView.SizeInBytes = bufferSize;
-    instanceBufferView.StrideInBytes = sizeof(Matrix);
+  // Groups visible instances into runs that can be drawn straight from the instance buffer. Runs are joined
+  // across short gaps of culled instances, never across hidden ones.
+  void cull(const Frustum &frustum) {
+    visibleInstances.clear();
+    visibleRuns.clear();
+    cullStats = instanceBounds.cull(frustum, visibleInstances);
+    for (int index : visibleInstances) {
+      if (!visibleRuns.empty()) {
+        std::pair<int, int> &run = visibleRuns.back();
+        int end = run.first + run.second;
+        bool join = index - end <= MAX_RUN_GAP;
+        for (int i = end; join && i < index; i++) {
+          join = !instanceHidden[i];
+        }
+        if (join) {
+          run.second = index + 1 - run.first;
+          continue;
+        }
+      }
+      visibleRuns.push_back({index, 1});
+    }
   }
 
   void drawInstanced(Core* core, PSOManager* psos, Shaders* shaders, Matrix& vp, TextureManager* textures, LightData& lightData, float time = 0.0f, std::string shaderName = "StaticModelNormalMapped") {
-      if (instanceTransforms.empty())
+      cull(Frustum::fromViewProjection(vp));
+      if (visibleRuns.empty())
           return;
+      uploadInstances(core);
 
-      std::string psoName = shaderName + "PSO";
-
-      shaders->updateConstantVS(shaderName, "SceneConstantBuffer", "VP", &vp);
-
-      if (shaderName == "GrassShader") {
-          shaders->updateConstantVS(shaderName, "SceneConstantBuffer", "Time", &time);
+      if (handles.name != shaderName) {
+          handles.resolve(shaders, psos, shaderName, "SceneConstantBuffer");
+      }
+      if (textureHeapOffsets.size() != meshes.size()) {
+          textureHeapOffsets.clear();
+          for (int i = 0; i < meshes.size(); i++) {
+              textureHeapOffsets.push_back(textures->getHeapOffset(textureFilenames[i], core));
+          }
       }
 
-      shaders->updateConstantPS(shaderName, "LightBuffer", "cameraPos", &lightData.cameraPos);
-      shaders->updateConstantPS(shaderName, "LightBuffer", "lightDir", &lightData.lightDir);
-      shaders->updateConstantPS(shaderName, "LightBuffer", "lightColor", &lightData.lightColor);
-      shaders->updateConstantPS(shaderName, "LightBuffer", "ambientStrength", &lightData.ambientStrength);
+      Shaders::updateConstant(handles.vp, &vp);
+      Shaders::updateConstant(handles.time, &time);
+      handles.updateLight(lightData);
 
-      shaders->apply(core, shaderName);
-      psos->bind(core, psoName);
+      shaders->apply(core, handles.shader);
+      psos->bind(core, handles.pso);
 
       auto commandList = core->getCommandList();
       commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
@@ -681,8 +840,10 @@ public:
           commandList->IASetVertexBuffers(1, 1, &instanceBufferView);
           commandList->IASetIndexBuffer(&meshes[i]->ibView);
 
-          shaders->updateTexturePS(core, shaderName, "tex", textures->getHeapOffset(textureFilenames[i], core));
-          commandList->DrawIndexedInstanced(meshes[i]->numMeshIndices, instanceTransforms.size(), 0, 0, 0);
+          shaders->updateTexturePS(core, handles.tex, textureHeapOffsets[i]);
+          for (const std::pair<int, int> &run : visibleRuns) {
+              commandList->DrawIndexedInstanced(meshes[i]->numMeshIndices, run.second, 0, 0, run.first);
+          }
       }
   }
 
@@ -705,124 +866,107 @@ public:
   Animation animation;
   std::vector<std::string> textureFilenames;
   std::vector<std::string> normalFilenames;
+  std::vector<int> textureHeapOffsets;
+  LitShaderHandles handles;
+
+  // Instanced path: every instance added this frame is drawn with one DrawIndexedInstanced per mesh
+  SkinPalette palette;
+  LitShaderHandles instancedHandles;
+  ConstantHandle paletteStride;
+  // Poses shared by the instances of this model that opt in with AnimationInstance::usePoseCache
+  PoseCache poseCache;
 
   void load(Core *core, std::string filename, PSOManager *psos, Shaders *shaders) {
-    GEMLoader::GEMModelLoader loader;
-    std::vector<GEMLoader::GEMMesh> gemmeshes;
+    GEMLoader::GEMModelSource source;
+    if (!source.open(filename)) {
+      exit(0);
+    }
+    std::cout << "Loading: " << filename << std::endl;
+    create(core, source, psos, shaders);
+  }
+
+  // GPU side of load, so the file can be opened on another thread
+  void create(Core *core, const GEMLoader::GEMModelSource &source, PSOManager *psos, Shaders *shaders) {
     textureFilenames.clear();
     normalFilenames.clear();
+    for (int i = 0; i < source.meshes.size(); i++) {
+      const GEMLoader::GEMCookedMesh &gemmesh = source.meshes[i];
+      Mesh *mesh = new Mesh();
+      textureFilenames.push_back(gemmesh.albedo);
+      normalFilenames.push_back(gemmesh.normal);
+      mesh->init(core, gemmesh.vertices, gemmesh.vertexStride, gemmesh.vertexCount, gemmesh.indices.data, gemmesh.indices.count);
+      mesh->inputLayoutDesc = VertexLayoutCache::getAnimatedLayout();
+      meshes.push_back(mesh);
+    }
+    shaders->load(core, "AnimatedNormalMapped", "VSAnim.txt", "PSNormalMap.txt");
 
-    GEMLoader::GEMAnimation gemanimation;
-    loader.load(filename, gemmeshes, gemanimation);
-    std::cout << "Loading: " << filename << std::endl;
+    psos->createPSO(core, "AnimatedNormalMappedPSO", shaders->find("AnimatedNormalMapped")->vs, shaders->find("AnimatedNormalMapped")->ps, VertexLayoutCache::getAnimatedLayout());
+    handles.resolve(shaders, psos, "AnimatedNormalMapped", "staticMeshBuffer");
 
-    for (int i = 0; i < gemmeshes.size(); i++) {
-      Mesh *mesh = new Mesh();
-      std::vector<ANIMATED_VERTEX> vertices;
-      for (int j = 0; j < gemmeshes[i].verticesAnimated.size(); j++) {
-        ANIMATED_VERTEX v;
-        memcpy(&v, &gemmeshes[i].verticesAnimated[j], sizeof(ANIMATED_VERTEX));
-        vertices.push_back(v);
-      }
+    shaders->load(core, "AnimatedNormalMappedInstanced", "VSAnimInstanced.txt", "PSNormalMap.txt");
+    psos->createPSO(core, "AnimatedNormalMappedInstancedPSO", shaders->find("AnimatedNormalMappedInstanced")->vs,
+                    shaders->find("AnimatedNormalMappedInstanced")->ps, VertexLayoutCache::getAnimatedLayout());
+    instancedHandles.resolve(shaders, psos, "AnimatedNormalMappedInstanced", "staticMeshBuffer");
+    paletteStride = shaders->resolveConstantVS("AnimatedNormalMappedInstanced", "staticMeshBuffer", "paletteStride");
 
-      std::string texName = gemmeshes[i].material.find("albedo").getValue();
-
-      if (filename.find("Duck-mixed") != std::string::npos || filename.find("Bull-dark") != std::string::npos ||
-          filename.find("Goat-01") != std::string::npos || filename.find("Pig") != std::string::npos) {
-        texName = "T_Animalstextures_alb.png";
-      } else if (filename.find("AutomaticCarbine") != std::string::npos) {
-        if (texName.find("arms") != std::string::npos)
-          texName = "arms_1_Albedo_alb.png";
-        else if (texName.find("Collimator") != std::string::npos)
-          texName = "AC5_Collimator_Albedo_alb.png";
-        else if (texName.find("Glass") != std::string::npos)
-          texName = "AC5_Collimator_Glass_Albedo_alb.png";
-        else if (texName.find("Bullet") != std::string::npos || texName.find("Shell") != std::string::npos)
-          texName = "AC5_Bullet_Shell_Albedo_alb.png";
-        else
-          texName = "AC5_Albedo_alb.png";
-      } else {
-        if (texName.length() > 0 && texName.find(".png") == std::string::npos) {
-          texName += ".png";
-        }
-      }
+    createAnimation(source, animation);
+    animation.compressClips(KeyframeTolerance(), std::cout);
+    poseCache.init(&animation, Matrix());
+  }
 
-      std::string normName = texName;
-      size_t pos = normName.find("_alb");
-      if (pos != std::string::npos)
-        normName.replace(pos, 4, "_nrm");
-      else {
-        pos = normName.find("_ALB");
-        if (pos != std::string::npos)
-          normName.replace(pos, 4, "_NRM");
-        else {
-          pos = normName.find_last_of(".");
-          if (pos != std::string::npos)
-            normName.insert(pos, "_nrm");
-        }
+  void cacheTextureHeapOffsets(Core *core, TextureManager *textures) {
+    if (textureHeapOffsets.size() != meshes.size()) {
+      textureHeapOffsets.clear();
+      for (int i = 0; i < meshes.size(); i++) {
+        textureHeapOffsets.push_back(textures->getHeapOffset(textureFilenames[i], core));
       }
+    }
+  }
 
-      textureFilenames.push_back("Models/Textures/" + texName);
-      normalFilenames.push_back("Models/Textures/" + normName);
+  void beginInstances() { palette.begin(animation.bonesSize()); }
 
-      mesh->init(core, vertices, gemmeshes[i].indices);
-      meshes.push_back(mesh);
-    }
+  void addInstance(AnimationInstance *instance, const Matrix &w) { palette.add(w, instance->pose()); }
 
-    shaders->load(core, "AnimatedNormalMapped", "VSAnim.txt", "PSNormalMap.txt");
+  // Draws every instance added since beginInstances. The palettes go to the vertex shader as one structured
+  // buffer from the per-frame allocator.
+  void drawInstances(Core *core, PSOManager *psos, Shaders *shaders, Matrix &vp, TextureManager *textures, LightData &lightData) {
+    if (palette.count == 0)
+      return;
+    cacheTextureHeapOffsets(core, textures);
 
-    psos->createPSO(core, "AnimatedNormalMappedPSO", shaders->find("AnimatedNormalMapped")->vs, shaders->find("AnimatedNormalMapped")->ps, VertexLayoutCache::getAnimatedLayout());
+    psos->bind(core, instancedHandles.pso);
 
-    animation.skeleton.bones.clear();
-    animation.animations.clear();
-    memcpy(&animation.skeleton.globalInverse, &gemanimation.globalInverse, 16 * sizeof(float));
-    for (int i = 0; i < gemanimation.bones.size(); i++) {
-      Bone bone;
-      bone.name = gemanimation.bones[i].name;
-      memcpy(&bone.offset, &gemanimation.bones[i].offset, 16 * sizeof(float));
-      bone.parentIndex = gemanimation.bones[i].parentIndex;
-      animation.skeleton.bones.push_back(bone);
-    }
-    for (int i = 0; i < gemanimation.animations.size(); i++) {
-      std::string name = gemanimation.animations[i].name;
-      AnimationSequence aseq;
-      aseq.ticksPerSecond = gemanimation.animations[i].ticksPerSecond;
-      for (int j = 0; j < gemanimation.animations[i].frames.size(); j++) {
-        AnimationFrame frame;
-        for (int index = 0; index < gemanimation.animations[i].frames[j].positions.size(); index++) {
-          Vec3 p;
-          Quaternion q;
-          Vec3 s;
-          memcpy(&p, &gemanimation.animations[i].frames[j].positions[index], sizeof(Vec3));
-          frame.positions.push_back(p);
-          memcpy(&q, &gemanimation.animations[i].frames[j].rotations[index], sizeof(Quaternion));
-          frame.rotations.push_back(q);
-          memcpy(&s, &gemanimation.animations[i].frames[j].scales[index], sizeof(Vec3));
-          frame.scales.push_back(s);
-        }
-        aseq.frames.push_back(frame);
-      }
-      animation.animations.insert({name, aseq});
+    unsigned int stride = palette.stride();
+    Shaders::updateConstant(instancedHandles.vp, &vp);
+    Shaders::updateConstant(paletteStride, &stride);
+    instancedHandles.updateLight(lightData);
+
+    shaders->apply(core, instancedHandles.shader);
+    auto commandList = core->getCommandList();
+    commandList->SetGraphicsRootShaderResourceView(3, core->constantAllocator.allocate(palette.matrices.data(), palette.sizeInBytes()));
+    commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+    for (int i = 0; i < meshes.size(); i++) {
+      shaders->updateTexturePS(core, instancedHandles.tex, textureHeapOffsets[i]);
+      commandList->IASetVertexBuffers(0, 1, &meshes[i]->vbView);
+      commandList->IASetIndexBuffer(&meshes[i]->ibView);
+      commandList->DrawIndexedInstanced(meshes[i]->numMeshIndices, palette.count, 0, 0, 0);
     }
   }
 
   void draw(Core *core, PSOManager *psos, Shaders *shaders, AnimationInstance *instance, Matrix &vp, Matrix &w,
             TextureManager *textures, LightData &lightData) {
-    psos->bind(core, "AnimatedNormalMappedPSO");
+    cacheTextureHeapOffsets(core, textures);
 
-    std::string shaderName = "AnimatedNormalMapped";
+    psos->bind(core, handles.pso);
 
-    shaders->updateConstantVS(shaderName, "staticMeshBuffer", "W", &w);
-    shaders->updateConstantVS(shaderName, "staticMeshBuffer", "VP", &vp);
-    shaders->updateConstantVS(shaderName, "staticMeshBuffer", "bones", instance->matrices);
-    shaders->updateConstantPS(shaderName, "LightBuffer", "cameraPos", &lightData.cameraPos);
-    shaders->updateConstantPS(shaderName, "LightBuffer", "lightDir", &lightData.lightDir);
-    shaders->updateConstantPS(shaderName, "LightBuffer", "lightColor", &lightData.lightColor);
-    shaders->updateConstantPS(shaderName, "LightBuffer", "ambientStrength", &lightData.ambientStrength);
+    Shaders::updateConstant(handles.w, &w);
+    Shaders::updateConstant(handles.vp, &vp);
+    Shaders::updateConstant(handles.bones, instance->pose(), animation.bonesSize() * sizeof(Matrix));
+    handles.updateLight(lightData);
 
-    shaders->apply(core, shaderName);
+    shaders->apply(core, handles.shader);
     for (int i = 0; i < meshes.size(); i++) {
-      shaders->updateTexturePS(core, shaderName, "tex", textures->getHeapOffset(textureFilenames[i], core));
+      shaders->updateTexturePS(core, handles.tex, textureHeapOffsets[i]);
       meshes[i]->draw(core);
     }
   }
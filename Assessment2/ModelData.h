@@ -0,0 +1,82 @@
+#pragma once
+#include "Animation.h"
+#include "GEMCache.h"
+#include "Maths.h"
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+
+// The parts of building a model that need no GPU, shared by StaticModel and AnimatedModel and used on their own by
+// the headless benchmarks
+
+// Sphere around the AABB of every vertex position, position being the first member of the vertex
+inline void computeModelBounds(const GEMLoader::GEMModelSource &source, Vec3 &center, float &radius) {
+  Vec3 minP(FLT_MAX, FLT_MAX, FLT_MAX);
+  Vec3 maxP(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+  for (const GEMLoader::GEMCookedMesh &gemmesh : source.meshes) {
+    const unsigned char *vertex = (const unsigned char *)gemmesh.vertices;
+    for (unsigned int i = 0; i < gemmesh.vertexCount; i++, vertex += gemmesh.vertexStride) {
+      Vec3 pos;
+      memcpy(&pos, vertex, sizeof(Vec3));
+      minP = Min(minP, pos);
+      maxP = Max(maxP, pos);
+    }
+  }
+  if (minP.x > maxP.x) {
+    center = Vec3(0, 0, 0);
+    radius = 0.0f;
+    return;
+  }
+  center = (minP + maxP) * 0.5f;
+  radius = (maxP - center).length();
+}
+
+// World space sphere for one instance, the radius scaled by the largest axis scale of the transform
+inline void transformBounds(const Matrix &transform, const Vec3 &center, float radius, Vec3 &worldCenter, float &worldRadius) {
+  const float(*a)[4] = transform.a;
+  worldCenter = Vec3(a[0][0] * center.x + a[0][1] * center.y + a[0][2] * center.z + a[0][3],
+                     a[1][0] * center.x + a[1][1] * center.y + a[1][2] * center.z + a[1][3],
+                     a[2][0] * center.x + a[2][1] * center.y + a[2][2] * center.z + a[2][3]);
+  float scale = 0.0f;
+  for (int j = 0; j < 3; j++) {
+    scale = std::max(scale, SQ(a[0][j]) + SQ(a[1][j]) + SQ(a[2][j]));
+  }
+  worldRadius = radius * sqrtf(scale);
+}
+
+// Skeleton, keyframes and clips of an animated model
+inline void createAnimation(const GEMLoader::GEMModelSource &source, Animation &animation) {
+  const GEMLoader::GEMAnimationView *gemanimation = source.animation;
+  animation.skeleton.bones.clear();
+  animation.animations.clear();
+  memcpy(&animation.skeleton.globalInverse, &gemanimation->globalInverse, 16 * sizeof(float));
+  for (int i = 0; i < gemanimation->bones.size(); i++) {
+    Bone bone;
+    bone.name = gemanimation->bones[i].name;
+    memcpy(&bone.offset, &gemanimation->bones[i].offset, 16 * sizeof(float));
+    bone.parentIndex = gemanimation->bones[i].parentIndex;
+    animation.skeleton.bones.push_back(bone);
+  }
+  // Keyframe channels are copied one block per frame instead of one element at a time
+  for (int i = 0; i < gemanimation->animations.size(); i++) {
+    const GEMLoader::GEMAnimationSequenceView &gemseq = gemanimation->animations[i];
+    // A later clip with the same name as an earlier one is ignored, so the first one wins
+    auto inserted = animation.animations.emplace(gemseq.name, AnimationSequence());
+    if (!inserted.second) {
+      continue;
+    }
+    AnimationSequence &aseq = inserted.first->second;
+    aseq.ticksPerSecond = gemseq.ticksPerSecond;
+    aseq.frames.resize(gemseq.frameCount);
+    for (unsigned int j = 0; j < gemseq.frameCount; j++) {
+      AnimationFrame &frame = aseq.frames[j];
+      frame.positions.resize(gemseq.bonesN);
+      frame.rotations.resize(gemseq.bonesN);
+      frame.scales.resize(gemseq.bonesN);
+      memcpy(frame.positions.data(), gemseq.positions(j).data, gemseq.positions(j).sizeInBytes());
+      memcpy(frame.rotations.data(), gemseq.rotations(j).data, gemseq.rotations(j).sizeInBytes());
+      memcpy(frame.scales.data(), gemseq.scales(j).data, gemseq.scales(j).sizeInBytes());
+    }
+  }
+  animation.buildClips();
+}
@@ -85,6 +85,13 @@ public:
   void bind(Core *core, std::string name) {
     core->getCommandList()->SetPipelineState(psos[name]);
   }
+  ID3D12PipelineState *find(const std::string &name) {
+    auto it = psos.find(name);
+    return it == psos.end() ? nullptr : it->second;
+  }
+  void bind(Core *core, ID3D12PipelineState *pso) {
+    core->getCommandList()->SetPipelineState(pso);
+  }
   ~PSOManager() {
     for (auto &pso : psos) {
       pso.second->Release();
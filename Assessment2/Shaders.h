@@ -20,67 +20,32 @@ struct ConstantBufferVariable
 	unsigned int size;
 };
 
+// CPU copy of one constant buffer. apply() copies it into the frame's constant allocator, so variables keep
+// their last written value between draws.
 class ConstantBuffer
 {
 public:
 	std::string name;
 	std::map<std::string, ConstantBufferVariable> constantBufferData;
-	ID3D12Resource* constantBuffer;
-	unsigned char* buffer;
+	std::vector<unsigned char> data;
 	unsigned int cbSizeInBytes;
-	unsigned int numInstances;
-	unsigned int offsetIndex;
-	void init(Core* core, unsigned int sizeInBytes, unsigned int maxDrawCalls = 1024)
+	void init(unsigned int sizeInBytes)
 	{
 		cbSizeInBytes = (sizeInBytes + 255) & ~255;
-		unsigned int cbSizeInBytesAligned = cbSizeInBytes * maxDrawCalls;
-		numInstances = maxDrawCalls;
-		offsetIndex = 0;
-		HRESULT hr;
-		D3D12_HEAP_PROPERTIES heapprops;
-		memset(&heapprops, 0, sizeof(D3D12_HEAP_PROPERTIES));
-		heapprops.Type = D3D12_HEAP_TYPE_UPLOAD;
-		heapprops.CreationNodeMask = 1;
-		heapprops.VisibleNodeMask = 1;
-		D3D12_RESOURCE_DESC cbDesc;
-		memset(&cbDesc, 0, sizeof(D3D12_RESOURCE_DESC));
-		cbDesc.Width = cbSizeInBytesAligned;
-		cbDesc.Height = 1;
-		cbDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		cbDesc.DepthOrArraySize = 1;
-		cbDesc.MipLevels = 1;
-		cbDesc.SampleDesc.Count = 1;
-		cbDesc.SampleDesc.Quality = 0;
-		cbDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		hr = core->device->CreateCommittedResource(&heapprops, D3D12_HEAP_FLAG_NONE, &cbDesc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, __uuidof(ID3D12Resource), (void**)&constantBuffer);
-		D3D12_RANGE readRange = { 0, 0 };
-		hr = constantBuffer->Map(0, &readRange, (void**)&buffer);
-	}
-	void update(std::string name, void* data) 
-	{
-		ConstantBufferVariable cbVariable = constantBufferData[name];
-		unsigned int offset = offsetIndex * cbSizeInBytes;
-		memcpy(&buffer[offset + cbVariable.offset], data, cbVariable.size);
+		data.assign(cbSizeInBytes, 0);
 	}
-	D3D12_GPU_VIRTUAL_ADDRESS getGPUAddress() const
+	void update(std::string name, void* value) 
 	{
-		return (constantBuffer->GetGPUVirtualAddress() + (offsetIndex * cbSizeInBytes));
+		ConstantBufferVariable cbVariable = constantBufferData[name];
+		memcpy(&data[cbVariable.offset], value, cbVariable.size);
 	}
-	void next()
+	D3D12_GPU_VIRTUAL_ADDRESS upload(Core* core)
 	{
-		offsetIndex++;
-		if (offsetIndex >= numInstances)
-		{
-			offsetIndex = 0;
-		}
+		return core->constantAllocator.allocate(data.data(), cbSizeInBytes);
 	}
 	void free()
 	{
-		if (constantBuffer) {
-			constantBuffer->Unmap(0, NULL);
-			constantBuffer->Release();
-			constantBuffer = nullptr;
-		}
+		data.clear();
 	}
 };
 
@@ -119,9 +84,13 @@ public:
 				bufferVariable.offset = vDesc.StartOffset;
 				bufferVariable.size = vDesc.Size;
 				buffer.constantBufferData.insert({ vDesc.Name, bufferVariable });
-				totalSize += bufferVariable.size;
+				// End of the last variable, so HLSL packing padding is included
+				if (bufferVariable.offset + bufferVariable.size > totalSize)
+				{
+					totalSize = bufferVariable.offset + bufferVariable.size;
+				}
 			}
-			buffer.init(core, totalSize);
+			buffer.init(totalSize);
 			buffers.push_back(buffer);
 		}
 		for (int i = 0; i < desc.BoundResources; i++)
@@ -193,9 +162,22 @@ public:
 	{
 		updateConstant(constantBufferName, variableName, data, psConstantBuffers);
 	}
+	ConstantBuffer* findConstantBuffer(const std::string& constantBufferName, std::vector<ConstantBuffer>& buffers)
+	{
+		for (int i = 0; i < buffers.size(); i++)
+		{
+			if (buffers[i].name == constantBufferName)
+			{
+				return &buffers[i];
+			}
+		}
+		return nullptr;
+	}
 	void updateTexturePS(Core* core, std::string name, int heapOffset) {
 		if (textureBindPoints.find(name) == textureBindPoints.end()) return; 
-		UINT bindPoint = textureBindPoints[name];
+		updateTexturePS(core, textureBindPoints[name], heapOffset);
+	}
+	void updateTexturePS(Core* core, int bindPoint, int heapOffset) {
 		D3D12_GPU_DESCRIPTOR_HANDLE handle = core->srvHeap.gpuHandle;
 		handle.ptr = handle.ptr + (UINT64)(heapOffset - bindPoint) * (UINT64)core->srvHeap.incrementSize;
 		core->getCommandList()->SetGraphicsRootDescriptorTable(2, handle);
@@ -204,13 +186,11 @@ public:
 	{
 		for (int i = 0; i < vsConstantBuffers.size(); i++)
 		{
-			core->getCommandList()->SetGraphicsRootConstantBufferView(0, vsConstantBuffers[i].getGPUAddress());
-			vsConstantBuffers[i].next();
+			core->getCommandList()->SetGraphicsRootConstantBufferView(0, vsConstantBuffers[i].upload(core));
 		}
 		for (int i = 0; i < psConstantBuffers.size(); i++)
 		{
-			core->getCommandList()->SetGraphicsRootConstantBufferView(1, psConstantBuffers[i].getGPUAddress());
-			psConstantBuffers[i].next();
+			core->getCommandList()->SetGraphicsRootConstantBufferView(1, psConstantBuffers[i].upload(core));
 		}
 	}
 	void free()
@@ -225,6 +205,38 @@ public:
 	}
 };
 
+// Handles are resolved once with Shaders::resolve* when a shader is loaded, then used per draw without any
+// string lookups. A handle for a shader or variable that does not exist is invalid and updates through it do nothing.
+struct ShaderHandle
+{
+	Shader* shader = nullptr;
+	bool valid() const
+	{
+		return shader != nullptr;
+	}
+};
+
+struct ConstantHandle
+{
+	ConstantBuffer* buffer = nullptr;
+	unsigned int offset = 0;
+	unsigned int size = 0;
+	bool valid() const
+	{
+		return buffer != nullptr;
+	}
+};
+
+struct TextureHandle
+{
+	Shader* shader = nullptr;
+	int bindPoint = 0;
+	bool valid() const
+	{
+		return shader != nullptr;
+	}
+};
+
 class Shaders
 {
 public:
@@ -277,6 +289,105 @@ public:
 	{
 		return &shaders[name];
 	}
+	ShaderHandle resolve(const std::string& name)
+	{
+		ShaderHandle handle;
+		auto it = shaders.find(name);
+		if (it != shaders.end())
+		{
+			handle.shader = &it->second;
+		}
+		return handle;
+	}
+	ConstantHandle resolveConstant(const std::string& name, const std::string& constantBufferName, const std::string& variableName, bool pixelShader)
+	{
+		ConstantHandle handle;
+		ShaderHandle shader = resolve(name);
+		if (!shader.valid())
+		{
+			return handle;
+		}
+		ConstantBuffer* buffer = shader.shader->findConstantBuffer(constantBufferName, pixelShader ? shader.shader->psConstantBuffers : shader.shader->vsConstantBuffers);
+		if (buffer == nullptr)
+		{
+			return handle;
+		}
+		auto it = buffer->constantBufferData.find(variableName);
+		if (it == buffer->constantBufferData.end())
+		{
+			return handle;
+		}
+		handle.buffer = buffer;
+		handle.offset = it->second.offset;
+		handle.size = it->second.size;
+		return handle;
+	}
+	ConstantHandle resolveConstantVS(const std::string& name, const std::string& constantBufferName, const std::string& variableName)
+	{
+		return resolveConstant(name, constantBufferName, variableName, false);
+	}
+	ConstantHandle resolveConstantPS(const std::string& name, const std::string& constantBufferName, const std::string& variableName)
+	{
+		return resolveConstant(name, constantBufferName, variableName, true);
+	}
+	TextureHandle resolveTexturePS(const std::string& name, const std::string& textureName)
+	{
+		TextureHandle handle;
+		ShaderHandle shader = resolve(name);
+		if (shader.valid() && shader.shader->textureBindPoints.find(textureName) != shader.shader->textureBindPoints.end())
+		{
+			handle.shader = shader.shader;
+			handle.bindPoint = shader.shader->textureBindPoints[textureName];
+		}
+		return handle;
+	}
+	static void updateConstant(const ConstantHandle& handle, const void* data)
+	{
+		if (handle.buffer)
+		{
+			memcpy(&handle.buffer->data[handle.offset], data, handle.size);
+		}
+	}
+	// Writes the first size bytes of the variable, for arrays filled only partly
+	static void updateConstant(const ConstantHandle& handle, const void* data, unsigned int size)
+	{
+		if (handle.buffer)
+		{
+			memcpy(&handle.buffer->data[handle.offset], data, size < handle.size ? size : handle.size);
+		}
+	}
+	void updateTexturePS(Core* core, const TextureHandle& handle, int heapOffset)
+	{
+		if (handle.shader)
+		{
+			handle.shader->updateTexturePS(core, handle.bindPoint, heapOffset);
+		}
+	}
+	void apply(Core* core, const ShaderHandle& handle)
+	{
+		handle.shader->apply(core);
+	}
+	// Times the string path against the handle path for one variable and writes ns per update to out
+	void benchmarkConstant(const std::string& name, const std::string& constantBufferName, const std::string& variableName, void* data, int iterations, std::ostream& out)
+	{
+		ConstantHandle handle = resolveConstantVS(name, constantBufferName, variableName);
+		LARGE_INTEGER freq, start, mid, end;
+		QueryPerformanceFrequency(&freq);
+		QueryPerformanceCounter(&start);
+		for (int i = 0; i < iterations; i++)
+		{
+			updateConstantVS(name, constantBufferName, variableName, data);
+		}
+		QueryPerformanceCounter(&mid);
+		for (int i = 0; i < iterations; i++)
+		{
+			updateConstant(handle, data);
+		}
+		QueryPerformanceCounter(&end);
+		double stringNs = (double)(mid.QuadPart - start.QuadPart) * 1e9 / (double)freq.QuadPart / iterations;
+		double handleNs = (double)(end.QuadPart - mid.QuadPart) * 1e9 / (double)freq.QuadPart / iterations;
+		out << name << " " << constantBufferName << "." << variableName << " (" << handle.size << " bytes): " << stringNs << " ns by name, " << handleNs << " ns by handle" << std::endl;
+	}
 	void apply(Core* core, std::string name)
 	{
 		shaders[name].apply(core);
@@ -121,10 +121,16 @@ private:
     return hr;
   }
 
+  WAVEFORMATEXTENSIBLE wfx = {0}; // Format read by readWAV
+
 public:
   // Loads a WAV file into the audio buffer
   bool loadWAV(IXAudio2 *xaudio, std::string filename) {
-    WAVEFORMATEXTENSIBLE wfx = {0};
+    return readWAV(filename) && createVoices(xaudio);
+  }
+
+  // Parses the file into the audio buffer. Touches no XAudio2 state, so it can run on a worker thread.
+  bool readWAV(std::string filename) {
     // Open the file
     HANDLE hFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ,
                                NULL, OPEN_EXISTING, 0, NULL);
@@ -153,7 +159,11 @@ public:
     buffer.AudioBytes = dwChunkSize;
     buffer.pAudioData = pDataBuffer;
     buffer.Flags = XAUDIO2_END_OF_STREAM;
+    return true;
+  }
 
+  // Creates the source voices for a buffer filled by readWAV
+  bool createVoices(IXAudio2 *xaudio) {
     HRESULT hr;
     // Create multiple source voices for concurrent playback
     for (int i = 0; i < 128; i++) {
@@ -225,6 +235,13 @@ public:
     }
   }
 
+  // Adds a sound whose file was already read with Sound::readWAV
+  void add(std::string filename, Sound *sound) {
+    if (find(filename) == NULL && sound->createVoices(xaudio)) {
+      sounds[filename] = sound;
+    }
+  }
+
   // Plays a loaded sound effect
   void play(std::string filename) {
     Sound *sound = find(filename);
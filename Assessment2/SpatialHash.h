@@ -0,0 +1,128 @@
+#pragma once
+#include "Maths.h"
+#include <algorithm>
+#include <vector>
+
+// Points of moving entities bucketed by their cell of a uniform grid over the x / z plane. The cells are hashed
+// into a table sized to the number of points rather than to the ground they cover, so the whole thing is rebuilt
+// from scratch every frame in one pass over the points. Indices are positions in the list given to build.
+class SpatialHash {
+public:
+  void build(const std::vector<Vec3> &positions, float size = 2.0f) {
+    points = positions;
+    cellSize = size;
+    invCellSize = 1.0f / cellSize;
+    int buckets = 1;
+    while (buckets < (int)points.size() * 2) {
+      buckets <<= 1;
+    }
+    mask = (unsigned)buckets - 1;
+
+    // Count then fill, so every bucket's points sit together in entries and stay in index order. The entries carry
+    // copies of their points so a query reads each bucket as one run of memory.
+    bucketStart.assign(buckets + 1, 0);
+    pointBucket.resize(points.size());
+    for (int i = 0; i < (int)points.size(); i++) {
+      pointBucket[i] = bucket(cellX(points[i].x), cellZ(points[i].z));
+      bucketStart[pointBucket[i] + 1]++;
+    }
+    for (int b = 0; b < buckets; b++) {
+      bucketStart[b + 1] += bucketStart[b];
+    }
+    entries.resize(points.size());
+    fill.assign(bucketStart.begin(), bucketStart.end() - 1);
+    for (int i = 0; i < (int)points.size(); i++) {
+      Entry &entry = entries[fill[pointBucket[i]]++];
+      entry.point = points[i];
+      entry.cellX = cellX(points[i].x);
+      entry.cellZ = cellZ(points[i].z);
+      entry.index = i;
+    }
+  }
+
+  // Calls visit(index) for every point within radius of centre on the x / z plane, cell by cell, until it returns
+  // false. Indices in one cell come in ascending order; use queryRadius for the whole set in order.
+  template <typename Visit> void visitRadius(const Vec3 &centre, float radius, Visit visit) const {
+    auto inside = [&](const Vec3 &point) {
+      Vec3 offset = point - centre;
+      offset.y = 0;
+      return offset.length() < radius;
+    };
+    int x0 = cellX(centre.x - radius), x1 = cellX(centre.x + radius);
+    int z0 = cellZ(centre.z - radius), z1 = cellZ(centre.z + radius);
+    // A query covering more cells than there are points is cheaper as a walk over all of them
+    if ((long long)(x1 - x0 + 1) * (z1 - z0 + 1) > (long long)points.size()) {
+      for (int i = 0; i < (int)points.size(); i++) {
+        if (inside(points[i]) && !visit(i)) {
+          return;
+        }
+      }
+      return;
+    }
+    for (int z = z0; z <= z1; z++) {
+      for (int x = x0; x <= x1; x++) {
+        unsigned b = bucket(x, z);
+        for (int c = bucketStart[b]; c < bucketStart[b + 1]; c++) {
+          const Entry &entry = entries[c];
+          // Other cells hashed to the same bucket are skipped, so no point is visited twice
+          if (entry.cellX == x && entry.cellZ == z && inside(entry.point) && !visit(entry.index)) {
+            return;
+          }
+        }
+      }
+    }
+  }
+
+  // Appends the index of every point within radius of centre on the x / z plane to out, in ascending order so
+  // they are visited in the same order as a loop over the whole list
+  void queryRadius(const Vec3 &centre, float radius, std::vector<int> &out) const {
+    size_t start = out.size();
+    visitRadius(centre, radius, [&out](int i) {
+      out.push_back(i);
+      return true;
+    });
+    std::sort(out.begin() + start, out.end());
+  }
+
+  // Appends, in ascending order, the index of every point closer than range to apex whose direction from it is
+  // within the cone around forward (a unit vector) whose half angle has cosine minCos
+  void queryCone(const Vec3 &apex, const Vec3 &forward, float range, float minCos, std::vector<int> &out) const {
+    size_t start = out.size();
+    visitRadius(apex, range, [&](int i) {
+      Vec3 toPoint = points[i] - apex;
+      if (toPoint.length() < range && Dot(forward, toPoint.normalize()) > minCos) {
+        out.push_back(i);
+      }
+      return true;
+    });
+    std::sort(out.begin() + start, out.end());
+  }
+
+  const Vec3 &position(int i) const { return points[i]; }
+  int size() const { return (int)points.size(); }
+  int bucketCount() const { return (int)mask + 1; }
+
+private:
+  float cellSize = 2.0f;
+  float invCellSize = 0.5f;
+  unsigned mask = 0;
+  struct Entry {
+    Vec3 point;
+    int cellX, cellZ;
+    int index;
+  };
+  std::vector<Vec3> points;
+  std::vector<Entry> entries;          // Grouped by bucket
+  std::vector<int> bucketStart;        // entries[bucketStart[b] .. bucketStart[b + 1]) are the points in bucket b
+  std::vector<unsigned> pointBucket;   // Scratch for build, kept to avoid allocating each frame
+  std::vector<int> fill;
+
+  int cellX(float x) const { return (int)floorf(x * invCellSize); }
+  int cellZ(float z) const { return (int)floorf(z * invCellSize); }
+  // Neighbouring cells differ in the low bits of x and z, so the product is folded down before masking to keep them
+  // from landing in the same buckets
+  unsigned bucket(int x, int z) const {
+    unsigned h = (unsigned)x * 0x9E3779B1u + (unsigned)z * 0x85EBCA77u;
+    return (h ^ (h >> 16)) & mask;
+  }
+};
@@ -8,6 +8,7 @@
 #include <d3d12.h>
 #include "Core.h"
 #include <map>
+#include <vector>
 
 class Texture
 {
@@ -37,7 +38,7 @@ public:
 
         core->device->CreateCommittedResource(
             &heapDesc, D3D12_HEAP_FLAG_NONE, &textureDesc,
-            D3D12_RESOURCE_STATE_COPY_DEST, nullptr,
+            D3D12_RESOURCE_STATE_COMMON, nullptr,
             IID_PPV_ARGS(&tex));
 
         D3D12_PLACED_SUBRESOURCE_FOOTPRINT footprint = {};
@@ -49,7 +50,7 @@ public:
 
         unsigned long long totalSize = (unsigned long long)alignedRowPitch * height;
 
-        core->uploadResource(tex, data, totalSize, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, &footprint);
+        core->uploadResource(tex, data, totalSize, &footprint);
 
         D3D12_CPU_DESCRIPTOR_HANDLE srvHandle = core->srvHeap.getNextCPUHandle();
 
@@ -63,7 +64,12 @@ public:
         heapOffset = core->srvHeap.used - 1;
     }
 
-    void load(const std::string& filename, Core* core)
+    // Decoded texels waiting for create(), rows already padded to the 256 byte pitch the copy needs
+    std::vector<unsigned char> pixels;
+    unsigned int alignedRowPitch = 0;
+
+    // CPU side of load, safe to run on a worker thread
+    void decode(const std::string& filename)
     {
         int loadedChannels = 0;
         unsigned char* texels = stbi_load(filename.c_str(), &width, &height, &loadedChannels, 4);
@@ -74,12 +80,9 @@ public:
             width = 1;
             height = 1;
             unsigned int rowPitch = 4; 
-            unsigned int alignedRowPitch = (rowPitch + 255) & ~255;
-            unsigned char* fallbackData = new unsigned char[alignedRowPitch];
-            fallbackData[0] = 255; fallbackData[1] = 0; fallbackData[2] = 255; fallbackData[3] = 255;
-
-            upload(width, height, fallbackData, alignedRowPitch, core);
-            delete[] fallbackData;
+            alignedRowPitch = (rowPitch + 255) & ~255;
+            pixels.assign(alignedRowPitch, 0);
+            pixels[0] = 255; pixels[1] = 0; pixels[2] = 255; pixels[3] = 255;
             return;
         }
 
@@ -87,26 +90,35 @@ public:
         int bytesPerPixel = 4;
 
         unsigned int rowPitch = width * bytesPerPixel;
-        unsigned int alignedRowPitch = (rowPitch + 255) & ~255;
+        alignedRowPitch = (rowPitch + 255) & ~255;
 
         if (rowPitch == alignedRowPitch)
         {
-            upload(width, height, texels, alignedRowPitch, core);
+            pixels.assign(texels, texels + (rowPitch * height));
         }
         else
         {
-            unsigned char* alignedData = new unsigned char[alignedRowPitch * height];
+            pixels.resize(alignedRowPitch * height);
             for (int i = 0; i < height; i++)
             {
-                memcpy(&alignedData[i * alignedRowPitch], &texels[i * rowPitch], rowPitch);
+                memcpy(&pixels[i * alignedRowPitch], &texels[i * rowPitch], rowPitch);
             }
-
-            upload(width, height, alignedData, alignedRowPitch, core);
-            delete[] alignedData;
         }
 
         stbi_image_free(texels);
     }
+
+    void create(Core* core)
+    {
+        upload(width, height, pixels.data(), alignedRowPitch, core);
+        std::vector<unsigned char>().swap(pixels);
+    }
+
+    void load(const std::string& filename, Core* core)
+    {
+        decode(filename);
+        create(core);
+    }
 };
 
 class TextureManager
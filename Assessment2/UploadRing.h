@@ -0,0 +1,80 @@
+#pragma once
+
+#include <deque>
+#include <utility>
+
+// Offset bookkeeping for Core's ring of staging memory. No D3D calls, so bench-upload-ring drives it without a GPU.
+// Space handed out by allocate() is owned by the fence value passed to the next retire() and comes back
+// once release() is given a completed value at or past it.
+class UploadRing
+{
+public:
+	unsigned long long capacity = 0;
+	unsigned long long head = 0; // Bytes handed out so far, never wraps
+	unsigned long long tail = 0; // Bytes given back so far
+	unsigned long long retiredHead = 0;
+	std::deque<std::pair<unsigned long long, unsigned long long>> inFlight; // Fence value, head when retired
+	void init(unsigned long long _capacity)
+	{
+		capacity = _capacity;
+		head = 0;
+		tail = 0;
+		retiredHead = 0;
+		inFlight.clear();
+	}
+	// alignment must be a power of two that divides capacity
+	bool allocate(unsigned long long size, unsigned long long alignment, unsigned long long& offset)
+	{
+		if (size > capacity)
+		{
+			return false;
+		}
+		if (head == tail)
+		{
+			// Empty, start again from the beginning of the buffer
+			head = ((head + capacity - 1) / capacity) * capacity;
+			tail = head;
+			retiredHead = head;
+		}
+		unsigned long long start = (head + alignment - 1) & ~(alignment - 1);
+		if ((start % capacity) + size > capacity)
+		{
+			start = ((start / capacity) + 1) * capacity;
+		}
+		if (start + size - tail > capacity)
+		{
+			return false;
+		}
+		offset = start % capacity;
+		head = start + size;
+		return true;
+	}
+	void retire(unsigned long long fenceValue)
+	{
+		if (head != retiredHead)
+		{
+			inFlight.push_back({ fenceValue, head });
+			retiredHead = head;
+		}
+	}
+	void release(unsigned long long completedValue)
+	{
+		while (!inFlight.empty() && inFlight.front().first <= completedValue)
+		{
+			tail = inFlight.front().second;
+			inFlight.pop_front();
+		}
+	}
+	bool hasInFlight() const
+	{
+		return !inFlight.empty();
+	}
+	unsigned long long oldestFence() const
+	{
+		return inFlight.front().first;
+	}
+	unsigned long long used() const
+	{
+		return head - tail;
+	}
+};